@@ -21,29 +21,18 @@
 #include "camera.hpp"
 #include "draw.hpp"
 #include "logger.hpp"
+#include "alg_simd.hpp"
+#include "workpool.hpp"
 #include "alg.hpp"
 
 #define MAX2(x, y) ((x) > (y) ? (x) : (y))
-#define MAX3(x, y, z) ((x) > (y) ? ((x) > (z) ? (x) : (z)) : ((y) > (z) ? (y) : (z)))
 #define NORM               100
 #define ABS(x)             ((x) < 0 ? -(x) : (x))
 #define DIFF(x, y)         (ABS((x)-(y)))
 #define NDIFF(x, y)        (ABS(x) * NORM / (ABS(x) + 2 * DIFF(x, y)))
-#define MAXS 10000               /* max depth of stack */
 #define EXCLUDE_LEVEL_PERCENT 20
 /* Increment for *smartmask_buffer in alg_diff_standard. */
 #define SMARTMASK_SENSITIVITY_INCR 5
-#define PUSH(Y, XL, XR, DY)     /* push new segment on stack */  \
-        if (sp<stack+MAXS && Y+(DY) >= 0 && Y+(DY) < height)     \
-        {sp->y = Y; sp->xl = XL; sp->xr = XR; sp->dy = DY; sp++;}
-
-#define POP(Y, XL, XR, DY)      /* pop segment off stack */      \
-        {sp--; Y = sp->y+(DY = sp->dy); XL = sp->xl; XR = sp->xr;}
-
-typedef struct {
-    int y, xl, xr, dy;
-} Segment;
-
 
 void cls_alg::noise_tune()
 {
@@ -129,79 +118,132 @@ void cls_alg::threshold_tune()
     }
 }
 
-/*
- * Labeling by Joerg Weber. Based on an idea from Hubert Mara.
- * Floodfill enhanced by Ian McConnel based on code from
- * http://www.acm.org/pubs/tog/GraphicsGems/
- * http://www.codeproject.com/gdi/QuickFill.asp
+/* Root of the set holding run indx.  Halves the path on the way up */
+int cls_alg::label_find(int indx)
+{
+    ctx_alg_run *runs = label_runs.data();
+
+    while (runs[indx].parent != indx) {
+        runs[indx].parent = runs[runs[indx].parent].parent;
+        indx = runs[indx].parent;
+    }
+    return indx;
+}
 
- * Filled horizontal segment of scanline y for xl <= x <= xr.
- * Parent segment was on line y - dy.  dy = 1 or -1
+/* Join the sets of runs a and b.  The earlier run becomes the root */
+void cls_alg::label_union(int a, int b)
+{
+    ctx_alg_run *runs = label_runs.data();
+
+    a = label_find(a);
+    b = label_find(b);
+    if (a < b) {
+        runs[b].parent = a;
+    } else if (b < a) {
+        runs[a].parent = b;
+    }
+}
+
+/*
+ * Collect the horizontal runs of motion pixels in the changed blocks and
+ * join each run with the runs that touch it on the row above.
  */
-int cls_alg::iflood(int x, int y, int width, int height,
-        u_char *out, int *labels, int newvalue, int oldvalue)
+void cls_alg::label_runs_find()
 {
-    int l, x1, x2, dy;
-    Segment stack[MAXS], *sp = stack; /* Stack of filled segments. */
-    int count = 0;
-
-    if (x < 0 || x >= width || y < 0 || y >= height) {
-        return 0;
-    }
-
-    PUSH(y, x, x, 1);      /* Needed in some cases. */
-    PUSH(y + 1, x, x, -1); /* Seed segment (popped 1st). */
-
-    while (sp > stack) {
-        /* Pop segment off stack and fill a neighboring scan line. */
-        POP(y, x1, x2, dy);
-        /*
-         * Segment of scan line y-dy for x1<=x<=x2 was previously filled,
-         * now explore adjacent pixels in scan line y
-         */
-        for (x = x1; x >= 0 && out[y * width + x] != 0 && labels[y * width + x] == oldvalue; x--) {
-            labels[y * width + x] = newvalue;
-            count++;
+    u_char *out = cam->imgs.image_motion.image_norm;
+    int width = cam->imgs.width;
+    int height = cam->imgs.height;
+    int ix, iy, bx, x_st, x_en, prev_st, prev_en, cur_st, indx;
+    ctx_alg_run run;
+
+    label_runs.clear();
+    prev_st = prev_en = 0;
+
+    for (iy = 0; iy < height; iy++) {
+        cur_st = (int)label_runs.size();
+        bx = 0;
+        while (block_span(block_dirty, iy, bx, x_st, x_en)) {
+            ix = x_st;
+            while (ix < x_en) {
+                if (out[(iy * width) + ix] == 0) {
+                    ix++;
+                    continue;
+                }
+                run.y = iy;
+                run.x_st = ix;
+                while ((ix < width) && (out[(iy * width) + ix] != 0)) {
+                    ix++;
+                }
+                run.x_en = ix;
+                run.parent = (int)label_runs.size();
+                run.size = 0;
+                run.label = 0;
+                label_runs.push_back(run);
+            }
+            /* A run may carry on into the next span */
+            if (ix > x_en) {
+                while ((bx * DIRTY_SIZE) < ix) {
+                    bx++;
+                }
+            }
         }
 
-        if (x >= x1) {
-            goto skip;
+        /* Runs on the row above that share a column are the same label */
+        indx = cur_st;
+        while ((prev_st < prev_en) && (indx < (int)label_runs.size())) {
+            if ((label_runs[prev_st].x_st < label_runs[indx].x_en) &&
+                (label_runs[indx].x_st < label_runs[prev_st].x_en)) {
+                label_union(prev_st, indx);
+            }
+            if (label_runs[prev_st].x_en < label_runs[indx].x_en) {
+                prev_st++;
+            } else {
+                indx++;
+            }
         }
 
-        l = x + 1;
-
-        if (l < x1) {
-            PUSH(y, l, x1 - 1, -dy); /* Leak on left? */
-        }
+        prev_st = cur_st;
+        prev_en = (int)label_runs.size();
+    }
+}
 
-        x = x1 + 1;
+/*
+ * Clear the labels of the blocks that were labeled last time along with
+ * the blocks to be labeled now so only the changed blocks are touched.
+ */
+void cls_alg::labels_clear()
+{
+    int bx, by, y, width;
+    int *labels;
 
-        do {
-            for (; x < width && out[y * width + x] != 0 && labels[y * width + x] == oldvalue; x++) {
-                labels[y * width + x] = newvalue;
-                count++;
+    width = cam->imgs.width;
+    for (by = 0; by < block_h; by++) {
+        for (bx = 0; bx < block_w; bx++) {
+            if ((block_labels[by * block_w + bx] == 0) &&
+                (block_dirty[by * block_w + bx] == 0)) {
+                continue;
             }
-
-            PUSH(y, l, x - 1, dy);
-
-            if (x > x2 + 1) {
-                PUSH(y, x2 + 1, x - 1, -dy); /* Leak on right? */
+            labels = cam->imgs.labels + (by * DIRTY_SIZE * width) + (bx * DIRTY_SIZE);
+            for (y = 0; y < DIRTY_SIZE; y++) {
+                memset(labels, 0, DIRTY_SIZE * sizeof(*labels));
+                labels += width;
             }
-
-        skip:
-            for (x++; x <= x2 && !(out[y * width + x] != 0 && labels[y * width + x] == oldvalue); x++);
-            l = x;
-        } while (x <= x2);
+        }
     }
-    return count;
+    memcpy(block_labels, block_dirty, (uint)(block_w * block_h));
 }
 
+/*
+ * Label the connected groups of motion pixels.  The runs are joined into
+ * sets with a union find and the labels are then numbered in the order of
+ * the first pixel of each group with a neighbor to the right and below.
+ */
 int cls_alg::labeling()
 {
     ctx_images *imgs = &cam->imgs;
-    u_char *out = imgs->image_motion.image_norm;
-    int *labels = imgs->labels;
-    int ix, iy, pixelpos;
+    int *labels;
+    ctx_alg_run *runs, *root;
+    int indx, cnt, ix;
     int width = imgs->width;
     int height = imgs->height;
     int labelsize = 0;
@@ -216,46 +258,56 @@ int cls_alg::labeling()
     imgs->labels_above = 0;
 
     /* Init: 0 means no label set / not checked. */
-    memset(labels, 0,(uint)(width * height) * sizeof(*labels));
-    pixelpos = 0;
-
-    for (iy = 0; iy < height - 1; iy++) {
-        for (ix = 0; ix < width - 1; ix++, pixelpos++) {
-            /* No motion - no label */
-            if (out[pixelpos] == 0) {
-                labels[pixelpos] = 1;
-                continue;
-            }
+    labels_clear();
 
-            /* Already visited by alg_iflood */
-            if (labels[pixelpos] > 0) {
-                continue;
-            }
+    /* Only the blocks with changes can have labels */
+    label_runs_find();
+    runs = label_runs.data();
+    cnt = (int)label_runs.size();
 
-            labelsize = iflood(ix, iy, width, height, out, labels, current_label, 0);
+    for (indx = 0; indx < cnt; indx++) {
+        runs[indx].parent = label_find(indx);
+        runs[runs[indx].parent].size += runs[indx].x_en - runs[indx].x_st;
+    }
 
-            if (labelsize > 0) {
-                /* Label above threshold? Mark it again (add 32768 to labelnumber). */
-                if (labelsize > cam->threshold) {
-                    labelsize = iflood(ix, iy, width, height, out, labels, current_label + 32768, current_label);
-                    imgs->labelgroup_max += labelsize;
-                    imgs->labels_above++;
-                } else if(max_under < labelsize) {
-                    max_under = labelsize;
-                }
+    for (indx = 0; indx < cnt; indx++) {
+        root = &runs[runs[indx].parent];
+        if ((root->label != 0) ||
+            (runs[indx].y >= (height - 1)) || (runs[indx].x_st >= (width - 1))) {
+            continue;
+        }
 
-                if (imgs->labelsize_max < labelsize) {
-                    imgs->labelsize_max = labelsize;
-                    imgs->largest_label = current_label;
-                }
+        labelsize = root->size;
+        root->label = current_label;
 
-                cam->current_image->total_labels++;
-                current_label++;
-            }
+        /* Label above threshold? Mark it again (add 32768 to labelnumber). */
+        if (labelsize > cam->threshold) {
+            root->label += 32768;
+            imgs->labelgroup_max += labelsize;
+            imgs->labels_above++;
+        } else if(max_under < labelsize) {
+            max_under = labelsize;
         }
-        pixelpos++; /* Compensate for ix < width - 1 */
+
+        if (imgs->labelsize_max < labelsize) {
+            imgs->labelsize_max = labelsize;
+            imgs->largest_label = current_label;
+        }
+
+        cam->current_image->total_labels++;
+        current_label++;
     }
 
+    for (indx = 0; indx < cnt; indx++) {
+        root = &runs[runs[indx].parent];
+        labels = imgs->labels + (runs[indx].y * width);
+        for (ix = runs[indx].x_st; ix < runs[indx].x_en; ix++) {
+            labels[ix] = root->label;
+        }
+    }
+
+    label_runs_valid = true;
+
     /* Return group of significant labels or if that's none, the next largest
      * group (which is under the threshold, but especially for setup gives an
      * idea how close it was).
@@ -263,312 +315,408 @@ int cls_alg::labeling()
     return imgs->labelgroup_max ? imgs->labelgroup_max : max_under;
 }
 
-/**  Dilates a 3x3 box. */
-int cls_alg::dilate9(u_char *img, int width, int height, void *buffer)
+/*
+ * Find the next run of blocks set in the map for row y starting from
+ * block bx.  The run is returned as the columns x_st up to x_en.  With no
+ * map the whole row is a single run.
+ */
+bool cls_alg::block_span(const u_char *map, int y, int &bx, int &x_st, int &x_en)
 {
-    /*
-     * - row1, row2 and row3 represent lines in the temporary buffer.
-     * - Window is a sliding window containing max values of the columns
-     *   in the 3x3 matrix.
-     * - width is an index into the sliding window (this is faster than
-     *   doing modulo 3 on i).
-     * - blob keeps the current max value.
-     */
-    int y, i, sum = 0, widx;
-    u_char *row1, *row2, *row3, *rowTemp, *yp;
-    u_char window[3], blob, latest;
+    const u_char *row;
 
-    /* Set up row pointers in the temporary buffer. */
-    row1 = (u_char *)buffer;
-    row2 = row1 + width;
-    row3 = row2 + width;
+    if (map == NULL) {
+        if (bx != 0) {
+            return false;
+        }
+        bx = block_w;
+        x_st = 0;
+        x_en = cam->imgs.width;
+        return true;
+    }
 
-    /* Init rows 2 and 3. */
-    memset(row2, 0, (uint)width);
-    memcpy(row3, img, (uint)width);
+    row = map + ((y / DIRTY_SIZE) * block_w);
+    while ((bx < block_w) && (row[bx] == 0)) {
+        bx++;
+    }
+    if (bx == block_w) {
+        return false;
+    }
+    x_st = bx * DIRTY_SIZE;
+    while ((bx < block_w) && (row[bx] != 0)) {
+        bx++;
+    }
+    x_en = bx * DIRTY_SIZE;
 
-    /* Pointer to the current row in img. */
-    yp = img;
+    return true;
+}
 
-    for (y = 0; y < height; y++) {
-        /* Move down one step; row 1 becomes the previous row 2 and so on. */
-        rowTemp = row1;
-        row1 = row2;
-        row2 = row3;
-        row3 = rowTemp;
+/*
+ * Set up the morphology of the band.  Without a band the whole image is
+ * done.  Returns the map of blocks to process.
+ */
+const u_char *cls_alg::morph_setup(ctx_alg_band *band, int &y_off
+    , const u_char *&above, const u_char *&below)
+{
+    if (band == NULL) {
+        y_off = 0;
+        above = NULL;
+        below = NULL;
+        return NULL;
+    }
+    y_off = band->y_st;
+    above = band->halo_above;
+    below = band->halo_below;
 
-        /* If we're at the last row, fill with zeros, otherwise copy from img. */
-        if (y == height - 1) {
-            memset(row3, 0, (uint)width);
-        } else {
-            memcpy(row3, yp + width, (uint)width);
+    return block_active;
+}
+
+/*
+ * Erode or dilate the rows of img with the shape of op.  The rows outside
+ * of img are taken from the band halo or are set to flag.  Only the runs
+ * of the active blocks are changed and the number of pixels left set in
+ * them is returned.  The first and last columns of the changed rows are
+ * set to flag.
+ */
+int cls_alg::morph(u_char *img, int width, int height, void *buffer
+    , enum SIMD_MORPH op, u_char flag, ctx_alg_band *band)
+{
+    int y, sum = 0, y_off, bx, x_st, x_en;
+    u_char *row_above, *row_cur, *row_vert, *row_fill, *row_tmp;
+    const u_char *above, *below, *row_below, *map;
+    ctx_simd_morph mor;
+    bool reload;
+
+    map = morph_setup(band, y_off, above, below);
+
+    /* Rows before any changes, the column pass and the fill rows */
+    row_above = (u_char *)buffer;
+    row_cur = row_above + width;
+    row_vert = row_cur + width;
+    row_fill = row_vert + width;
+    memset(row_fill, flag, (uint)width);
+
+    if (above == NULL) {
+        above = row_fill;
+    }
+    if (below == NULL) {
+        below = row_fill;
+    }
+
+    mor.op = op;
+    reload = true;
+
+    for (y = 0; y < height; y++) {
+        bx = 0;
+        if (block_span(map, y_off + y, bx, x_st, x_en) == false) {
+            reload = true;
+            continue;
         }
 
-        /* Init slots 0 and 1 in the moving window. */
-        window[0] = MAX3(row1[0], row2[0], row3[0]);
-        window[1] = MAX3(row1[1], row2[1], row3[1]);
-
-        /* Init blob to the current max, and set window index. */
-        blob = MAX2(window[0], window[1]);
-        widx = 2;
-
-        /*
-         * Iterate over the current row; index i is off by one to eliminate
-         * a lot of +1es in the loop.
-         */
-        for (i = 2; i <= width - 1; i++) {
-            /* Get the max value of the next column in the 3x3 matrix. */
-            latest = window[widx] = MAX3(row1[i], row2[i], row3[i]);
-
-            /*
-             * If the value is larger than the current max, use it. Otherwise,
-             * calculate a new max (because the new value may not be the max.
-             */
-            if (latest >= blob) {
-                blob = latest;
+        /* Rows skipped are unchanged so the row above is still in img */
+        if (reload) {
+            if (y > 0) {
+                memcpy(row_above, img + (y - 1) * width, (uint)width);
             } else {
-                blob = MAX3(window[0], window[1], window[2]);
+                memcpy(row_above, above, (uint)width);
             }
+            reload = false;
+        }
+        memcpy(row_cur, img + y * width, (uint)width);
 
-            /* Write the max value (blob) to the image. */
-            if (blob != 0) {
-                *(yp + i - 1) = blob;
-                sum++;
-            }
+        if (y == height - 1) {
+            row_below = below;
+        } else {
+            row_below = img + (y + 1) * width;
+        }
 
-            /* Wrap around the window index if necessary. */
-            if (++widx == 3) {
-                widx = 0;
+        do {
+            x_st = MAX2(x_st, 1);
+            x_en = MIN(x_en, width - 1);
+            if (x_st >= x_en) {
+                continue;
             }
-        }
+            mor.above = row_above + x_st;
+            mor.cur = row_cur + x_st;
+            mor.below = row_below + x_st;
+            mor.vert = row_vert + x_st;
+            mor.out = img + (y * width) + x_st;
+            mor.count = x_en - x_st;
+            sum += simd_morph(&mor);
+        } while (block_span(map, y_off + y, bx, x_st, x_en));
+
+        img[y * width] = img[y * width + width - 1] = flag;
 
-        /* Store zeros in the vertical sides. */
-        *yp = *(yp + width - 1) = 0;
-        yp += width;
+        /* The unchanged current row is the row above for the next row */
+        row_tmp = row_above;
+        row_above = row_cur;
+        row_cur = row_tmp;
     }
 
     return sum;
 }
 
-/**  Dilates a + shape. */
-int cls_alg::dilate5(u_char *img, int width, int height, void *buffer)
+static void alg_band_process(void *arg, int indx)
 {
-    /*
-     * - row1, row2 and row3 represent lines in the temporary buffer.
-     * - mem holds the max value of the overlapping part of two + shapes.
-     */
-    int y, i, sum = 0;
-    u_char *row1, *row2, *row3, *rowTemp, *yp;
-    u_char blob, mem, latest;
-
-    /* Set up row pointers in the temporary buffer. */
-    row1 = (u_char *)buffer;
-    row2 = row1 + width;
-    row3 = row2 + width;
+    ((cls_alg *)arg)->band_process(indx);
+}
 
-    /* Init rows 2 and 3. */
-    memset(row2, 0, (uint)width);
-    memcpy(row3, img, (uint)width);
+/* Perform the current action on one band of the motion image */
+void cls_alg::band_process(int indx)
+{
+    ctx_alg_band *band = &bands[indx];
+    ctx_simd_diff dif;
+    int width = cam->imgs.width;
+    int rows = band->y_en - band->y_st;
+    u_char *img = cam->imgs.image_motion.image_norm + (band->y_st * width);
+
+    switch (band_act) {
+    case BAND_ACT_DIFF:
+        dif = band_dif;
+        diff_part(&dif, band->y_st * width, rows * width);
+        band->sum = dif.diffs;
+        band->diffs_net = dif.diffs_net;
+        break;
+    case BAND_ACT_HALO:
+        /* Rows shared with the neighbors must be saved before any changes */
+        if (band->halo_above != NULL) {
+            memcpy(band->halo_above, img - width, (uint)width);
+        }
+        if (band->halo_below != NULL) {
+            memcpy(band->halo_below, img + (rows * width), (uint)width);
+        }
+        break;
+    case BAND_ACT_ERODE9:
+        band->sum = morph(img, width, rows, band->buffer, SIMD_MORPH_ERODE9, 0, band);
+        break;
+    case BAND_ACT_ERODE5:
+        band->sum = morph(img, width, rows, band->buffer, SIMD_MORPH_ERODE5, 0, band);
+        break;
+    case BAND_ACT_DILATE9:
+        band->sum = morph(img, width, rows, band->buffer, SIMD_MORPH_DILATE9, 0, band);
+        break;
+    case BAND_ACT_DILATE5:
+        band->sum = morph(img, width, rows, band->buffer, SIMD_MORPH_DILATE5, 0, band);
+        break;
+    case BAND_ACT_MOMENTS:
+        band_moments(band);
+        break;
+    case BAND_ACT_DIST:
+        band_dist(band);
+        break;
+    }
+}
 
-    /* Pointer to the current row in img. */
-    yp = img;
+/* Perform the action on all the bands using the shared workpool */
+void cls_alg::band_run(enum ALG_BAND_ACT act)
+{
+    band_act = act;
+    cam->app->workpool->run(alg_band_process, this, band_cnt);
+}
 
-    for (y = 0; y < height; y++) {
-        /* Move down one step; row 1 becomes the previous row 2 and so on. */
-        rowTemp = row1;
-        row1 = row2;
-        row2 = row3;
-        row3 = rowTemp;
+/* Erode or dilate the motion image and return the number of pixels left */
+int cls_alg::band_morph(enum ALG_BAND_ACT act)
+{
+    int indx, sum;
 
-        /* If we're at the last row, fill with zeros, otherwise copy from img. */
-        if (y == height - 1) {
-            memset(row3, 0, (uint)width);
-        } else {
-            memcpy(row3, yp + width, (uint)width);
-        }
+    if (band_cnt > 1) {
+        band_run(BAND_ACT_HALO);
+    }
+    band_run(act);
 
-        /* Init mem and set blob to force an evaluation of the entire + shape. */
-        mem = MAX2(row2[0], row2[1]);
-        blob = 1; /* dummy value, must be > 0 */
+    sum = 0;
+    for (indx = 0; indx < band_cnt; indx++) {
+        sum += bands[indx].sum;
+    }
 
-        for (i = 1; i < width - 1; i++) {
-            /* Get the max value of the "right edge" of the + shape. */
-            latest = MAX3(row1[i], row2[i + 1], row3[i]);
+    /* Dilation can spread the changes into the blocks next to them */
+    if ((act == BAND_ACT_DILATE9) || (act == BAND_ACT_DILATE5)) {
+        memcpy(block_dirty, block_active, (uint)(block_w * block_h));
+        blocks_active();
+    }
 
-            if (blob == 0) {
-                /* In case the last blob is zero, only latest matters. */
-                blob = latest;
-                mem = row2[i + 1];
-            } else {
-                /* Otherwise, we have to check both latest and mem. */
-                blob = MAX2(mem, latest);
-                mem = MAX2(row2[i], row2[i + 1]);
-            }
+    return sum;
+}
 
-            /* Write the max value (blob) to the image. */
-            if (blob != 0) {
-                *(yp + i) = blob;
-                sum++;
+/* Mark each block with any changed pixel in the map from the diff */
+void cls_alg::blocks_dirty()
+{
+    int bx, by, y;
+    const u_char *seg;
+    u_char *blk;
+
+    seg = diff_dirty;
+    for (by = 0; by < block_h; by++) {
+        blk = block_dirty + (by * block_w);
+        memcpy(blk, seg, (uint)block_w);
+        seg += block_w;
+        for (y = 1; y < DIRTY_SIZE; y++) {
+            for (bx = 0; bx < block_w; bx++) {
+                blk[bx] |= seg[bx];
             }
+            seg += block_w;
         }
-
-        /* Store zeros in the vertical sides. */
-        *yp = *(yp + width - 1) = 0;
-        yp += width;
     }
-    return sum;
 }
 
-/**  Erodes a 3x3 box. */
-int cls_alg::erode9(u_char *img, int width, int height, void *buffer, u_char flag)
+/*
+ * The blocks to erode or dilate are the changed blocks and the blocks
+ * around them.  All other blocks and their neighbors are zero so the
+ * erode and dilate would leave them unchanged.
+ */
+void cls_alg::blocks_active()
 {
-    int y, i, sum = 0;
-    char *Row1, *Row2, *Row3;
-
-    Row1 = (char *)buffer;
-    Row2 = Row1 + width;
-    Row3 = Row1 + 2 * width;
-    memset(Row2, flag, (uint)width);
-    memcpy(Row3, img, (uint)width);
+    int bx, by, x, y;
 
-    for (y = 0; y < height; y++) {
-        memcpy(Row1, Row2, (uint)width);
-        memcpy(Row2, Row3, (uint)width);
-
-        if (y == height - 1) {
-            memset(Row3, flag, (uint)width);
-        } else {
-            memcpy(Row3, img + (y + 1) * width, (uint)width);
-        }
-
-        for (i = width - 2; i >= 1; i--) {
-            if (Row1[i - 1] == 0 ||
-                Row1[i]     == 0 ||
-                Row1[i + 1] == 0 ||
-                Row2[i - 1] == 0 ||
-                Row2[i]     == 0 ||
-                Row2[i + 1] == 0 ||
-                Row3[i - 1] == 0 ||
-                Row3[i]     == 0 ||
-                Row3[i + 1] == 0) {
-                img[y * width + i] = 0;
-            } else {
-                sum++;
+    memset(block_active, 0, (uint)(block_w * block_h));
+    for (by = 0; by < block_h; by++) {
+        for (bx = 0; bx < block_w; bx++) {
+            if (block_dirty[by * block_w + bx] == 0) {
+                continue;
+            }
+            for (y = MAX2(by - 1, 0); y <= MIN(by + 1, block_h - 1); y++) {
+                for (x = MAX2(bx - 1, 0); x <= MIN(bx + 1, block_w - 1); x++) {
+                    block_active[y * block_w + x] = 1;
+                }
             }
         }
-
-        img[y * width] = img[y * width + width - 1] = flag;
     }
-    return sum;
 }
 
-/* Erodes in a + shape. */
-int cls_alg::erode5(u_char *img, int width, int height, void *buffer, u_char flag)
+/*
+ * Split the image into the bands for the detection.  With detect_threads
+ * of 1 there is a single band which is done on the camera thread.  Each
+ * band uses six rows of the common buffer.
+ */
+void cls_alg::bands_init()
 {
-    int y, i, sum = 0;
-    char *Row1, *Row2, *Row3;
+    int indx, width, height, rows;
+    ctx_alg_band *band;
 
-    Row1 = (char *)buffer;
-    Row2 = Row1 + width;
-    Row3 = Row1 + 2 * width;
-    memset(Row2, flag, (uint)width);
-    memcpy(Row3, img, (uint)width);
+    width = cam->imgs.width;
+    height = cam->imgs.height;
 
-    for (y = 0; y < height; y++) {
-        memcpy(Row1, Row2, (uint)width);
-        memcpy(Row2, Row3, (uint)width);
+    band_cnt = cam->cfg->detect_threads;
+    if (band_cnt > (height / ALG_BAND_MIN_ROWS)) {
+        band_cnt = height / ALG_BAND_MIN_ROWS;
+    }
+    if (band_cnt < 1) {
+        band_cnt = 1;
+    }
 
-        if (y == height - 1) {
-            memset(Row3, flag, (uint)width);
+    bands = (ctx_alg_band *)mymalloc((uint)band_cnt * sizeof(ctx_alg_band));
+    memset(bands, 0, (uint)band_cnt * sizeof(ctx_alg_band));
+
+    rows = height / band_cnt;
+    for (indx = 0; indx < band_cnt; indx++) {
+        band = &bands[indx];
+        band->y_st = indx * rows;
+        if (indx == (band_cnt - 1)) {
+            band->y_en = height;
         } else {
-            memcpy(Row3, img + (y + 1) * width, (uint)width);
+            band->y_en = band->y_st + rows;
         }
-
-        for (i = width - 2; i >= 1; i--) {
-            if (Row1[i]     == 0 ||
-                Row2[i - 1] == 0 ||
-                Row2[i]     == 0 ||
-                Row2[i + 1] == 0 ||
-                Row3[i]     == 0) {
-                img[y * width + i] = 0;
-            } else {
-                sum++;
-            }
+        band->buffer = cam->imgs.common_buffer + (indx * 6 * width);
+        band->hist_x = (int *)mymalloc((uint)width * sizeof(*band->hist_x));
+        if (band->y_st > 0) {
+            band->halo_above = band->buffer + (4 * width);
+        } else {
+            band->halo_above = NULL;
+        }
+        if (band->y_en < height) {
+            band->halo_below = band->buffer + (5 * width);
+        } else {
+            band->halo_below = NULL;
         }
+    }
 
-        img[y * width] = img[y * width + width - 1] = flag;
+    if (band_cnt > 1) {
+        MOTPLS_LOG(INF, TYPE_ALL, NO_ERRNO
+            , _("Motion detection using %d threads"), band_cnt);
     }
-    return sum;
 }
 
-void cls_alg::despeckle()
+/*
+ * Compile the despeckle_filter into the list of erode and dilate actions.
+ * Anything after the labeling is ignored since no further despeckle is
+ * done after it.
+ */
+void cls_alg::despeckle_init()
 {
-    int diffs, width, height, done;
     uint i, len;
-    u_char *out, *common_buffer;
-
-    if ((cam->cfg->despeckle_filter == "") || cam->current_image->diffs <= 0) {
-        if (cam->imgs.labelsize_max) {
-            cam->imgs.labelsize_max = 0;
-        }
-        return;
-    }
 
-    diffs = 0;
-    out = cam->imgs.image_motion.image_norm;
-    width = cam->imgs.width;
-    height = cam->imgs.height;
-    done = 0;
-    len = (uint)cam->cfg->despeckle_filter.length();
-    common_buffer = cam->imgs.common_buffer;
-    cam->current_image->total_labels = 0;
-    cam->imgs.largest_label = 0;
+    despeckle_filter = cam->cfg->despeckle_filter;
+    despeckle_plan.clear();
+    despeckle_labels = false;
 
+    len = (uint)despeckle_filter.length();
     for (i = 0; i < len; i++) {
-        switch (cam->cfg->despeckle_filter[i]) {
+        switch (despeckle_filter[i]) {
         case 'E':
-            diffs = erode9(out, width, height, common_buffer, 0);
-            if (diffs == 0) {
-                i = len;
-            }
-            done = 1;
+            despeckle_plan.push_back(BAND_ACT_ERODE9);
             break;
         case 'e':
-            diffs = erode5(out, width, height, common_buffer, 0);
-            if (diffs == 0) {
-                i = len;
-            }
-            done = 1;
+            despeckle_plan.push_back(BAND_ACT_ERODE5);
             break;
         case 'D':
-            diffs = dilate9(out, width, height, common_buffer);
-            done = 1;
+            despeckle_plan.push_back(BAND_ACT_DILATE9);
             break;
         case 'd':
-            diffs = dilate5(out, width, height, common_buffer);
-            done = 1;
+            despeckle_plan.push_back(BAND_ACT_DILATE5);
             break;
-        /* No further despeckle after labeling! */
         case 'l':
-            diffs = labeling();
+            despeckle_labels = true;
             i = len;
-            done = 2;
             break;
         }
     }
+}
 
-    /* If conf.despeckle_filter contains any valid action EeDdl */
-    if (done) {
-        if (done != 2) {
-            cam->imgs.labelsize_max = 0; // Disable Labeling
+void cls_alg::despeckle()
+{
+    int diffs;
+    uint i;
+
+    if ((cam->cfg->despeckle_filter == "") || cam->current_image->diffs <= 0) {
+        if (cam->imgs.labelsize_max) {
+            cam->imgs.labelsize_max = 0;
         }
-        cam->current_image->diffs = diffs;
         return;
-    } else {
+    }
+
+    if (despeckle_filter != cam->cfg->despeckle_filter) {
+        despeckle_init();
+    }
+
+    cam->current_image->total_labels = 0;
+    cam->imgs.largest_label = 0;
+
+    /* If conf.despeckle_filter contains no valid action EeDdl */
+    if ((despeckle_plan.size() == 0) && (despeckle_labels == false)) {
         cam->imgs.labelsize_max = 0; // Disable Labeling
+        return;
     }
 
-    return;
+    blocks_dirty();
+    blocks_active();
+
+    diffs = 0;
+    for (i = 0; i < despeckle_plan.size(); i++) {
+        diffs = band_morph(despeckle_plan[i]);
+        /* Nothing is left after an erode so the rest can be skipped */
+        if ((diffs == 0) &&
+            ((despeckle_plan[i] == BAND_ACT_ERODE9) ||
+             (despeckle_plan[i] == BAND_ACT_ERODE5))) {
+            break;
+        }
+    }
+
+    /* No further despeckle after labeling! */
+    if (despeckle_labels && (i == despeckle_plan.size())) {
+        diffs = labeling();
+    } else {
+        cam->imgs.labelsize_max = 0; // Disable Labeling
+    }
+    cam->current_image->diffs = diffs;
 }
 
 void cls_alg::tune_smartmask()
@@ -608,277 +756,196 @@ void cls_alg::tune_smartmask()
         }
     }
     /* Further expansion (here:erode due to inverted logic!) of the mask. */
-    erode9(smartmask_final, cam->imgs.width, cam->imgs.height,
-                      cam->imgs.common_buffer, 255);
-    erode5(smartmask_final, cam->imgs.width, cam->imgs.height,
-                      cam->imgs.common_buffer, 255);
+    morph(smartmask_final, cam->imgs.width, cam->imgs.height,
+        cam->imgs.common_buffer, SIMD_MORPH_ERODE9, 255, NULL);
+    morph(smartmask_final, cam->imgs.width, cam->imgs.height,
+        cam->imgs.common_buffer, SIMD_MORPH_ERODE5, 255, NULL);
     smartmask_count = 5 * cam->lastrate * (11 - cam->cfg->smart_mask_speed);
 }
 
-void cls_alg::diff_nomask()
+/* Reduce the luminance of the image at src to the pyramid level at dst */
+void cls_alg::pyramid(const u_char *src, u_char *dst_max, u_char *dst_min)
 {
-    u_char *ref = cam->imgs.ref;
-    u_char *out = cam->imgs.image_motion.image_norm;
-    u_char *new_img = cam->imgs.image_vprvcy;
-
-    int i, curdiff;
-    int imgsz = cam->imgs.motionsize;
-    int diffs = 0, diffs_net = 0;
-    int noise = cam->noise;
-    int lrgchg = cam->cfg->threshold_ratio_change;
-
-    memset(out + imgsz, 128, (uint)(imgsz / 2));
-    memset(out, 0, (uint)imgsz);
-
-    for (i = 0; i < imgsz; i++) {
-        curdiff = (*ref - *new_img);
-        if (abs(curdiff) > noise) {
-            *out = *new_img;
-            diffs++;
-            if (curdiff > lrgchg) {
-                diffs_net++;
-            } else if (curdiff < -lrgchg) {
-                diffs_net--;
-            }
-        }
-        out++;
-        ref++;
-        new_img++;
-    }
-    cam->current_image->diffs_raw = diffs;
-    cam->current_image->diffs = diffs;
-    cam->imgs.image_motion.imgts = cam->current_image->imgts;
+    int width = cam->imgs.width;
+    int by;
 
-    if (diffs > 0 ) {
-        cam->current_image->diffs_ratio = (abs(diffs_net) * 100) / diffs;
-    } else {
-        cam->current_image->diffs_ratio = 100;
+    for (by = 0; by < (cam->imgs.height / PYRAMID_SCALE); by++) {
+        simd_pyramid_row(src, dst_max, dst_min, width);
+        src += width * PYRAMID_SCALE;
+        dst_max += width / PYRAMID_SCALE;
+        dst_min += width / PYRAMID_SCALE;
     }
-
 }
 
-void cls_alg::diff_mask()
+/*
+ * Quick check for whether the image has enough changes to need the
+ * standard diff.  The new image is reduced once to the largest and the
+ * smallest pixel of each block and compared to the reduced reference.
+ * A block has changed when either of them moves by more than the noise
+ * level so one pixel that turns lighter or darker than the rest of its
+ * block is still seen.  As with the sampling this replaced, the number
+ * of changes needed is scaled down by the pixels each block stands for.
+ */
+bool cls_alg::diff_fast()
 {
-    u_char *ref  = cam->imgs.ref;
-    u_char *out  = cam->imgs.image_motion.image_norm;
-    u_char *mask = cam->imgs.mask;
-    u_char *new_img = cam->imgs.image_vprvcy;
-
-    int i, curdiff;
-    int imgsz = cam->imgs.motionsize;
-    int diffs = 0, diffs_net = 0;
+    int small_cnt = (cam->imgs.width / PYRAMID_SCALE) *
+        (cam->imgs.height / PYRAMID_SCALE);
     int noise = cam->noise;
-    int lrgchg = cam->cfg->threshold_ratio_change;
+    int max_n_changes = cam->cfg->threshold / 2;
+    int indx, diffs;
 
-    memset(out + imgsz, 128, (uint)(imgsz / 2));
-    memset(out, 0, (uint)imgsz);
+    max_n_changes /= (PYRAMID_SCALE * PYRAMID_SCALE);
 
-    for (i = 0; i < imgsz; i++) {
-        curdiff = (*ref - *new_img);
-        if (mask) {
-            curdiff = ((curdiff * *mask) / 255);
-        }
+    pyramid(cam->imgs.image_vprvcy, img_max, img_min);
 
-        if (abs(curdiff) > noise) {
-            *out = *new_img;
+    diffs = 0;
+    for (indx = 0; indx < small_cnt; indx++) {
+        if ((abs(cam->imgs.ref_max[indx] - img_max[indx]) > noise) ||
+            (abs(cam->imgs.ref_min[indx] - img_min[indx]) > noise)) {
             diffs++;
-            if (curdiff > lrgchg) {
-                diffs_net++;
-            } else if (curdiff < -lrgchg) {
-                diffs_net--;
+            if (diffs > max_n_changes) {
+                return true;
             }
         }
-
-        out++;
-        ref++;
-        new_img++;
-        mask++;
-    }
-    cam->current_image->diffs_raw = diffs;
-    cam->current_image->diffs = diffs;
-    cam->imgs.image_motion.imgts = cam->current_image->imgts;
-
-    if (diffs > 0 ) {
-        cam->current_image->diffs_ratio = (abs(diffs_net) * 100) / diffs;
-    } else {
-        cam->current_image->diffs_ratio = 100;
     }
 
+    return false;
 }
 
-void cls_alg::diff_smart()
+/* Set up the parameters for differencing the full image */
+void cls_alg::diff_setup(ctx_simd_diff *dif)
 {
+    dif->ref = cam->imgs.ref;
+    dif->img = cam->imgs.image_vprvcy;
+    dif->mask = cam->imgs.mask;
+    dif->out = cam->imgs.image_motion.image_norm;
+    dif->dirty = diff_dirty;
+    dif->count = cam->imgs.motionsize;
+    dif->noise = cam->noise;
+    dif->noise_map = bg_noise;
+    dif->lrgchg = cam->cfg->threshold_ratio_change;
+    dif->diffs = 0;
+    dif->diffs_net = 0;
 
-    u_char *ref  = cam->imgs.ref;
-    u_char *out  = cam->imgs.image_motion.image_norm;
-    u_char *mask_final = smartmask_final;
-    u_char *new_img = cam->imgs.image_vprvcy;
-
-    int i, curdiff;
-    int imgsz = cam->imgs.motionsize;
-    int diffs = 0, diffs_net = 0;
-    int noise = cam->noise;
-    int *mask_buffer = smartmask_buffer;
-    int lrgchg = cam->cfg->threshold_ratio_change;
-
-    imgsz = cam->imgs.motionsize;
-    memset(out + imgsz, 128, (uint)(imgsz / 2));
-    memset(out, 0, (uint)imgsz);
-
-    for (i = 0; i < imgsz; i++) {
-        curdiff = (*ref - *new_img);
-        if (cam->cfg->smart_mask_speed) {
-            if (abs(curdiff) > noise) {
-                if (cam->event_curr_nbr != cam->event_prev_nbr) {
-                    (*mask_buffer) += SMARTMASK_SENSITIVITY_INCR;
-                }
-                if (!*mask_final) {
-                    curdiff = 0;
-                }
-            }
-            mask_final++;
-            mask_buffer++;
-        }
-        /* Pixel still in motion after all the masks? */
-        if (abs(curdiff) > noise) {
-            *out = *new_img;
-            diffs++;
-            if (curdiff > lrgchg) {
-                diffs_net++;
-            } else if (curdiff < -lrgchg) {
-                diffs_net--;
-            }
+    if (cam->cfg->smart_mask_speed == 0) {
+        dif->mask_final = NULL;
+        dif->mask_buffer = NULL;
+        dif->mask_incr = 0;
+    } else {
+        dif->mask_final = smartmask_final;
+        dif->mask_buffer = smartmask_buffer;
+        if (cam->event_curr_nbr != cam->event_prev_nbr) {
+            dif->mask_incr = SMARTMASK_SENSITIVITY_INCR;
+        } else {
+            dif->mask_incr = 0;
         }
-        out++;
-        ref++;
-        new_img++;
     }
-    cam->current_image->diffs_raw = diffs;
-    cam->current_image->diffs = diffs;
+
+    /* Every byte of the motion image is written by the diff */
+    memset(dif->out + dif->count, 128, (uint)(dif->count / 2));
+}
+
+void cls_alg::diff_result(ctx_simd_diff *dif)
+{
+    cam->current_image->diffs_raw = dif->diffs;
+    cam->current_image->diffs = dif->diffs;
     cam->imgs.image_motion.imgts = cam->current_image->imgts;
 
-    if (diffs > 0 ) {
-        cam->current_image->diffs_ratio = (abs(diffs_net) * 100) / diffs;
+    if (dif->diffs > 0 ) {
+        cam->current_image->diffs_ratio = (abs(dif->diffs_net) * 100) / dif->diffs;
     } else {
         cam->current_image->diffs_ratio = 100;
     }
 }
 
-void cls_alg::diff_masksmart()
+/* Difference len pixels of the luminance starting at indx */
+void cls_alg::diff_part(ctx_simd_diff *dif, int indx, int len)
 {
-    u_char *ref = cam->imgs.ref;
-    u_char *out = cam->imgs.image_motion.image_norm;
-    u_char *mask = cam->imgs.mask;
-    u_char *mask_final = smartmask_final;
-    u_char *new_img = cam->imgs.image_vprvcy;
-
-    int i, curdiff;
-    int imgsz = cam->imgs.motionsize;
-    int diffs = 0, diffs_net = 0;
-    int noise = cam->noise;
-    int *mask_buffer = smartmask_buffer;
-    int lrgchg = cam->cfg->threshold_ratio_change;
-
-    imgsz= cam->imgs.motionsize;
-    memset(out + imgsz, 128, ((uint)imgsz / 2));
-    memset(out, 0, (uint)imgsz);
-
-    for (i = 0; i < imgsz; i++) {
-        curdiff = (*ref - *new_img);
-        if (mask) {
-            curdiff = ((curdiff * *mask) / 255);
-        }
-
-        if (cam->cfg->smart_mask_speed) {
-            if (abs(curdiff) > noise) {
-                if (cam->event_curr_nbr != cam->event_prev_nbr) {
-                    (*mask_buffer) += SMARTMASK_SENSITIVITY_INCR;
-                }
-                if (!*mask_final) {
-                    curdiff = 0;
-                }
-            }
-            mask_final++;
-            mask_buffer++;
-        }
-
-        /* Pixel still in motion after all the masks? */
-        if (abs(curdiff) > noise) {
-            *out = *new_img;
-            diffs++;
-            if (curdiff > lrgchg) {
-                diffs_net++;
-            } else if (curdiff < -lrgchg) {
-                diffs_net--;
-            }
-        }
-
-        out++;
-        ref++;
-        new_img++;
-        mask++;
+    dif->ref += indx;
+    dif->img += indx;
+    if (dif->mask != NULL) {
+        dif->mask += indx;
+    }
+    if (dif->mask_final != NULL) {
+        dif->mask_final += indx;
+        dif->mask_buffer += indx;
+    }
+    if (dif->noise_map != NULL) {
+        dif->noise_map += indx;
+    }
+    dif->out += indx;
+    if (dif->dirty != NULL) {
+        dif->dirty += indx / DIRTY_SIZE;
     }
+    dif->count = len;
 
-    cam->current_image->diffs_raw = diffs;
-    cam->current_image->diffs = diffs;
-    cam->imgs.image_motion.imgts = cam->current_image->imgts;
+    simd_diff(dif);
+}
 
-    if (diffs > 0 ) {
-        cam->current_image->diffs_ratio = (abs(diffs_net) * 100) / diffs;
+void cls_alg::diff_standard()
+{
+    int indx;
+    ctx_simd_diff dif;
+
+    diff_setup(&dif);
+    if (band_cnt > 1) {
+        band_dif = dif;
+        band_run(BAND_ACT_DIFF);
+        for (indx = 0; indx < band_cnt; indx++) {
+            dif.diffs += bands[indx].sum;
+            dif.diffs_net += bands[indx].diffs_net;
+        }
     } else {
-        cam->current_image->diffs_ratio = 100;
+        simd_diff(&dif);
     }
-
+    diff_result(&dif);
 }
 
-bool cls_alg::diff_fast()
+/*
+ * While motion is being detected the standard diff is always done so it
+ * can be done by the capture on each strip of the image while that strip
+ * is still in the cache.  Returns whether the strips should be sent.
+ * When the bands are done in parallel the diff is left to the bands.
+ */
+bool cls_alg::diff_strip_start()
 {
-    ctx_images *imgs = &cam->imgs;
-    int i, curdiff, diffs = 0;
-    int step = cam->imgs.motionsize / 10000;
-    int noise = cam->noise;
-    int max_n_changes = cam->cfg->threshold / 2;
-    u_char *ref = imgs->ref;
-    u_char *new_img = cam->imgs.image_vprvcy;
+    diff_strip_done = false;
 
-    if (!step % 2) {
-        step++;
+    if ((cam->detecting_motion == false) || (band_cnt > 1) ||
+        (cam->frame_skip != 0) || (cam->pause == true)) {
+        diff_strip_active = false;
+        return false;
     }
 
-    max_n_changes /= step;
+    diff_setup(&diff_strip_dif);
+    diff_strip_active = true;
 
-    i = imgs->motionsize;
+    return true;
+}
 
-    for (; i > 0; i -= step) {
-        curdiff = abs(*ref - *new_img); /* Using a temp variable is 12% faster. */
-        if (curdiff >  noise) {
-            diffs++;
-            if (diffs > max_n_changes) {
-               return true;
-            }
-        }
-        ref += step;
-        new_img += step;
+void cls_alg::diff_strip(int indx, int len)
+{
+    ctx_simd_diff dif;
+
+    if (diff_strip_active == false) {
+        return;
     }
 
-    return false;
+    dif = diff_strip_dif;
+    diff_part(&dif, indx, len);
+
+    diff_strip_dif.diffs += dif.diffs;
+    diff_strip_dif.diffs_net += dif.diffs_net;
 }
 
-void cls_alg::diff_standard()
+void cls_alg::diff_strip_finish()
 {
-    if (cam->cfg->smart_mask_speed == 0) {
-        if (cam->imgs.mask == NULL) {
-            diff_nomask();
-        } else {
-            diff_mask();
-        }
-    } else {
-        if (cam->imgs.mask == NULL) {
-            diff_smart();
-        } else {
-            diff_masksmart();
-        }
+    if (diff_strip_active == false) {
+        return;
     }
+    diff_result(&diff_strip_dif);
+    diff_strip_active = false;
+    diff_strip_done = true;
 }
 
 void cls_alg::lightswitch()
@@ -895,82 +962,241 @@ void cls_alg::lightswitch()
     }
 }
 
+/*
+ * The reduced reference used by diff_fast is made from each row of blocks
+ * just after they are updated and while they are still in the cache.
+ */
 void cls_alg::ref_frame_update()
 {
-    int accept_timer;
-    int i, threshold_ref;
-    int *ref_dyn = cam->imgs.ref_dyn;
-    u_char *image_virgin = cam->imgs.image_vprvcy;
-    u_char *ref = cam->imgs.ref;
-    u_char *mask_final = smartmask_final;
-    u_char *out = cam->imgs.image_motion.image_norm;
+    ctx_simd_ref upd;
+    int by, len, small_w;
 
-    accept_timer = cam->cfg->static_object_time * cam->cfg->framerate;
-    threshold_ref = cam->noise * EXCLUDE_LEVEL_PERCENT / 100;
-
-    for (i = cam->imgs.motionsize; i > 0; i--) {
-        /* Exclude pixels from ref frame well below noise level. */
-        if (((int)(abs(*ref - *image_virgin)) > threshold_ref) && (*mask_final)) {
-            if (*ref_dyn == 0) { /* Always give new pixels a chance. */
-                *ref_dyn = 1;
-            } else if (*ref_dyn > accept_timer) { /* Include static Object after some time. */
-                *ref_dyn = 0;
-                *ref = *image_virgin;
-            } else if (*out) {
-                (*ref_dyn)++; /* Motionpixel? Keep excluding from ref frame. */
-            } else {
-                *ref_dyn = 0; /* Nothing special - release pixel. */
-                *ref = (u_char)((*ref + *image_virgin) / 2);
-            }
-        } else {  /* No motion: copy to ref frame. */
-            *ref_dyn = 0; /* Reset pixel */
-            *ref = *image_virgin;
-        }
+    if (bg_mean != NULL) {
+        bg_update();
+        return;
+    }
 
-        ref++;
-        image_virgin++;
-        mask_final++;
-        ref_dyn++;
-        out++;
+    len = cam->imgs.width * PYRAMID_SCALE;
+    small_w = cam->imgs.width / PYRAMID_SCALE;
+
+    upd.ref = cam->imgs.ref;
+    upd.dyn = cam->imgs.ref_dyn;
+    upd.img = cam->imgs.image_vprvcy;
+    upd.mask_final = smartmask_final;
+    upd.out = cam->imgs.image_motion.image_norm;
+    upd.count = len;
+    upd.threshold = cam->noise * EXCLUDE_LEVEL_PERCENT / 100;
+    upd.weight = (cam->cfg->reference_weight * 256) / 100;
+
+    /* The exclusion counts are words so the time is limited to what they hold */
+    upd.accept = cam->cfg->static_object_time * cam->cfg->framerate;
+    if (upd.accept > (UINT16_MAX - 1)) {
+        upd.accept = UINT16_MAX - 1;
     }
 
+    for (by = 0; by < (cam->imgs.height / PYRAMID_SCALE); by++) {
+        simd_ref_update(&upd);
+        simd_pyramid_row(upd.ref, cam->imgs.ref_max + (by * small_w)
+            , cam->imgs.ref_min + (by * small_w), cam->imgs.width);
+        upd.ref += len;
+        upd.dyn += len;
+        upd.img += len;
+        upd.mask_final += len;
+        upd.out += len;
+    }
+    upd.count = cam->imgs.motionsize - (by * len);
+    if (upd.count > 0) {
+        simd_ref_update(&upd);
+    }
+
+}
+
+/*
+ * Update the running gaussian background.  The reference frame is its
+ * mean and the noise level of each pixel is raised by its deviation so
+ * pixels that are always changing such as trees and water need larger
+ * changes to count as motion.
+ */
+void cls_alg::bg_update()
+{
+    ctx_simd_bg bg;
+    int by, len, small_w;
+
+    len = cam->imgs.width * PYRAMID_SCALE;
+    small_w = cam->imgs.width / PYRAMID_SCALE;
+
+    bg.mean = bg_mean;
+    bg.dev = bg_dev;
+    bg.ref = cam->imgs.ref;
+    bg.noise_map = bg_noise;
+    bg.img = cam->imgs.image_vprvcy;
+    bg.out = cam->imgs.image_motion.image_norm;
+    bg.count = len;
+    bg.noise = cam->noise;
+
+    for (by = 0; by < (cam->imgs.height / PYRAMID_SCALE); by++) {
+        simd_bg_update(&bg);
+        simd_pyramid_row(bg.ref, cam->imgs.ref_max + (by * small_w)
+            , cam->imgs.ref_min + (by * small_w), cam->imgs.width);
+        bg.mean += len;
+        bg.dev += len;
+        bg.ref += len;
+        bg.noise_map += len;
+        bg.img += len;
+        bg.out += len;
+    }
+    bg.count = cam->imgs.motionsize - (by * len);
+    if (bg.count > 0) {
+        simd_bg_update(&bg);
+    }
 }
 
 void cls_alg::ref_frame_reset()
 {
+    int indx;
+
     /* Copy fresh image */
     memcpy(cam->imgs.ref, cam->imgs.image_vprvcy, (uint)cam->imgs.size_norm);
     /* Reset static objects */
     memset(cam->imgs.ref_dyn, 0
         ,(uint)cam->imgs.motionsize * sizeof(*cam->imgs.ref_dyn));
 
+    if (bg_mean != NULL) {
+        for (indx = 0; indx < cam->imgs.motionsize; indx++) {
+            bg_mean[indx] = (uint16_t)(cam->imgs.image_vprvcy[indx] << 8);
+        }
+        memset(bg_dev, 0, (uint)cam->imgs.motionsize * sizeof(*bg_dev));
+        memset(bg_noise, (u_char)MIN(MAX(cam->noise, 0), 255), (uint)cam->imgs.motionsize);
+    }
+
+    pyramid(cam->imgs.ref, cam->imgs.ref_max, cam->imgs.ref_min);
+
 }
 
-/*Calculate the center location of changes*/
-void cls_alg::location_center()
+/*
+ * Count the changes in each row and column of the band.  Groups of
+ * DIRTY_SIZE pixels with no changes are skipped together.
+ */
+void cls_alg::band_moments(ctx_alg_band *band)
+{
+    int width = cam->imgs.width;
+    const u_char *out = cam->imgs.image_motion.image_norm + (band->y_st * width);
+    int x, y, indx, cnt;
+    uint64_t blk;
+
+    memset(band->hist_x, 0, (uint)width * sizeof(*band->hist_x));
+
+    for (y = band->y_st; y < band->y_en; y++) {
+        cnt = 0;
+        for (x = 0; x < width; x += DIRTY_SIZE) {
+            memcpy(&blk, out + x, sizeof(blk));
+            if (blk == 0) {
+                continue;
+            }
+            for (indx = x; indx < (x + DIRTY_SIZE); indx++) {
+                if (out[indx]) {
+                    band->hist_x[indx]++;
+                    cnt++;
+                }
+            }
+        }
+        loc_rows[y] = cnt;
+        out += width;
+    }
+}
+
+/*
+ * Add up the distances of the changes in the band from the center and
+ * the squares of the distances.  Rows with no changes are skipped.
+ */
+void cls_alg::band_dist(ctx_alg_band *band)
 {
     int width = cam->imgs.width;
-    int height = cam->imgs.height;
     ctx_coord *cent = &cam->current_image->location;
-    u_char *out = cam->imgs.image_motion.image_norm;
-    int x, y, centc = 0;
+    const u_char *out;
+    int x, y;
+    int64_t dist;
 
-    cent->x = 0;
-    cent->y = 0;
+    band->distance_sum = 0;
+    band->distance_sq = 0;
 
-    for (y = 0; y < height; y++) {
+    for (y = band->y_st; y < band->y_en; y++) {
+        if (loc_rows[y] == 0) {
+            continue;
+        }
+        out = cam->imgs.image_motion.image_norm + (y * width);
         for (x = 0; x < width; x++) {
-            if (*(out++)) {
-                cent->x += x;
-                cent->y += y;
-                centc++;
+            if (out[x]) {
+                dist = (int64_t)sqrt(((x - cent->x) * (x - cent->x)) +
+                    ((y - cent->y) * (y - cent->y)));
+                band->distance_sum += dist;
+                band->distance_sq += dist * dist;
             }
         }
     }
+}
 
+/*
+ * Count the changes in each row and column of the motion image.  When the
+ * labeling was done on this image the counts come from its runs.
+ */
+void cls_alg::location_moments()
+{
+    int width = cam->imgs.width;
+    int height = cam->imgs.height;
+    ctx_alg_run *run;
+    int indx, x;
+
+    if (label_runs_valid) {
+        memset(loc_cols, 0, (uint)(width + 1) * sizeof(*loc_cols));
+        memset(loc_rows, 0, (uint)height * sizeof(*loc_rows));
+        for (indx = 0; indx < (int)label_runs.size(); indx++) {
+            run = &label_runs[indx];
+            loc_rows[run->y] += run->x_en - run->x_st;
+            loc_cols[run->x_st]++;
+            loc_cols[run->x_en]--;
+        }
+        for (x = 1; x < width; x++) {
+            loc_cols[x] += loc_cols[x - 1];
+        }
+        return;
+    }
+
+    band_run(BAND_ACT_MOMENTS);
+
+    memcpy(loc_cols, bands[0].hist_x, (uint)width * sizeof(*loc_cols));
+    for (indx = 1; indx < band_cnt; indx++) {
+        for (x = 0; x < width; x++) {
+            loc_cols[x] += bands[indx].hist_x[x];
+        }
+    }
+}
+
+/*Calculate the center location of changes*/
+void cls_alg::location_center()
+{
+    int width = cam->imgs.width;
+    int height = cam->imgs.height;
+    ctx_coord *cent = &cam->current_image->location;
+    int x, y;
+    int64_t sum_x, sum_y, centc;
+
+    sum_x = 0;
+    sum_y = 0;
+    centc = 0;
+    for (x = 0; x < width; x++) {
+        sum_x += (int64_t)x * loc_cols[x];
+    }
+    for (y = 0; y < height; y++) {
+        sum_y += (int64_t)y * loc_rows[y];
+        centc += loc_rows[y];
+    }
+
+    cent->x = 0;
+    cent->y = 0;
     if (centc) {
-        cent->x = cent->x / centc;
-        cent->y = cent->y / centc;
+        cent->x = (int)(sum_x / centc);
+        cent->y = (int)(sum_y / centc);
     }
 
     /* This allows for the redcross and boxes to be drawn*/
@@ -989,126 +1215,89 @@ void cls_alg::location_center()
 
 }
 
-/*Calculate distribution and variances of changes*/
-void cls_alg::location_dist_stddev()
+/*
+ * Calculate distribution and variances of changes.  The distances and
+ * variances along each axis come from the row and column counts.  Only
+ * the distances from the center need another pass over the changes.
+ */
+void cls_alg::location_dist()
 {
-    ctx_images *imgs = &cam->imgs;
     int width = cam->imgs.width;
     int height = cam->imgs.height;
     ctx_coord *cent = &cam->current_image->location;
-    u_char *out = imgs->image_motion.image_norm;
-    int x, y, centc = 0, xdist = 0, ydist = 0;
-    int64_t variance_x, variance_y, variance_xy, distance_mean;
+    ctx_alg_run *run;
+    int indx, x, y, dx, dy;
+    int64_t centc, xdist, ydist, dist;
+    int64_t variance_x, variance_y, variance_xy;
+    int64_t distance_sum, distance_sq, distance_mean;
 
     cent->maxx = 0;
     cent->maxy = 0;
     cent->minx = width;
     cent->miny = height;
+
+    centc = 0;
+    xdist = 0;
+    ydist = 0;
     variance_x = 0;
     variance_y = 0;
-    distance_mean = 0;
-
+    for (x = 0; x < width; x++) {
+        dx = x - cent->x;
+        xdist += (int64_t)abs(dx) * loc_cols[x];
+        variance_x += (int64_t)(dx * dx) * loc_cols[x];
+    }
     for (y = 0; y < height; y++) {
-        for (x = 0; x < width; x++) {
-            if (*(out++)) {
-                variance_x += ((x - cent->x) * (x - cent->x));
-                variance_y += ((y - cent->y) * (y - cent->y));
-                distance_mean += (int64_t)sqrt(
-                        ((x - cent->x) * (x - cent->x)) +
-                        ((y - cent->y) * (y - cent->y)));
-
-                if (x > cent->x) {
-                    xdist += x - cent->x;
-                } else if (x < cent->x) {
-                    xdist += cent->x - x;
-                }
-
-                if (y > cent->y) {
-                    ydist += y - cent->y;
-                } else if (y < cent->y) {
-                    ydist += cent->y - y;
-                }
-
-                centc++;
-            }
-        }
+        dy = y - cent->y;
+        ydist += (int64_t)abs(dy) * loc_rows[y];
+        variance_y += (int64_t)(dy * dy) * loc_rows[y];
+        centc += loc_rows[y];
     }
 
     if (centc) {
-        cent->minx = cent->x - xdist / centc * 3;
-        cent->maxx = cent->x + xdist / centc * 3;
-        cent->miny = cent->y - ydist / centc * 3;
-        cent->maxy = cent->y + ydist / centc * 3;
-        cent->stddev_x = (int)sqrt((variance_x / centc));
-        cent->stddev_y = (int)sqrt((variance_y / centc));
-        distance_mean = (int64_t)(distance_mean / centc);
+        cent->minx = cent->x - (int)(xdist / centc) * 3;
+        cent->maxx = cent->x + (int)(xdist / centc) * 3;
+        cent->miny = cent->y - (int)(ydist / centc) * 3;
+        cent->maxy = cent->y + (int)(ydist / centc) * 3;
     } else {
         cent->stddev_y = 0;
         cent->stddev_x = 0;
-        distance_mean = 0;
     }
 
-    variance_xy = 0;
-    out = imgs->image_motion.image_norm;
-    for (y = 0; y < height; y++) {
-        for (x = 0; x < width; x++) {
-            if (*(out++)) {
-                variance_xy += (
-                    ((int64_t)sqrt(((x - cent->x) * (x - cent->x)) +
-                          ((y - cent->y) * (y - cent->y))) - distance_mean) *
-                    ((int64_t)sqrt(((x - cent->x) * (x - cent->x)) +
-                          ((y - cent->y) * (y - cent->y))) - distance_mean));
-            }
-        }
-    }
-    /* Per statistics, divide by n-1 for calc of a standard deviation */
-    if ((centc-1) > 0) {
-        cent->stddev_xy = (int)sqrt((variance_xy / (centc-1)));
+    if ((calc_stddev == false) || (centc == 0)) {
+        return;
     }
-}
-
-void cls_alg::location_dist_basic()
-{
-    ctx_images *imgs = &cam->imgs;
-    int width = cam->imgs.width;
-    int height = cam->imgs.height;
-    ctx_coord *cent = &cam->current_image->location;
-    u_char *out = imgs->image_motion.image_norm;
-    int x, y, centc = 0, xdist = 0, ydist = 0;
-
-    cent->maxx = 0;
-    cent->maxy = 0;
-    cent->minx = width;
-    cent->miny = height;
-
-    for (y = 0; y < height; y++) {
-        for (x = 0; x < width; x++) {
-            if (*(out++)) {
-                if (x > cent->x) {
-                    xdist += x - cent->x;
-                } else if (x < cent->x) {
-                    xdist += cent->x - x;
-                }
 
-                if (y > cent->y) {
-                    ydist += y - cent->y;
-                } else if (y < cent->y) {
-                    ydist += cent->y - y;
-                }
-
-                centc++;
+    cent->stddev_x = (int)sqrt((variance_x / centc));
+    cent->stddev_y = (int)sqrt((variance_y / centc));
+
+    distance_sum = 0;
+    distance_sq = 0;
+    if (label_runs_valid) {
+        for (indx = 0; indx < (int)label_runs.size(); indx++) {
+            run = &label_runs[indx];
+            dy = run->y - cent->y;
+            for (x = run->x_st; x < run->x_en; x++) {
+                dist = (int64_t)sqrt(((x - cent->x) * (x - cent->x)) + (dy * dy));
+                distance_sum += dist;
+                distance_sq += dist * dist;
             }
         }
+    } else {
+        band_run(BAND_ACT_DIST);
+        for (indx = 0; indx < band_cnt; indx++) {
+            distance_sum += bands[indx].distance_sum;
+            distance_sq += bands[indx].distance_sq;
+        }
     }
+    distance_mean = distance_sum / centc;
 
-    if (centc) {
-        cent->minx = cent->x - xdist / centc * 3;
-        cent->maxx = cent->x + xdist / centc * 3;
-        cent->miny = cent->y - ydist / centc * 3;
-        cent->maxy = cent->y + ydist / centc * 3;
-    } else {
-        cent->stddev_y = 0;
-        cent->stddev_x = 0;
+    /* Sum of the squared differences from the mean distance */
+    variance_xy = distance_sq - (2 * distance_mean * distance_sum)
+        + (centc * distance_mean * distance_mean);
+
+    /* Per statistics, divide by n-1 for calc of a standard deviation */
+    if ((centc-1) > 0) {
+        cent->stddev_xy = (int)sqrt((variance_xy / (centc-1)));
     }
 }
 
@@ -1158,12 +1347,9 @@ void cls_alg::location_minmax()
 /* Determine the location and standard deviations of changes*/
 void cls_alg::location()
 {
+    location_moments();
     location_center();
-    if (calc_stddev) {
-        location_dist_stddev();
-    } else {
-        location_dist_basic();
-    }
+    location_dist();
     location_minmax();
 }
 
@@ -1193,7 +1379,11 @@ void cls_alg::stddev()
 
 void cls_alg::diff()
 {
-    if (cam->detecting_motion) {
+    label_runs_valid = false;
+    if (diff_strip_done) {
+        /* Already done with the capture */
+        diff_strip_done = false;
+    } else if (cam->detecting_motion) {
         diff_standard();
     } else {
         if (diff_fast()) {
@@ -1234,13 +1424,66 @@ cls_alg::cls_alg(cls_camera *p_cam)
         diffs_last[i] = 0;
     }
 
+    diff_strip_active = false;
+    diff_strip_done = false;
+
+    bands_init();
+    despeckle_init();
+
+    if (cam->cfg->background_model == "gaussian") {
+        bg_mean = (uint16_t*) mymalloc((uint)cam->imgs.motionsize * sizeof(*bg_mean));
+        bg_dev = (uint16_t*) mymalloc((uint)cam->imgs.motionsize * sizeof(*bg_dev));
+        bg_noise = (u_char*) mymalloc((uint)cam->imgs.motionsize);
+        memset(bg_mean, 0, (uint)cam->imgs.motionsize * sizeof(*bg_mean));
+        memset(bg_dev, 0, (uint)cam->imgs.motionsize * sizeof(*bg_dev));
+        memset(bg_noise, 0, (uint)cam->imgs.motionsize);
+    } else {
+        bg_mean = NULL;
+        bg_dev = NULL;
+        bg_noise = NULL;
+    }
+
+    label_runs_valid = false;
+    loc_cols = (int*) mymalloc((uint)(cam->imgs.width + 1) * sizeof(*loc_cols));
+    loc_rows = (int*) mymalloc((uint)cam->imgs.height * sizeof(*loc_rows));
+
+    block_w = cam->imgs.width / DIRTY_SIZE;
+    block_h = cam->imgs.height / DIRTY_SIZE;
+    diff_dirty = (u_char*) mymalloc((uint)cam->imgs.motionsize / DIRTY_SIZE);
+    block_dirty = (u_char*) mymalloc((uint)(block_w * block_h));
+    block_active = (u_char*) mymalloc((uint)(block_w * block_h));
+    block_labels = (u_char*) mymalloc((uint)(block_w * block_h));
+    memset(block_labels, 1, (uint)(block_w * block_h));
+
+    img_max = (u_char*) mymalloc((uint)cam->imgs.motionsize /
+        (PYRAMID_SCALE * PYRAMID_SCALE));
+    img_min = (u_char*) mymalloc((uint)cam->imgs.motionsize /
+        (PYRAMID_SCALE * PYRAMID_SCALE));
+
 }
 
 cls_alg::~cls_alg()
 {
+    int i;
+
     myfree(smartmask);
     myfree(smartmask_final);
     myfree(smartmask_buffer);
+    for (i = 0; i < band_cnt; i++) {
+        myfree(bands[i].hist_x);
+    }
+    myfree(bands);
+    myfree(loc_cols);
+    myfree(loc_rows);
+    myfree(bg_mean);
+    myfree(bg_dev);
+    myfree(bg_noise);
+    myfree(diff_dirty);
+    myfree(block_dirty);
+    myfree(block_active);
+    myfree(block_labels);
+    myfree(img_max);
+    myfree(img_min);
 
 }
 
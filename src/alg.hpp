@@ -19,6 +19,45 @@
 #ifndef _INCLUDE_ALG_HPP_
 #define _INCLUDE_ALG_HPP_
     #define THRESHOLD_TUNE_LENGTH  256
+    #define ALG_BAND_MIN_ROWS      16
+
+    enum ALG_BAND_ACT {
+        BAND_ACT_DIFF,
+        BAND_ACT_HALO,
+        BAND_ACT_ERODE9,
+        BAND_ACT_ERODE5,
+        BAND_ACT_DILATE9,
+        BAND_ACT_DILATE5,
+        BAND_ACT_MOMENTS,
+        BAND_ACT_DIST
+    };
+
+    /*
+     * A horizontal band of the motion image.  The detection is done on each
+     * band independently and the partial results are then added together.
+     */
+    struct ctx_alg_band {
+        int         y_st;           /* First row of the band */
+        int         y_en;           /* Row after the last row of the band */
+        u_char      *buffer;        /* Rows for erode/dilate */
+        u_char      *halo_above;    /* Row before the band prior to erode/dilate */
+        u_char      *halo_below;    /* Row after the band prior to erode/dilate */
+        int         sum;
+        int         diffs_net;
+        int         *hist_x;        /* Changes in each column of the band */
+        int64_t     distance_sum;   /* Distances of the changes from the center */
+        int64_t     distance_sq;    /* Squares of the distances from the center */
+    };
+
+    /* A horizontal run of motion pixels and its set for the labeling */
+    struct ctx_alg_run {
+        int         y;
+        int         x_st;           /* First column of the run */
+        int         x_en;           /* Column after the last column of the run */
+        int         parent;         /* Index of the parent run in the set */
+        int         size;           /* Pixels in the set.  Only valid on the root */
+        int         label;          /* Label of the set.  Only valid on the root */
+    };
 
     class cls_alg {
         public:
@@ -32,6 +71,10 @@
             void ref_frame_reset();
             void stddev();
             void location();
+            bool diff_strip_start();
+            void diff_strip(int indx, int len);
+            void diff_strip_finish();
+            void band_process(int indx);
             u_char  *smartmask_final;
         private:
             cls_camera *cam;
@@ -40,25 +83,62 @@
             int     *smartmask_buffer;
             int     diffs_last[THRESHOLD_TUNE_LENGTH];
             bool    calc_stddev;
+            bool    diff_strip_active;  /* Diff is being done by the capture strips */
+            bool    diff_strip_done;    /* Diff for this image was done by the capture */
+            ctx_simd_diff   diff_strip_dif;
+            int             band_cnt;
+            ctx_alg_band    *bands;
+            enum ALG_BAND_ACT   band_act;
+            ctx_simd_diff   band_dif;
+            u_char          *img_max;       /* Largest pixel of each block of the new image */
+            u_char          *img_min;       /* Smallest pixel of each block of the new image */
+            u_char          *diff_dirty;    /* From the diff, any change in each DIRTY_SIZE pixels */
+            int             block_w;        /* Number of blocks across the image */
+            int             block_h;        /* Number of blocks down the image */
+            u_char          *block_dirty;   /* Blocks with any changed pixels */
+            u_char          *block_active;  /* Blocks to erode or dilate */
+            u_char          *block_labels;  /* Blocks that may hold labels from the last labeling */
+            std::vector<ctx_alg_run>    label_runs;
+            bool            label_runs_valid;   /* The runs are of the current motion image */
+            int             *loc_cols;      /* Changes in each column of the motion image */
+            int             *loc_rows;      /* Changes in each row of the motion image */
+            uint16_t        *bg_mean;       /* Gaussian background mean.  NULL when not in use */
+            uint16_t        *bg_dev;        /* Gaussian background mean deviation */
+            u_char          *bg_noise;      /* Noise level of each pixel from the background */
+            std::string     despeckle_filter;   /* Filter the plan was compiled from */
+            std::vector<enum ALG_BAND_ACT>  despeckle_plan;
+            bool            despeckle_labels;   /* Labeling is done after the plan */
 
-            int iflood(int x, int y, int width, int height,
-                u_char *out, int *labels, int newvalue, int oldvalue);
+            int label_find(int indx);
+            void label_union(int a, int b);
+            void label_runs_find();
+            void labels_clear();
             int labeling();
-            int dilate9(u_char *img, int width, int height, void *buffer);
-            int dilate5(u_char *img, int width, int height, void *buffer);
-            int erode9(u_char *img, int width, int height, void *buffer, u_char flag);
-            int erode5(u_char *img, int width, int height, void *buffer, u_char flag);
+            bool block_span(const u_char *map, int y, int &bx, int &x_st, int &x_en);
+            void blocks_dirty();
+            void blocks_active();
+            const u_char *morph_setup(ctx_alg_band *band, int &y_off
+                , const u_char *&above, const u_char *&below);
+            int morph(u_char *img, int width, int height, void *buffer
+                , enum SIMD_MORPH op, u_char flag, ctx_alg_band *band);
+            void bands_init();
+            void band_run(enum ALG_BAND_ACT act);
+            int band_morph(enum ALG_BAND_ACT act);
+            void band_moments(ctx_alg_band *band);
+            void band_dist(ctx_alg_band *band);
+            void bg_update();
+            void despeckle_init();
             void despeckle();
-            void diff_nomask();
-            void diff_mask();
-            void diff_smart();
-            void diff_masksmart();
+            void pyramid(const u_char *src, u_char *dst_max, u_char *dst_min);
             bool diff_fast();
+            void diff_setup(ctx_simd_diff *dif);
+            void diff_result(ctx_simd_diff *dif);
+            void diff_part(ctx_simd_diff *dif, int indx, int len);
             void diff_standard();
             void lightswitch();
+            void location_moments();
             void location_center();
-            void location_dist_stddev();
-            void location_dist_basic();
+            void location_dist();
             void location_minmax();
 
     };
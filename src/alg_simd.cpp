@@ -0,0 +1,1190 @@
+/*
+ *    This file is part of MotionPlus.
+ *
+ *    MotionPlus is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ *
+ *    MotionPlus is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License
+ *    along with MotionPlus.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+/*
+ * Vectorized versions of the per pixel loops used by the motion detection.
+ * The instruction set is selected once at startup.  Every vector version
+ * must produce exactly the same results as the plain C version so that
+ * detection does not change with the processor that it runs upon.
+ */
+
+#include "motionplus.hpp"
+#include "util.hpp"
+#include "logger.hpp"
+#include "alg_simd.hpp"
+
+#if defined(__x86_64__) || defined(__i386__)
+    #define SIMD_X86
+    #include <immintrin.h>
+#endif
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+    #define SIMD_NEON
+    #include <arm_neon.h>
+#endif
+
+static enum SIMD_TYPE simd_active = SIMD_TYPE_NONE;
+
+/* Plain C differencing starting at indx_st.  Results are added to dif */
+static void simd_diff_c(ctx_simd_diff *dif, int indx_st)
+{
+    int indx, curdiff, noise;
+    int diffs = 0, diffs_net = 0;
+
+    noise = dif->noise;
+    for (indx = indx_st; indx < dif->count; indx++) {
+        if (dif->noise_map != NULL) {
+            noise = dif->noise_map[indx];
+        }
+        if ((dif->dirty != NULL) && ((indx % DIRTY_SIZE) == 0)) {
+            dif->dirty[indx / DIRTY_SIZE] = 0;
+        }
+
+        curdiff = (dif->ref[indx] - dif->img[indx]);
+        if (dif->mask != NULL) {
+            curdiff = ((curdiff * dif->mask[indx]) / 255);
+        }
+
+        if (dif->mask_final != NULL) {
+            if (abs(curdiff) > noise) {
+                if (dif->mask_incr != 0) {
+                    dif->mask_buffer[indx] += dif->mask_incr;
+                }
+                if (!dif->mask_final[indx]) {
+                    curdiff = 0;
+                }
+            }
+        }
+
+        /* Pixel still in motion after all the masks? */
+        if (abs(curdiff) > noise) {
+            dif->out[indx] = dif->img[indx];
+            if (dif->dirty != NULL) {
+                dif->dirty[indx / DIRTY_SIZE] = 1;
+            }
+            diffs++;
+            if (curdiff > dif->lrgchg) {
+                diffs_net++;
+            } else if (curdiff < -dif->lrgchg) {
+                diffs_net--;
+            }
+        } else {
+            dif->out[indx] = 0;
+        }
+    }
+
+    dif->diffs += diffs;
+    dif->diffs_net += diffs_net;
+}
+
+/* Plain C reduction of the rows starting at block bx_st */
+static void simd_pyramid_row_c(const u_char *src, u_char *dst_max
+    , u_char *dst_min, int width, int bx_st)
+{
+    int x, y, bx;
+    u_char big, small;
+    const u_char *pix;
+
+    for (bx = bx_st; bx < (width / PYRAMID_SCALE); bx++) {
+        pix = src + (bx * PYRAMID_SCALE);
+        big = pix[0];
+        small = pix[0];
+        for (y = 0; y < PYRAMID_SCALE; y++) {
+            for (x = 0; x < PYRAMID_SCALE; x++) {
+                big = MAX(big, pix[x]);
+                small = MIN(small, pix[x]);
+            }
+            pix += width;
+        }
+        dst_max[bx] = big;
+        dst_min[bx] = small;
+    }
+}
+
+/* Plain C column pass of the box shapes from indx_st up to the pixel after the run */
+static void simd_morph_vert_c(ctx_simd_morph *mor, int indx_st)
+{
+    int indx;
+    u_char pix;
+
+    for (indx = indx_st; indx <= mor->count; indx++) {
+        if ((mor->op == SIMD_MORPH_DILATE9) || (mor->op == SIMD_MORPH_DILATE5)) {
+            pix = MAX(mor->above[indx], mor->cur[indx]);
+            mor->vert[indx] = MAX(pix, mor->below[indx]);
+        } else {
+            pix = MIN(mor->above[indx], mor->cur[indx]);
+            mor->vert[indx] = MIN(pix, mor->below[indx]);
+        }
+    }
+}
+
+/* Plain C erode or dilate from indx_st.  Returns the pixels left set */
+static int simd_morph_c(ctx_simd_morph *mor, int indx_st)
+{
+    int indx, sum;
+    u_char pix;
+
+    sum = 0;
+    for (indx = indx_st; indx < mor->count; indx++) {
+        switch (mor->op) {
+        case SIMD_MORPH_DILATE9:
+            pix = MAX(mor->vert[indx - 1], mor->vert[indx]);
+            pix = MAX(pix, mor->vert[indx + 1]);
+            break;
+        case SIMD_MORPH_DILATE5:
+            pix = MAX(mor->cur[indx - 1], mor->cur[indx]);
+            pix = MAX(pix, mor->cur[indx + 1]);
+            pix = MAX(pix, mor->above[indx]);
+            pix = MAX(pix, mor->below[indx]);
+            break;
+        case SIMD_MORPH_ERODE9:
+            pix = MIN(mor->vert[indx - 1], mor->vert[indx]);
+            pix = MIN(pix, mor->vert[indx + 1]);
+            break;
+        default:
+            pix = MIN(mor->cur[indx - 1], mor->cur[indx]);
+            pix = MIN(pix, mor->cur[indx + 1]);
+            pix = MIN(pix, mor->above[indx]);
+            pix = MIN(pix, mor->below[indx]);
+            break;
+        }
+        /* Eroded pixels that remain keep their own value */
+        if ((pix != 0) &&
+            ((mor->op == SIMD_MORPH_ERODE9) || (mor->op == SIMD_MORPH_ERODE5))) {
+            pix = mor->cur[indx];
+        }
+        mor->out[indx] = pix;
+        if (pix != 0) {
+            sum++;
+        }
+    }
+
+    return sum;
+}
+
+/* Plain C update of the reference frame starting at indx_st */
+static void simd_ref_update_c(ctx_simd_ref *upd, int indx_st)
+{
+    int indx;
+
+    for (indx = indx_st; indx < upd->count; indx++) {
+        /* Exclude pixels from ref frame well below noise level. */
+        if ((abs(upd->ref[indx] - upd->img[indx]) > upd->threshold) &&
+            (upd->mask_final[indx])) {
+            if (upd->dyn[indx] == 0) { /* Always give new pixels a chance. */
+                upd->dyn[indx] = 1;
+            } else if (upd->dyn[indx] > upd->accept) { /* Include static Object after some time. */
+                upd->dyn[indx] = 0;
+                upd->ref[indx] = upd->img[indx];
+            } else if (upd->out[indx]) {
+                upd->dyn[indx]++; /* Motionpixel? Keep excluding from ref frame. */
+            } else {
+                upd->dyn[indx] = 0; /* Nothing special - release pixel. */
+                upd->ref[indx] = (u_char)(((upd->ref[indx] * (256 - upd->weight)) +
+                    (upd->img[indx] * upd->weight)) >> 8);
+            }
+        } else {  /* No motion: copy to ref frame. */
+            upd->dyn[indx] = 0; /* Reset pixel */
+            upd->ref[indx] = upd->img[indx];
+        }
+    }
+}
+
+/* Plain C update of the background starting at indx_st */
+static void simd_bg_update_c(ctx_simd_bg *bg, int indx_st)
+{
+    int indx, pix, dist, rate, thr;
+
+    for (indx = indx_st; indx < bg->count; indx++) {
+        rate = (bg->out[indx] ? BG_RATE_MOTION : BG_RATE);
+        pix = bg->img[indx] << 8;
+        if (pix > bg->mean[indx]) {
+            dist = pix - bg->mean[indx];
+            bg->mean[indx] = (uint16_t)(bg->mean[indx] + (dist >> rate));
+        } else {
+            dist = bg->mean[indx] - pix;
+            bg->mean[indx] = (uint16_t)(bg->mean[indx] - (dist >> rate));
+        }
+        if (dist > bg->dev[indx]) {
+            bg->dev[indx] = (uint16_t)(bg->dev[indx] + ((dist - bg->dev[indx]) >> rate));
+        } else {
+            bg->dev[indx] = (uint16_t)(bg->dev[indx] - ((bg->dev[indx] - dist) >> rate));
+        }
+        bg->ref[indx] = (u_char)((bg->mean[indx] + 128) >> 8);
+        thr = bg->noise + ((bg->dev[indx] >> 8) * BG_DEV_SCALE);
+        bg->noise_map[indx] = (u_char)MIN(thr, 255);
+    }
+}
+
+#ifdef SIMD_X86
+
+/* Sum the 16 unsigned byte counters */
+__attribute__((target("sse2")))
+static int simd_sum_sse2(__m128i cnt)
+{
+    __m128i sum;
+
+    sum = _mm_sad_epu8(cnt, _mm_setzero_si128());
+    return _mm_cvtsi128_si32(sum) + _mm_cvtsi128_si32(_mm_srli_si128(sum, 8));
+}
+
+/*
+ * Masked difference (diff * mask) / 255 for unsigned bytes.  The
+ * (p + 1 + (p >> 8)) >> 8 form is exact for all products of two bytes.
+ */
+__attribute__((target("sse2")))
+static __m128i simd_mask_sse2(__m128i absdiff, __m128i mask)
+{
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i one = _mm_set1_epi16(1);
+    __m128i lo, hi;
+
+    lo = _mm_mullo_epi16(_mm_unpacklo_epi8(absdiff, zero), _mm_unpacklo_epi8(mask, zero));
+    hi = _mm_mullo_epi16(_mm_unpackhi_epi8(absdiff, zero), _mm_unpackhi_epi8(mask, zero));
+    lo = _mm_srli_epi16(_mm_add_epi16(_mm_add_epi16(lo, one), _mm_srli_epi16(lo, 8)), 8);
+    hi = _mm_srli_epi16(_mm_add_epi16(_mm_add_epi16(hi, one), _mm_srli_epi16(hi, 8)), 8);
+
+    return _mm_packus_epi16(lo, hi);
+}
+
+/* Add incr to the four ints of the smart mask buffer for each changed pixel */
+__attribute__((target("sse2")))
+static void simd_buffer_sse2(int *buffer, __m128i chg, __m128i incr)
+{
+    __m128i chg_lo, chg_hi, *buf;
+
+    buf = (__m128i *)buffer;
+    chg_lo = _mm_unpacklo_epi8(chg, chg);
+    chg_hi = _mm_unpackhi_epi8(chg, chg);
+    _mm_storeu_si128(buf, _mm_add_epi32(_mm_loadu_si128(buf)
+        , _mm_and_si128(_mm_unpacklo_epi16(chg_lo, chg_lo), incr)));
+    _mm_storeu_si128(buf + 1, _mm_add_epi32(_mm_loadu_si128(buf + 1)
+        , _mm_and_si128(_mm_unpackhi_epi16(chg_lo, chg_lo), incr)));
+    _mm_storeu_si128(buf + 2, _mm_add_epi32(_mm_loadu_si128(buf + 2)
+        , _mm_and_si128(_mm_unpacklo_epi16(chg_hi, chg_hi), incr)));
+    _mm_storeu_si128(buf + 3, _mm_add_epi32(_mm_loadu_si128(buf + 3)
+        , _mm_and_si128(_mm_unpackhi_epi16(chg_hi, chg_hi), incr)));
+}
+
+__attribute__((target("sse2")))
+static void simd_diff_sse2(ctx_simd_diff *dif)
+{
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i noise_all = _mm_set1_epi8((char)MIN(dif->noise, 255));
+    const __m128i lrgchg = _mm_set1_epi8((char)MIN(dif->lrgchg, 255));
+    const __m128i incr = _mm_set1_epi32(dif->mask_incr);
+    __m128i ref, img, pos, neg, absdiff, chg, lrg, noise;
+    __m128i cnt_chg, cnt_pos, cnt_neg;
+    int indx, indx_max, blk, bits;
+
+    indx_max = dif->count - (dif->count % 16);
+    indx = 0;
+    while (indx < indx_max) {
+        /* Byte counters can count 255 blocks before they must be summed */
+        cnt_chg = cnt_pos = cnt_neg = zero;
+        for (blk = 0; (blk < 255) && (indx < indx_max); blk++, indx += 16) {
+            ref = _mm_loadu_si128((const __m128i *)(dif->ref + indx));
+            img = _mm_loadu_si128((const __m128i *)(dif->img + indx));
+            pos = _mm_subs_epu8(ref, img);
+            neg = _mm_subs_epu8(img, ref);
+            absdiff = _mm_or_si128(pos, neg);
+            if (dif->mask != NULL) {
+                absdiff = simd_mask_sse2(absdiff
+                    , _mm_loadu_si128((const __m128i *)(dif->mask + indx)));
+            }
+            if (dif->noise_map != NULL) {
+                noise = _mm_loadu_si128((const __m128i *)(dif->noise_map + indx));
+            } else {
+                noise = noise_all;
+            }
+            /* absdiff > noise */
+            chg = _mm_andnot_si128(
+                _mm_cmpeq_epi8(_mm_subs_epu8(absdiff, noise), zero)
+                , _mm_set1_epi8(-1));
+            if (dif->mask_final != NULL) {
+                if ((dif->mask_incr != 0) && _mm_movemask_epi8(chg)) {
+                    simd_buffer_sse2(dif->mask_buffer + indx, chg, incr);
+                }
+                chg = _mm_andnot_si128(_mm_cmpeq_epi8(
+                    _mm_loadu_si128((const __m128i *)(dif->mask_final + indx)), zero)
+                    , chg);
+            }
+            _mm_storeu_si128((__m128i *)(dif->out + indx), _mm_and_si128(chg, img));
+            if (dif->dirty != NULL) {
+                bits = _mm_movemask_epi8(chg);
+                dif->dirty[indx / DIRTY_SIZE] = ((bits & 0xff) != 0);
+                dif->dirty[indx / DIRTY_SIZE + 1] = ((bits & 0xff00) != 0);
+            }
+
+            lrg = _mm_andnot_si128(_mm_cmpeq_epi8(_mm_subs_epu8(absdiff, lrgchg), zero), chg);
+            cnt_chg = _mm_sub_epi8(cnt_chg, chg);
+            cnt_pos = _mm_sub_epi8(cnt_pos, _mm_andnot_si128(_mm_cmpeq_epi8(pos, zero), lrg));
+            cnt_neg = _mm_sub_epi8(cnt_neg, _mm_andnot_si128(_mm_cmpeq_epi8(neg, zero), lrg));
+        }
+        dif->diffs += simd_sum_sse2(cnt_chg);
+        dif->diffs_net += simd_sum_sse2(cnt_pos) - simd_sum_sse2(cnt_neg);
+    }
+
+    simd_diff_c(dif, indx_max);
+}
+
+__attribute__((target("avx2")))
+static int simd_sum_avx2(__m256i cnt)
+{
+    __m256i sad;
+    __m128i sum;
+
+    sad = _mm256_sad_epu8(cnt, _mm256_setzero_si256());
+    sum = _mm_add_epi64(_mm256_castsi256_si128(sad), _mm256_extracti128_si256(sad, 1));
+    return _mm_cvtsi128_si32(sum) + _mm_cvtsi128_si32(_mm_srli_si128(sum, 8));
+}
+
+__attribute__((target("avx2")))
+static __m256i simd_mask_avx2(__m256i absdiff, __m256i mask)
+{
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i one = _mm256_set1_epi16(1);
+    __m256i lo, hi;
+
+    /* The unpack and pack both work within each 128 bit lane so order is kept */
+    lo = _mm256_mullo_epi16(_mm256_unpacklo_epi8(absdiff, zero), _mm256_unpacklo_epi8(mask, zero));
+    hi = _mm256_mullo_epi16(_mm256_unpackhi_epi8(absdiff, zero), _mm256_unpackhi_epi8(mask, zero));
+    lo = _mm256_srli_epi16(_mm256_add_epi16(_mm256_add_epi16(lo, one), _mm256_srli_epi16(lo, 8)), 8);
+    hi = _mm256_srli_epi16(_mm256_add_epi16(_mm256_add_epi16(hi, one), _mm256_srli_epi16(hi, 8)), 8);
+
+    return _mm256_packus_epi16(lo, hi);
+}
+
+__attribute__((target("avx2")))
+static void simd_buffer_avx2(int *buffer, __m256i chg, __m256i incr)
+{
+    __m128i chg_lo, chg_hi;
+    __m256i *buf;
+
+    buf = (__m256i *)buffer;
+    chg_lo = _mm256_castsi256_si128(chg);
+    chg_hi = _mm256_extracti128_si256(chg, 1);
+    _mm256_storeu_si256(buf, _mm256_add_epi32(_mm256_loadu_si256(buf)
+        , _mm256_and_si256(_mm256_cvtepi8_epi32(chg_lo), incr)));
+    _mm256_storeu_si256(buf + 1, _mm256_add_epi32(_mm256_loadu_si256(buf + 1)
+        , _mm256_and_si256(_mm256_cvtepi8_epi32(_mm_srli_si128(chg_lo, 8)), incr)));
+    _mm256_storeu_si256(buf + 2, _mm256_add_epi32(_mm256_loadu_si256(buf + 2)
+        , _mm256_and_si256(_mm256_cvtepi8_epi32(chg_hi), incr)));
+    _mm256_storeu_si256(buf + 3, _mm256_add_epi32(_mm256_loadu_si256(buf + 3)
+        , _mm256_and_si256(_mm256_cvtepi8_epi32(_mm_srli_si128(chg_hi, 8)), incr)));
+}
+
+__attribute__((target("avx2")))
+static void simd_diff_avx2(ctx_simd_diff *dif)
+{
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i noise_all = _mm256_set1_epi8((char)MIN(dif->noise, 255));
+    const __m256i lrgchg = _mm256_set1_epi8((char)MIN(dif->lrgchg, 255));
+    const __m256i incr = _mm256_set1_epi32(dif->mask_incr);
+    __m256i ref, img, pos, neg, absdiff, chg, lrg, noise;
+    __m256i cnt_chg, cnt_pos, cnt_neg;
+    uint bits;
+    int indx, indx_max, blk;
+
+    indx_max = dif->count - (dif->count % 32);
+    indx = 0;
+    while (indx < indx_max) {
+        cnt_chg = cnt_pos = cnt_neg = zero;
+        for (blk = 0; (blk < 255) && (indx < indx_max); blk++, indx += 32) {
+            ref = _mm256_loadu_si256((const __m256i *)(dif->ref + indx));
+            img = _mm256_loadu_si256((const __m256i *)(dif->img + indx));
+            pos = _mm256_subs_epu8(ref, img);
+            neg = _mm256_subs_epu8(img, ref);
+            absdiff = _mm256_or_si256(pos, neg);
+            if (dif->mask != NULL) {
+                absdiff = simd_mask_avx2(absdiff
+                    , _mm256_loadu_si256((const __m256i *)(dif->mask + indx)));
+            }
+            if (dif->noise_map != NULL) {
+                noise = _mm256_loadu_si256((const __m256i *)(dif->noise_map + indx));
+            } else {
+                noise = noise_all;
+            }
+            chg = _mm256_andnot_si256(
+                _mm256_cmpeq_epi8(_mm256_subs_epu8(absdiff, noise), zero)
+                , _mm256_set1_epi8(-1));
+            if (dif->mask_final != NULL) {
+                if ((dif->mask_incr != 0) && _mm256_movemask_epi8(chg)) {
+                    simd_buffer_avx2(dif->mask_buffer + indx, chg, incr);
+                }
+                chg = _mm256_andnot_si256(_mm256_cmpeq_epi8(
+                    _mm256_loadu_si256((const __m256i *)(dif->mask_final + indx)), zero)
+                    , chg);
+            }
+            _mm256_storeu_si256((__m256i *)(dif->out + indx), _mm256_and_si256(chg, img));
+            if (dif->dirty != NULL) {
+                bits = (uint)_mm256_movemask_epi8(chg);
+                dif->dirty[indx / DIRTY_SIZE] = ((bits & 0xff) != 0);
+                dif->dirty[indx / DIRTY_SIZE + 1] = ((bits & 0xff00) != 0);
+                dif->dirty[indx / DIRTY_SIZE + 2] = ((bits & 0xff0000) != 0);
+                dif->dirty[indx / DIRTY_SIZE + 3] = ((bits & 0xff000000) != 0);
+            }
+
+            lrg = _mm256_andnot_si256(
+                _mm256_cmpeq_epi8(_mm256_subs_epu8(absdiff, lrgchg), zero), chg);
+            cnt_chg = _mm256_sub_epi8(cnt_chg, chg);
+            cnt_pos = _mm256_sub_epi8(cnt_pos
+                , _mm256_andnot_si256(_mm256_cmpeq_epi8(pos, zero), lrg));
+            cnt_neg = _mm256_sub_epi8(cnt_neg
+                , _mm256_andnot_si256(_mm256_cmpeq_epi8(neg, zero), lrg));
+        }
+        dif->diffs += simd_sum_avx2(cnt_chg);
+        dif->diffs_net += simd_sum_avx2(cnt_pos) - simd_sum_avx2(cnt_neg);
+    }
+
+    simd_diff_c(dif, indx_max);
+}
+
+__attribute__((target("sse2")))
+static __m128i simd_morph_op_sse2(__m128i a, __m128i b, bool dilate)
+{
+    if (dilate) {
+        return _mm_max_epu8(a, b);
+    } else {
+        return _mm_min_epu8(a, b);
+    }
+}
+
+/*
+ * Reduce the extremes of each group of four columns of 16 pixels to the
+ * low byte of its 32 bit lane.  The bytes shifted in only reach the upper
+ * bytes of the lanes which are then cleared.
+ */
+__attribute__((target("sse2")))
+static __m128i simd_pyramid_lane_sse2(__m128i pix, bool dilate)
+{
+    pix = simd_morph_op_sse2(pix, _mm_srli_epi16(pix, 8), dilate);
+    pix = simd_morph_op_sse2(pix, _mm_srli_epi32(pix, 16), dilate);
+
+    return _mm_and_si128(pix, _mm_set1_epi32(0xff));
+}
+
+__attribute__((target("sse2")))
+static void simd_pyramid_row_sse2(const u_char *src, u_char *dst_max
+    , u_char *dst_min, int width)
+{
+    __m128i big[2], small[2], pix;
+    int indx, indx_max, half, y;
+
+    indx_max = width - (width % 32);
+    for (indx = 0; indx < indx_max; indx += 32) {
+        for (half = 0; half < 2; half++) {
+            big[half] = _mm_loadu_si128((const __m128i *)(src + indx + (half * 16)));
+            small[half] = big[half];
+            for (y = 1; y < PYRAMID_SCALE; y++) {
+                pix = _mm_loadu_si128(
+                    (const __m128i *)(src + indx + (half * 16) + (y * width)));
+                big[half] = _mm_max_epu8(big[half], pix);
+                small[half] = _mm_min_epu8(small[half], pix);
+            }
+            big[half] = simd_pyramid_lane_sse2(big[half], true);
+            small[half] = simd_pyramid_lane_sse2(small[half], false);
+        }
+        pix = _mm_packs_epi32(big[0], big[1]);
+        _mm_storel_epi64((__m128i *)(dst_max + (indx / PYRAMID_SCALE))
+            , _mm_packus_epi16(pix, pix));
+        pix = _mm_packs_epi32(small[0], small[1]);
+        _mm_storel_epi64((__m128i *)(dst_min + (indx / PYRAMID_SCALE))
+            , _mm_packus_epi16(pix, pix));
+    }
+
+    simd_pyramid_row_c(src, dst_max, dst_min, width, indx_max / PYRAMID_SCALE);
+}
+
+__attribute__((target("sse2")))
+static int simd_morph_sse2(ctx_simd_morph *mor)
+{
+    const __m128i zero = _mm_setzero_si128();
+    __m128i pix, cur;
+    int indx, indx_max, sum;
+    bool dilate, box;
+
+    dilate = ((mor->op == SIMD_MORPH_DILATE9) || (mor->op == SIMD_MORPH_DILATE5));
+    box = ((mor->op == SIMD_MORPH_DILATE9) || (mor->op == SIMD_MORPH_ERODE9));
+
+    if (box) {
+        indx_max = mor->count + 1 - ((mor->count + 2) % 16);
+        for (indx = -1; indx < indx_max; indx += 16) {
+            pix = simd_morph_op_sse2(
+                _mm_loadu_si128((const __m128i *)(mor->above + indx))
+                , _mm_loadu_si128((const __m128i *)(mor->cur + indx)), dilate);
+            pix = simd_morph_op_sse2(pix
+                , _mm_loadu_si128((const __m128i *)(mor->below + indx)), dilate);
+            _mm_storeu_si128((__m128i *)(mor->vert + indx), pix);
+        }
+        simd_morph_vert_c(mor, indx);
+    }
+
+    sum = 0;
+    indx_max = mor->count - (mor->count % 16);
+    for (indx = 0; indx < indx_max; indx += 16) {
+        cur = _mm_loadu_si128((const __m128i *)(mor->cur + indx));
+        if (box) {
+            pix = simd_morph_op_sse2(
+                _mm_loadu_si128((const __m128i *)(mor->vert + indx - 1))
+                , _mm_loadu_si128((const __m128i *)(mor->vert + indx)), dilate);
+            pix = simd_morph_op_sse2(pix
+                , _mm_loadu_si128((const __m128i *)(mor->vert + indx + 1)), dilate);
+        } else {
+            pix = simd_morph_op_sse2(
+                _mm_loadu_si128((const __m128i *)(mor->cur + indx - 1))
+                , _mm_loadu_si128((const __m128i *)(mor->cur + indx + 1)), dilate);
+            pix = simd_morph_op_sse2(pix, cur, dilate);
+            pix = simd_morph_op_sse2(pix
+                , _mm_loadu_si128((const __m128i *)(mor->above + indx)), dilate);
+            pix = simd_morph_op_sse2(pix
+                , _mm_loadu_si128((const __m128i *)(mor->below + indx)), dilate);
+        }
+        if (dilate == false) {
+            pix = _mm_andnot_si128(_mm_cmpeq_epi8(pix, zero), cur);
+        }
+        _mm_storeu_si128((__m128i *)(mor->out + indx), pix);
+        sum += __builtin_popcount(
+            (uint)(~_mm_movemask_epi8(_mm_cmpeq_epi8(pix, zero)) & 0xffff));
+    }
+
+    return sum + simd_morph_c(mor, indx_max);
+}
+
+/*
+ * New exclusion counts for eight pixels.  chg, dz, acc and mov are the
+ * masks of the changed pixels, the counts at zero, the counts past the
+ * accept time and the pixels in motion.
+ */
+__attribute__((target("sse2")))
+static __m128i simd_ref_dyn_sse2(__m128i dyn, __m128i chg, __m128i dz
+    , __m128i acc, __m128i mov)
+{
+    const __m128i one = _mm_set1_epi16(1);
+    __m128i inc;
+
+    inc = _mm_and_si128(_mm_andnot_si128(acc, mov), _mm_add_epi16(dyn, one));
+    return _mm_and_si128(chg, _mm_or_si128(_mm_and_si128(dz, one)
+        , _mm_andnot_si128(dz, inc)));
+}
+
+/* Blend eight pixels of the reference and new image */
+__attribute__((target("sse2")))
+static __m128i simd_ref_blend_sse2(__m128i ref, __m128i img, __m128i wr, __m128i wi)
+{
+    return _mm_srli_epi16(_mm_add_epi16(_mm_mullo_epi16(ref, wr)
+        , _mm_mullo_epi16(img, wi)), 8);
+}
+
+__attribute__((target("sse2")))
+static void simd_ref_update_sse2(ctx_simd_ref *upd)
+{
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i ones = _mm_set1_epi8(-1);
+    const __m128i thr = _mm_set1_epi8((char)upd->threshold);
+    const __m128i accept = _mm_set1_epi16((short)upd->accept);
+    const __m128i wr = _mm_set1_epi16((short)(256 - upd->weight));
+    const __m128i wi = _mm_set1_epi16((short)upd->weight);
+    __m128i ref, img, chg, mov, dyn_lo, dyn_hi, dz_lo, dz_hi, acc_lo, acc_hi;
+    __m128i dz, acc, use_img, use_blend, blend;
+    int indx, indx_max;
+
+    indx_max = upd->count - (upd->count % 16);
+    for (indx = 0; indx < indx_max; indx += 16) {
+        ref = _mm_loadu_si128((const __m128i *)(upd->ref + indx));
+        img = _mm_loadu_si128((const __m128i *)(upd->img + indx));
+        chg = _mm_or_si128(_mm_subs_epu8(ref, img), _mm_subs_epu8(img, ref));
+        chg = _mm_andnot_si128(_mm_cmpeq_epi8(_mm_subs_epu8(chg, thr), zero), ones);
+        chg = _mm_andnot_si128(_mm_cmpeq_epi8(
+            _mm_loadu_si128((const __m128i *)(upd->mask_final + indx)), zero), chg);
+        mov = _mm_andnot_si128(_mm_cmpeq_epi8(
+            _mm_loadu_si128((const __m128i *)(upd->out + indx)), zero), ones);
+
+        dyn_lo = _mm_loadu_si128((const __m128i *)(upd->dyn + indx));
+        dyn_hi = _mm_loadu_si128((const __m128i *)(upd->dyn + indx + 8));
+        dz_lo = _mm_cmpeq_epi16(dyn_lo, zero);
+        dz_hi = _mm_cmpeq_epi16(dyn_hi, zero);
+        acc_lo = _mm_andnot_si128(_mm_cmpeq_epi16(_mm_subs_epu16(dyn_lo, accept), zero), ones);
+        acc_hi = _mm_andnot_si128(_mm_cmpeq_epi16(_mm_subs_epu16(dyn_hi, accept), zero), ones);
+
+        _mm_storeu_si128((__m128i *)(upd->dyn + indx), simd_ref_dyn_sse2(dyn_lo
+            , _mm_unpacklo_epi8(chg, chg), dz_lo, acc_lo, _mm_unpacklo_epi8(mov, mov)));
+        _mm_storeu_si128((__m128i *)(upd->dyn + indx + 8), simd_ref_dyn_sse2(dyn_hi
+            , _mm_unpackhi_epi8(chg, chg), dz_hi, acc_hi, _mm_unpackhi_epi8(mov, mov)));
+
+        /* Unchanged and accepted pixels take the image, released ones the blend */
+        dz = _mm_packs_epi16(dz_lo, dz_hi);
+        acc = _mm_packs_epi16(acc_lo, acc_hi);
+        use_img = _mm_or_si128(_mm_andnot_si128(chg, ones)
+            , _mm_andnot_si128(dz, acc));
+        use_blend = _mm_andnot_si128(_mm_or_si128(_mm_or_si128(dz, acc), mov), chg);
+
+        blend = _mm_packus_epi16(
+            simd_ref_blend_sse2(_mm_unpacklo_epi8(ref, zero), _mm_unpacklo_epi8(img, zero), wr, wi)
+            , simd_ref_blend_sse2(_mm_unpackhi_epi8(ref, zero), _mm_unpackhi_epi8(img, zero), wr, wi));
+
+        ref = _mm_or_si128(_mm_andnot_si128(_mm_or_si128(use_img, use_blend), ref)
+            , _mm_or_si128(_mm_and_si128(use_img, img), _mm_and_si128(use_blend, blend)));
+        _mm_storeu_si128((__m128i *)(upd->ref + indx), ref);
+    }
+
+    simd_ref_update_c(upd, indx_max);
+}
+
+/* Move val towards target by 1 / 2^rate with mov selecting BG_RATE_MOTION */
+__attribute__((target("sse2")))
+static __m128i simd_bg_step_sse2(__m128i val, __m128i target, __m128i mov, __m128i *dist)
+{
+    __m128i pos, neg;
+
+    pos = _mm_subs_epu16(target, val);
+    neg = _mm_subs_epu16(val, target);
+    *dist = _mm_or_si128(pos, neg);
+    pos = _mm_or_si128(_mm_andnot_si128(mov, _mm_srli_epi16(pos, BG_RATE))
+        , _mm_and_si128(mov, _mm_srli_epi16(pos, BG_RATE_MOTION)));
+    neg = _mm_or_si128(_mm_andnot_si128(mov, _mm_srli_epi16(neg, BG_RATE))
+        , _mm_and_si128(mov, _mm_srli_epi16(neg, BG_RATE_MOTION)));
+
+    return _mm_sub_epi16(_mm_add_epi16(val, pos), neg);
+}
+
+/* Update eight pixels and return the rounded mean and the noise levels */
+__attribute__((target("sse2")))
+static void simd_bg_part_sse2(ctx_simd_bg *bg, int indx, __m128i img, __m128i mov
+    , __m128i *ref, __m128i *thr)
+{
+    const __m128i half = _mm_set1_epi16(128);
+    __m128i mean, dev, dist;
+
+    mean = _mm_loadu_si128((const __m128i *)(bg->mean + indx));
+    dev = _mm_loadu_si128((const __m128i *)(bg->dev + indx));
+    mean = simd_bg_step_sse2(mean, _mm_slli_epi16(img, 8), mov, &dist);
+    dev = simd_bg_step_sse2(dev, dist, mov, &dist);
+    _mm_storeu_si128((__m128i *)(bg->mean + indx), mean);
+    _mm_storeu_si128((__m128i *)(bg->dev + indx), dev);
+
+    *ref = _mm_srli_epi16(_mm_add_epi16(mean, half), 8);
+    *thr = _mm_mullo_epi16(_mm_srli_epi16(dev, 8), _mm_set1_epi16(BG_DEV_SCALE));
+}
+
+__attribute__((target("sse2")))
+static void simd_bg_update_sse2(ctx_simd_bg *bg)
+{
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i noise = _mm_set1_epi8((char)bg->noise);
+    __m128i img, mov, ref_lo, ref_hi, thr_lo, thr_hi;
+    int indx, indx_max;
+
+    indx_max = bg->count - (bg->count % 16);
+    for (indx = 0; indx < indx_max; indx += 16) {
+        img = _mm_loadu_si128((const __m128i *)(bg->img + indx));
+        mov = _mm_andnot_si128(_mm_cmpeq_epi8(
+            _mm_loadu_si128((const __m128i *)(bg->out + indx)), zero), _mm_set1_epi8(-1));
+
+        simd_bg_part_sse2(bg, indx, _mm_unpacklo_epi8(img, zero)
+            , _mm_unpacklo_epi8(mov, mov), &ref_lo, &thr_lo);
+        simd_bg_part_sse2(bg, indx + 8, _mm_unpackhi_epi8(img, zero)
+            , _mm_unpackhi_epi8(mov, mov), &ref_hi, &thr_hi);
+
+        _mm_storeu_si128((__m128i *)(bg->ref + indx), _mm_packus_epi16(ref_lo, ref_hi));
+        _mm_storeu_si128((__m128i *)(bg->noise_map + indx)
+            , _mm_adds_epu8(_mm_packus_epi16(thr_lo, thr_hi), noise));
+    }
+
+    simd_bg_update_c(bg, indx_max);
+}
+
+#endif /* SIMD_X86 */
+
+#ifdef SIMD_NEON
+
+static int simd_sum_neon(uint8x16_t cnt)
+{
+    uint64x2_t sum;
+
+    sum = vpaddlq_u32(vpaddlq_u16(vpaddlq_u8(cnt)));
+    return (int)(vgetq_lane_u64(sum, 0) + vgetq_lane_u64(sum, 1));
+}
+
+static uint8x16_t simd_mask_neon(uint8x16_t absdiff, uint8x16_t mask)
+{
+    const uint16x8_t one = vdupq_n_u16(1);
+    uint16x8_t lo, hi;
+
+    lo = vmull_u8(vget_low_u8(absdiff), vget_low_u8(mask));
+    hi = vmull_u8(vget_high_u8(absdiff), vget_high_u8(mask));
+    lo = vaddq_u16(vaddq_u16(lo, one), vshrq_n_u16(lo, 8));
+    hi = vaddq_u16(vaddq_u16(hi, one), vshrq_n_u16(hi, 8));
+
+    return vcombine_u8(vshrn_n_u16(lo, 8), vshrn_n_u16(hi, 8));
+}
+
+static void simd_buffer_neon(int *buffer, uint8x16_t chg, int32x4_t incr)
+{
+    int16x8_t chg_lo, chg_hi;
+
+    chg_lo = vmovl_s8(vget_low_s8(vreinterpretq_s8_u8(chg)));
+    chg_hi = vmovl_s8(vget_high_s8(vreinterpretq_s8_u8(chg)));
+    vst1q_s32(buffer, vaddq_s32(vld1q_s32(buffer)
+        , vandq_s32(vmovl_s16(vget_low_s16(chg_lo)), incr)));
+    vst1q_s32(buffer + 4, vaddq_s32(vld1q_s32(buffer + 4)
+        , vandq_s32(vmovl_s16(vget_high_s16(chg_lo)), incr)));
+    vst1q_s32(buffer + 8, vaddq_s32(vld1q_s32(buffer + 8)
+        , vandq_s32(vmovl_s16(vget_low_s16(chg_hi)), incr)));
+    vst1q_s32(buffer + 12, vaddq_s32(vld1q_s32(buffer + 12)
+        , vandq_s32(vmovl_s16(vget_high_s16(chg_hi)), incr)));
+}
+
+static void simd_diff_neon(ctx_simd_diff *dif)
+{
+    const uint8x16_t noise_all = vdupq_n_u8((uint8_t)MIN(dif->noise, 255));
+    const uint8x16_t lrgchg = vdupq_n_u8((uint8_t)MIN(dif->lrgchg, 255));
+    const int32x4_t incr = vdupq_n_s32(dif->mask_incr);
+    uint8x16_t ref, img, pos, neg, absdiff, chg, lrg, noise;
+    uint8x16_t cnt_chg, cnt_pos, cnt_neg;
+    int indx, indx_max, blk;
+
+    indx_max = dif->count - (dif->count % 16);
+    indx = 0;
+    while (indx < indx_max) {
+        cnt_chg = cnt_pos = cnt_neg = vdupq_n_u8(0);
+        for (blk = 0; (blk < 255) && (indx < indx_max); blk++, indx += 16) {
+            ref = vld1q_u8(dif->ref + indx);
+            img = vld1q_u8(dif->img + indx);
+            pos = vqsubq_u8(ref, img);
+            neg = vqsubq_u8(img, ref);
+            absdiff = vorrq_u8(pos, neg);
+            if (dif->mask != NULL) {
+                absdiff = simd_mask_neon(absdiff, vld1q_u8(dif->mask + indx));
+            }
+            if (dif->noise_map != NULL) {
+                noise = vld1q_u8(dif->noise_map + indx);
+            } else {
+                noise = noise_all;
+            }
+            chg = vcgtq_u8(absdiff, noise);
+            if (dif->mask_final != NULL) {
+                if ((dif->mask_incr != 0) &&
+                    (vgetq_lane_u64(vreinterpretq_u64_u8(chg), 0) ||
+                     vgetq_lane_u64(vreinterpretq_u64_u8(chg), 1))) {
+                    simd_buffer_neon(dif->mask_buffer + indx, chg, incr);
+                }
+                ref = vld1q_u8(dif->mask_final + indx);
+                chg = vandq_u8(chg, vtstq_u8(ref, ref));
+            }
+            vst1q_u8(dif->out + indx, vandq_u8(chg, img));
+            if (dif->dirty != NULL) {
+                dif->dirty[indx / DIRTY_SIZE] =
+                    (vgetq_lane_u64(vreinterpretq_u64_u8(chg), 0) != 0);
+                dif->dirty[indx / DIRTY_SIZE + 1] =
+                    (vgetq_lane_u64(vreinterpretq_u64_u8(chg), 1) != 0);
+            }
+
+            lrg = vandq_u8(chg, vcgtq_u8(absdiff, lrgchg));
+            cnt_chg = vsubq_u8(cnt_chg, chg);
+            cnt_pos = vsubq_u8(cnt_pos, vandq_u8(lrg, vtstq_u8(pos, pos)));
+            cnt_neg = vsubq_u8(cnt_neg, vandq_u8(lrg, vtstq_u8(neg, neg)));
+        }
+        dif->diffs += simd_sum_neon(cnt_chg);
+        dif->diffs_net += simd_sum_neon(cnt_pos) - simd_sum_neon(cnt_neg);
+    }
+
+    simd_diff_c(dif, indx_max);
+}
+
+static void simd_pyramid_row_neon(const u_char *src, u_char *dst_max
+    , u_char *dst_min, int width)
+{
+    uint8x16_t big, small, pix;
+    uint8x8_t blk;
+    int indx, indx_max, y;
+
+    indx_max = width - (width % 16);
+    for (indx = 0; indx < indx_max; indx += 16) {
+        big = vld1q_u8(src + indx);
+        small = big;
+        for (y = 1; y < PYRAMID_SCALE; y++) {
+            pix = vld1q_u8(src + indx + (y * width));
+            big = vmaxq_u8(big, pix);
+            small = vminq_u8(small, pix);
+        }
+        blk = vpmax_u8(vget_low_u8(big), vget_high_u8(big));
+        blk = vpmax_u8(blk, blk);
+        vst1_lane_u32((uint32_t *)(dst_max + (indx / PYRAMID_SCALE))
+            , vreinterpret_u32_u8(blk), 0);
+        blk = vpmin_u8(vget_low_u8(small), vget_high_u8(small));
+        blk = vpmin_u8(blk, blk);
+        vst1_lane_u32((uint32_t *)(dst_min + (indx / PYRAMID_SCALE))
+            , vreinterpret_u32_u8(blk), 0);
+    }
+
+    simd_pyramid_row_c(src, dst_max, dst_min, width, indx_max / PYRAMID_SCALE);
+}
+
+static uint8x16_t simd_morph_op_neon(uint8x16_t a, uint8x16_t b, bool dilate)
+{
+    if (dilate) {
+        return vmaxq_u8(a, b);
+    } else {
+        return vminq_u8(a, b);
+    }
+}
+
+static int simd_morph_neon(ctx_simd_morph *mor)
+{
+    uint8x16_t pix, cur;
+    int indx, indx_max, sum;
+    bool dilate, box;
+
+    dilate = ((mor->op == SIMD_MORPH_DILATE9) || (mor->op == SIMD_MORPH_DILATE5));
+    box = ((mor->op == SIMD_MORPH_DILATE9) || (mor->op == SIMD_MORPH_ERODE9));
+
+    if (box) {
+        indx_max = mor->count + 1 - ((mor->count + 2) % 16);
+        for (indx = -1; indx < indx_max; indx += 16) {
+            pix = simd_morph_op_neon(vld1q_u8(mor->above + indx)
+                , vld1q_u8(mor->cur + indx), dilate);
+            pix = simd_morph_op_neon(pix, vld1q_u8(mor->below + indx), dilate);
+            vst1q_u8(mor->vert + indx, pix);
+        }
+        simd_morph_vert_c(mor, indx);
+    }
+
+    sum = 0;
+    indx_max = mor->count - (mor->count % 16);
+    for (indx = 0; indx < indx_max; indx += 16) {
+        cur = vld1q_u8(mor->cur + indx);
+        if (box) {
+            pix = simd_morph_op_neon(vld1q_u8(mor->vert + indx - 1)
+                , vld1q_u8(mor->vert + indx), dilate);
+            pix = simd_morph_op_neon(pix, vld1q_u8(mor->vert + indx + 1), dilate);
+        } else {
+            pix = simd_morph_op_neon(vld1q_u8(mor->cur + indx - 1)
+                , vld1q_u8(mor->cur + indx + 1), dilate);
+            pix = simd_morph_op_neon(pix, cur, dilate);
+            pix = simd_morph_op_neon(pix, vld1q_u8(mor->above + indx), dilate);
+            pix = simd_morph_op_neon(pix, vld1q_u8(mor->below + indx), dilate);
+        }
+        if (dilate == false) {
+            pix = vandq_u8(vtstq_u8(pix, pix), cur);
+        }
+        vst1q_u8(mor->out + indx, pix);
+        sum += simd_sum_neon(vshrq_n_u8(vtstq_u8(pix, pix), 7));
+    }
+
+    return sum + simd_morph_c(mor, indx_max);
+}
+
+static uint16x8_t simd_ref_dyn_neon(uint16x8_t dyn, uint16x8_t chg, uint16x8_t dz
+    , uint16x8_t acc, uint16x8_t mov)
+{
+    const uint16x8_t one = vdupq_n_u16(1);
+    uint16x8_t inc;
+
+    inc = vandq_u16(vbicq_u16(mov, acc), vaddq_u16(dyn, one));
+    return vandq_u16(chg, vbslq_u16(dz, one, inc));
+}
+
+/* Widen the byte masks to word masks */
+static uint16x8_t simd_ref_mask_neon(uint8x8_t mask)
+{
+    return vreinterpretq_u16_s16(vmovl_s8(vreinterpret_s8_u8(mask)));
+}
+
+static uint8x8_t simd_ref_blend_neon(uint8x8_t ref, uint8x8_t img, uint16x8_t wr, uint16x8_t wi)
+{
+    return vshrn_n_u16(vmlaq_u16(vmulq_u16(vmovl_u8(ref), wr), vmovl_u8(img), wi), 8);
+}
+
+static void simd_ref_update_neon(ctx_simd_ref *upd)
+{
+    const uint8x16_t thr = vdupq_n_u8((uint8_t)upd->threshold);
+    const uint16x8_t accept = vdupq_n_u16((uint16_t)upd->accept);
+    const uint16x8_t wr = vdupq_n_u16((uint16_t)(256 - upd->weight));
+    const uint16x8_t wi = vdupq_n_u16((uint16_t)upd->weight);
+    uint8x16_t ref, img, chg, mov, dz, acc, use_img, use_blend, blend;
+    uint16x8_t dyn_lo, dyn_hi, dz_lo, dz_hi, acc_lo, acc_hi;
+    int indx, indx_max;
+
+    indx_max = upd->count - (upd->count % 16);
+    for (indx = 0; indx < indx_max; indx += 16) {
+        ref = vld1q_u8(upd->ref + indx);
+        img = vld1q_u8(upd->img + indx);
+        chg = vcgtq_u8(vabdq_u8(ref, img), thr);
+        mov = vld1q_u8(upd->mask_final + indx);
+        chg = vandq_u8(chg, vtstq_u8(mov, mov));
+        mov = vld1q_u8(upd->out + indx);
+        mov = vtstq_u8(mov, mov);
+
+        dyn_lo = vld1q_u16(upd->dyn + indx);
+        dyn_hi = vld1q_u16(upd->dyn + indx + 8);
+        dz_lo = vceqq_u16(dyn_lo, vdupq_n_u16(0));
+        dz_hi = vceqq_u16(dyn_hi, vdupq_n_u16(0));
+        acc_lo = vcgtq_u16(dyn_lo, accept);
+        acc_hi = vcgtq_u16(dyn_hi, accept);
+
+        vst1q_u16(upd->dyn + indx, simd_ref_dyn_neon(dyn_lo
+            , simd_ref_mask_neon(vget_low_u8(chg)), dz_lo, acc_lo
+            , simd_ref_mask_neon(vget_low_u8(mov))));
+        vst1q_u16(upd->dyn + indx + 8, simd_ref_dyn_neon(dyn_hi
+            , simd_ref_mask_neon(vget_high_u8(chg)), dz_hi, acc_hi
+            , simd_ref_mask_neon(vget_high_u8(mov))));
+
+        /* Unchanged and accepted pixels take the image, released ones the blend */
+        dz = vcombine_u8(vmovn_u16(dz_lo), vmovn_u16(dz_hi));
+        acc = vcombine_u8(vmovn_u16(acc_lo), vmovn_u16(acc_hi));
+        use_img = vorrq_u8(vmvnq_u8(chg), vbicq_u8(acc, dz));
+        use_blend = vbicq_u8(chg, vorrq_u8(vorrq_u8(dz, acc), mov));
+
+        blend = vcombine_u8(
+            simd_ref_blend_neon(vget_low_u8(ref), vget_low_u8(img), wr, wi)
+            , simd_ref_blend_neon(vget_high_u8(ref), vget_high_u8(img), wr, wi));
+
+        ref = vbslq_u8(use_img, img, vbslq_u8(use_blend, blend, ref));
+        vst1q_u8(upd->ref + indx, ref);
+    }
+
+    simd_ref_update_c(upd, indx_max);
+}
+
+static uint16x8_t simd_bg_step_neon(uint16x8_t val, uint16x8_t target, uint16x8_t mov
+    , uint16x8_t *dist)
+{
+    uint16x8_t pos, neg;
+
+    pos = vqsubq_u16(target, val);
+    neg = vqsubq_u16(val, target);
+    *dist = vorrq_u16(pos, neg);
+    pos = vbslq_u16(mov, vshrq_n_u16(pos, BG_RATE_MOTION), vshrq_n_u16(pos, BG_RATE));
+    neg = vbslq_u16(mov, vshrq_n_u16(neg, BG_RATE_MOTION), vshrq_n_u16(neg, BG_RATE));
+
+    return vsubq_u16(vaddq_u16(val, pos), neg);
+}
+
+static void simd_bg_part_neon(ctx_simd_bg *bg, int indx, uint8x8_t img, uint8x8_t mov
+    , uint8x8_t *ref, uint8x8_t *thr)
+{
+    uint16x8_t mean, dev, dist, mov16;
+
+    mov16 = vreinterpretq_u16_s16(vmovl_s8(vreinterpret_s8_u8(mov)));
+    mean = vld1q_u16(bg->mean + indx);
+    dev = vld1q_u16(bg->dev + indx);
+    mean = simd_bg_step_neon(mean, vshll_n_u8(img, 8), mov16, &dist);
+    dev = simd_bg_step_neon(dev, dist, mov16, &dist);
+    vst1q_u16(bg->mean + indx, mean);
+    vst1q_u16(bg->dev + indx, dev);
+
+    *ref = vrshrn_n_u16(mean, 8);
+    *thr = vqmovn_u16(vmulq_n_u16(vshrq_n_u16(dev, 8), BG_DEV_SCALE));
+}
+
+static void simd_bg_update_neon(ctx_simd_bg *bg)
+{
+    const uint8x16_t noise = vdupq_n_u8((uint8_t)bg->noise);
+    uint8x16_t img, mov;
+    uint8x8_t ref_lo, ref_hi, thr_lo, thr_hi;
+    int indx, indx_max;
+
+    indx_max = bg->count - (bg->count % 16);
+    for (indx = 0; indx < indx_max; indx += 16) {
+        img = vld1q_u8(bg->img + indx);
+        mov = vld1q_u8(bg->out + indx);
+        mov = vtstq_u8(mov, mov);
+
+        simd_bg_part_neon(bg, indx, vget_low_u8(img), vget_low_u8(mov), &ref_lo, &thr_lo);
+        simd_bg_part_neon(bg, indx + 8, vget_high_u8(img), vget_high_u8(mov), &ref_hi, &thr_hi);
+
+        vst1q_u8(bg->ref + indx, vcombine_u8(ref_lo, ref_hi));
+        vst1q_u8(bg->noise_map + indx, vqaddq_u8(vcombine_u8(thr_lo, thr_hi), noise));
+    }
+
+    simd_bg_update_c(bg, indx_max);
+}
+
+#endif /* SIMD_NEON */
+
+/* Select the best instruction set supported by this processor */
+void simd_init()
+{
+    simd_active = SIMD_TYPE_NONE;
+
+    #ifdef SIMD_X86
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("avx2")) {
+            simd_active = SIMD_TYPE_AVX2;
+        } else if (__builtin_cpu_supports("sse2")) {
+            simd_active = SIMD_TYPE_SSE2;
+        }
+    #endif
+
+    #ifdef SIMD_NEON
+        simd_active = SIMD_TYPE_NEON;
+    #endif
+}
+
+enum SIMD_TYPE simd_type()
+{
+    return simd_active;
+}
+
+const char *simd_name()
+{
+    if (simd_active == SIMD_TYPE_SSE2) {
+        return "sse2";
+    } else if (simd_active == SIMD_TYPE_AVX2) {
+        return "avx2";
+    } else if (simd_active == SIMD_TYPE_NEON) {
+        return "neon";
+    } else {
+        return "none";
+    }
+}
+
+/* Difference of the image against the reference frame */
+void simd_diff(ctx_simd_diff *dif)
+{
+    dif->diffs = 0;
+    dif->diffs_net = 0;
+
+    /* The vector versions compare unsigned bytes and need non negative levels */
+    if ((dif->noise < 0) || (dif->lrgchg < 0)) {
+        simd_diff_c(dif, 0);
+        return;
+    }
+
+    #ifdef SIMD_X86
+        if (simd_active == SIMD_TYPE_AVX2) {
+            simd_diff_avx2(dif);
+            return;
+        } else if (simd_active == SIMD_TYPE_SSE2) {
+            simd_diff_sse2(dif);
+            return;
+        }
+    #endif
+
+    #ifdef SIMD_NEON
+        if (simd_active == SIMD_TYPE_NEON) {
+            simd_diff_neon(dif);
+            return;
+        }
+    #endif
+
+    simd_diff_c(dif, 0);
+}
+
+/*
+ * Reduce the PYRAMID_SCALE rows starting at src to one row of dst_max and
+ * dst_min holding the largest and smallest pixel of each block of
+ * PYRAMID_SCALE by PYRAMID_SCALE pixels.
+ */
+void simd_pyramid_row(const u_char *src, u_char *dst_max, u_char *dst_min, int width)
+{
+    #ifdef SIMD_X86
+        if (simd_active != SIMD_TYPE_NONE) {
+            simd_pyramid_row_sse2(src, dst_max, dst_min, width);
+            return;
+        }
+    #endif
+
+    #ifdef SIMD_NEON
+        if (simd_active == SIMD_TYPE_NEON) {
+            simd_pyramid_row_neon(src, dst_max, dst_min, width);
+            return;
+        }
+    #endif
+
+    simd_pyramid_row_c(src, dst_max, dst_min, width, 0);
+}
+
+/*
+ * Erode or dilate one run of a row.  An eroded pixel is cleared when any
+ * pixel of the shape is zero and a dilated pixel is set to the largest
+ * value in the shape.  Returns the number of pixels left set in the run.
+ */
+int simd_morph(ctx_simd_morph *mor)
+{
+    #ifdef SIMD_X86
+        if (simd_active != SIMD_TYPE_NONE) {
+            return simd_morph_sse2(mor);
+        }
+    #endif
+
+    #ifdef SIMD_NEON
+        if (simd_active == SIMD_TYPE_NEON) {
+            return simd_morph_neon(mor);
+        }
+    #endif
+
+    if ((mor->op == SIMD_MORPH_DILATE9) || (mor->op == SIMD_MORPH_ERODE9)) {
+        simd_morph_vert_c(mor, -1);
+    }
+    return simd_morph_c(mor, 0);
+}
+
+/* Update the reference frame with the new image */
+void simd_ref_update(ctx_simd_ref *upd)
+{
+    /* The vector versions compare unsigned bytes and words */
+    if ((upd->threshold < 0) || (upd->threshold > 255) ||
+        (upd->accept < 0) || (upd->accept > 65534)) {
+        simd_ref_update_c(upd, 0);
+        return;
+    }
+
+    #ifdef SIMD_X86
+        if (simd_active != SIMD_TYPE_NONE) {
+            simd_ref_update_sse2(upd);
+            return;
+        }
+    #endif
+
+    #ifdef SIMD_NEON
+        if (simd_active == SIMD_TYPE_NEON) {
+            simd_ref_update_neon(upd);
+            return;
+        }
+    #endif
+
+    simd_ref_update_c(upd, 0);
+}
+
+/* Update the running gaussian background with the new image */
+void simd_bg_update(ctx_simd_bg *bg)
+{
+    /* The vector versions add the noise level to unsigned bytes */
+    if ((bg->noise < 0) || (bg->noise > 255)) {
+        simd_bg_update_c(bg, 0);
+        return;
+    }
+
+    #ifdef SIMD_X86
+        if (simd_active != SIMD_TYPE_NONE) {
+            simd_bg_update_sse2(bg);
+            return;
+        }
+    #endif
+
+    #ifdef SIMD_NEON
+        if (simd_active == SIMD_TYPE_NEON) {
+            simd_bg_update_neon(bg);
+            return;
+        }
+    #endif
+
+    simd_bg_update_c(bg, 0);
+}
@@ -0,0 +1,124 @@
+/*
+ *    This file is part of MotionPlus.
+ *
+ *    MotionPlus is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ *
+ *    MotionPlus is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License
+ *    along with MotionPlus.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef _INCLUDE_ALG_SIMD_HPP_
+#define _INCLUDE_ALG_SIMD_HPP_
+
+    #define PYRAMID_SCALE   4   /* Block size of the reduced images.  Vector code assumes 4 */
+    #define DIRTY_SIZE      8   /* Pixels for each byte of the dirty map */
+    #define BG_RATE         5   /* Background model learns 1/32 of each new image */
+    #define BG_RATE_MOTION  10  /* and 1/1024 for the pixels in motion */
+    #define BG_DEV_SCALE    3   /* Deviations added to the noise level of each pixel */
+
+    enum SIMD_TYPE {
+        SIMD_TYPE_NONE,     /* Plain C loops */
+        SIMD_TYPE_SSE2,
+        SIMD_TYPE_AVX2,
+        SIMD_TYPE_NEON
+    };
+
+    /*
+     * Parameters and results for one pass of the frame differencing.
+     * The mask, mask_final, mask_buffer, noise_map and dirty pointers are
+     * optional and are left as NULL when not in use.  With a dirty map, out
+     * must start on a multiple of DIRTY_SIZE pixels.
+     */
+    struct ctx_simd_diff {
+        const u_char    *ref;           /* Reference frame */
+        const u_char    *img;           /* New image (privacy mask applied) */
+        const u_char    *mask;          /* Fixed mask file values */
+        const u_char    *mask_final;    /* Smart mask.  Zero excludes the pixel */
+        int             *mask_buffer;   /* Smart mask accumulator */
+        int             mask_incr;      /* Amount to add to mask_buffer for changed pixels */
+        u_char          *out;           /* Motion image.  Every byte in count is written */
+        u_char          *dirty;         /* Set non zero for each DIRTY_SIZE pixels with motion */
+        int             count;          /* Number of pixels to process */
+        int             noise;
+        const u_char    *noise_map;     /* Noise level of each pixel used in place of noise */
+        int             lrgchg;
+        int             diffs;          /* Result: pixels above the noise level */
+        int             diffs_net;      /* Result: net large changes (lighter minus darker) */
+    };
+
+    enum SIMD_MORPH {
+        SIMD_MORPH_ERODE9,  /* Erode with the 3x3 box */
+        SIMD_MORPH_ERODE5,  /* Erode with the + shape */
+        SIMD_MORPH_DILATE9, /* Dilate with the 3x3 box */
+        SIMD_MORPH_DILATE5  /* Dilate with the + shape */
+    };
+
+    /*
+     * Parameters for the erode or dilate of one run of a row.  The pixel
+     * before and after the run are read from the above, cur and below rows.
+     * The box shapes are done as a column pass into vert and then a row
+     * pass so vert must also have room for the pixel before and after.
+     */
+    struct ctx_simd_morph {
+        enum SIMD_MORPH op;
+        const u_char    *above;         /* Row above before any changes */
+        const u_char    *cur;           /* Row to change before any changes */
+        const u_char    *below;         /* Row below before any changes */
+        u_char          *vert;          /* Scratch row for the column pass */
+        u_char          *out;           /* Changed row */
+        int             count;          /* Number of pixels to process */
+    };
+
+    /*
+     * Parameters for the update of the reference frame.  Changed pixels
+     * are kept out of the reference while they are in motion and blended
+     * in with weight out of 256 once they are not.
+     */
+    struct ctx_simd_ref {
+        u_char          *ref;           /* Reference frame to update */
+        uint16_t        *dyn;           /* Frames each changed pixel has been excluded */
+        const u_char    *img;           /* New image (privacy mask applied) */
+        const u_char    *mask_final;    /* Smart mask.  Zero takes the pixel as is */
+        const u_char    *out;           /* Motion image */
+        int             count;          /* Number of pixels to process */
+        int             threshold;      /* Change needed to exclude a pixel */
+        int             accept;         /* Frames before an excluded pixel is accepted */
+        int             weight;         /* Weight of the new image in the blend out of 256 */
+    };
+
+    /*
+     * Parameters for the update of the running gaussian background.  The
+     * mean and mean deviation of each pixel are fixed point with 8 bits of
+     * fraction.  The reference frame and the noise level of each pixel for
+     * the diff are made from them.
+     */
+    struct ctx_simd_bg {
+        uint16_t        *mean;
+        uint16_t        *dev;
+        u_char          *ref;           /* Result: mean rounded to a pixel */
+        u_char          *noise_map;     /* Result: noise plus BG_DEV_SCALE deviations */
+        const u_char    *img;           /* New image (privacy mask applied) */
+        const u_char    *out;           /* Motion image */
+        int             count;          /* Number of pixels to process */
+        int             noise;
+    };
+
+    void simd_init();
+    enum SIMD_TYPE simd_type();
+    const char *simd_name();
+    void simd_diff(ctx_simd_diff *dif);
+    void simd_pyramid_row(const u_char *src, u_char *dst_max, u_char *dst_min, int width);
+    int simd_morph(ctx_simd_morph *mor);
+    void simd_ref_update(ctx_simd_ref *upd);
+    void simd_bg_update(ctx_simd_bg *bg);
+
+#endif /* _INCLUDE_ALG_SIMD_HPP_ */
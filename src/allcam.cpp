@@ -24,6 +24,9 @@
 #include "allcam.hpp"
 #include "camera.hpp"
 #include "jpegutils.hpp"
+#include "resize.hpp"
+#include "workpool.hpp"
+#include "webu_getimg.hpp"
 
 
 static void *allcam_handler(void *arg)
@@ -59,26 +62,120 @@ void cls_allcam::getsizes_img(cls_camera *p_cam)
     p_cam->all_sizes.dst_sz = (dst_w * dst_h * 3)/2;
 }
 
-void cls_allcam::getimg_src(cls_camera *p_cam, std::string imgtyp, u_char *dst_img, u_char *src_img)
+static void allcam_tile_process(void *arg, int indx)
+{
+    ((cls_allcam *)arg)->tile_process(indx);
+}
+
+/* The stream of the all camera image and the image type for the index */
+ctx_stream_data *cls_allcam::stream_data(int indx, std::string &imgtyp)
+{
+    if (indx == 0) {
+        imgtyp = "norm";
+        return &stream.norm;
+    } else if (indx == 1) {
+        imgtyp = "motion";
+        return &stream.motion;
+    } else if (indx == 2) {
+        imgtyp = "secondary";
+        return &stream.secondary;
+    } else if (indx == 3) {
+        imgtyp = "source";
+        return &stream.source;
+    } else {
+        imgtyp = "norm";
+        return &stream.sub;
+    }
+}
+
+/*
+ * Match the tiles to the active cameras.  A tile that changes camera is
+ * drawn again on all the canvases and the canvases are cleared so that
+ * nothing is left of a camera no longer shown.
+ */
+void cls_allcam::tiles_check()
+{
+    int indx, strm_indx;
+    bool changed;
+    ctx_allcam_tile *tile;
+
+    changed = false;
+    if ((int)tiles.size() != active_cnt) {
+        changed = true;
+    }
+    for (indx=0; indx<(int)tiles.size(); indx++) {
+        tile = &tiles[indx];
+        if ((indx >= active_cnt) || (tile->cam != active_cam[indx])) {
+            myfree(tile->src_img);
+            changed = true;
+        }
+    }
+    if (changed == false) {
+        return;
+    }
+
+    tiles.resize((uint)active_cnt);
+    for (indx=0; indx<active_cnt; indx++) {
+        tile = &tiles[indx];
+        if (tile->src_img == nullptr) {
+            tile->cam = active_cam[indx];
+            tile->src_img = (u_char*)mymalloc((uint)tile->cam->all_sizes.src_sz);
+        }
+        for (strm_indx=0; strm_indx<ALLCAM_STRM_CNT; strm_indx++) {
+            tile->img_nbr[strm_indx] = -1;
+        }
+    }
+
+    for (strm_indx=0; strm_indx<ALLCAM_STRM_CNT; strm_indx++) {
+        canvas_clear(&canvas[strm_indx]);
+    }
+}
+
+void cls_allcam::tiles_free()
 {
     int indx;
+
+    for (indx=0; indx<(int)tiles.size(); indx++) {
+        myfree(tiles[indx].src_img);
+    }
+    tiles.clear();
+}
+
+/*
+ * Bring the tile of one camera up to date on the canvas of the current
+ * stream.  Only a new image from the camera is copied out and scaled.  The
+ * scaler writes straight into the place of the tile on the canvas.
+ */
+void cls_allcam::tile_process(int indx)
+{
+    int cnt, strm_w, strm_h;
+    bool newimg;
+    uint8_t *dst_data[4];
+    int dst_linesize[4];
+    ctx_allcam_tile *tile;
     ctx_stream_data *strm_c;
+    cls_camera *p_cam;
+    u_char *all_img;
+
+    tile = &tiles[indx];
+    p_cam = tile->cam;
 
-    if (imgtyp == "norm") {
+    if (tile_imgtyp == "norm") {
         strm_c = &p_cam->stream.norm;
-    } else if (imgtyp == "motion") {
+    } else if (tile_imgtyp == "motion") {
         strm_c = &p_cam->stream.motion;
-    } else if (imgtyp == "source") {
+    } else if (tile_imgtyp == "source") {
         strm_c = &p_cam->stream.source;
-    } else if (imgtyp == "secondary") {
+    } else if (tile_imgtyp == "secondary") {
         strm_c = &p_cam->stream.secondary;
     } else {
         return;
     }
 
+    newimg = false;
     pthread_mutex_lock(&p_cam->stream.mutex);
-        indx=0;
-        while (indx < 1000) {
+        cnt=0;
+        while (cnt < 1000) {
             if (strm_c->img_data == nullptr) {
                 if (strm_c->all_cnct == 0){
                     strm_c->all_cnct++;
@@ -89,125 +186,139 @@ void cls_allcam::getimg_src(cls_camera *p_cam, std::string imgtyp, u_char *dst_i
             } else {
                 break;
             }
-            indx++;
+            cnt++;
         }
         if ((p_cam->imgs.height != p_cam->all_sizes.src_h) ||
             (p_cam->imgs.width  != p_cam->all_sizes.src_w)) {
             MOTPLS_LOG(NTC, TYPE_STREAM, NO_ERRNO
                 , "Image has changed. Device: %d"
                 , p_cam->cfg->device_id);
-            memset(src_img, 0x00, (uint)p_cam->all_sizes.src_sz);
             p_cam->all_sizes.reset = true;
         } else if (strm_c->img_data == nullptr) {
             MOTPLS_LOG(DBG, TYPE_STREAM, NO_ERRNO
                 , "Could not get image for device %d"
                 , p_cam->cfg->device_id);
-            memset(src_img, 0x00, (uint)p_cam->all_sizes.src_sz);
-        } else {
-            memcpy(src_img, strm_c->img_data, (uint)p_cam->all_sizes.src_sz);
+        } else if (strm_c->img_nbr != tile->img_nbr[tile_strm]) {
+            memcpy(tile->src_img, strm_c->img_data, (uint)p_cam->all_sizes.src_sz);
+            tile->img_nbr[tile_strm] = strm_c->img_nbr;
+            newimg = true;
         }
     pthread_mutex_unlock(&p_cam->stream.mutex);
 
-    util_resize(src_img, p_cam->all_sizes.src_w, p_cam->all_sizes.src_h
-        , dst_img, p_cam->all_sizes.dst_w, p_cam->all_sizes.dst_h);
+    if (newimg == false) {
+        return;
+    }
 
+    all_img = canvas[tile_strm].all_img;
+    strm_w = all_sizes.src_w;
+    strm_h = all_sizes.src_h;
+
+    dst_data[0] = all_img +
+        (p_cam->all_loc.offset_row * strm_w) + p_cam->all_loc.offset_col;
+    dst_data[1] = all_img + (strm_w * strm_h) +
+        ((p_cam->all_loc.offset_row / 2) * (strm_w / 2)) +
+        (p_cam->all_loc.offset_col / 2);
+    dst_data[2] = dst_data[1] + ((strm_w * strm_h) / 4);
+    dst_data[3] = nullptr;
+    dst_linesize[0] = strm_w;
+    dst_linesize[1] = strm_w / 2;
+    dst_linesize[2] = strm_w / 2;
+    dst_linesize[3] = 0;
+
+    app->resize->scale_planes(tile->src_img
+        , p_cam->all_sizes.src_w, p_cam->all_sizes.src_h
+        , dst_data, dst_linesize
+        , p_cam->all_sizes.dst_w, p_cam->all_sizes.dst_h
+        , AV_PIX_FMT_YUV420P);
+
+    tile_changed++;
 }
 
-void cls_allcam::getimg(ctx_stream_data *strm_a, std::string imgtyp)
+/*
+ * Update the all camera image for the stream.  The tiles with a new image
+ * are scaled onto the canvas in parallel on the workpool.  The canvas is
+ * then scaled and encoded into the spare buffers outside of the lock and
+ * those are swapped with the ones of the stream so readers only wait on
+ * the swap.  Returns whether a new image was published.
+ */
+bool cls_allcam::getimg(int strm_indx)
 {
-    int a_y, a_u, a_v; /* all img y,u,v */
-    int c_y, c_u, c_v; /* camera img y,u,v */
-    int img_orow, img_ocol;
-    int indx, row, dst_w, dst_h;
-    u_char *dst_img, *src_img, *all_img;
-    cls_camera *p_cam;
+    u_char *tmp;
+    int jpg_sz;
+    std::string imgtyp;
+    ctx_stream_data *strm_a;
+    ctx_allcam_canvas *cnvs;
 
     getsizes();
+    tiles_check();
 
-    a_y = 0;
-    a_u = (all_sizes.src_w * all_sizes.src_h);
-    a_v = a_u + (a_u / 4);
+    strm_a = stream_data(strm_indx, imgtyp);
+    cnvs = &canvas[strm_indx];
 
-    all_img = (unsigned char*) mymalloc((uint)all_sizes.src_sz);
-    memset(all_img , 0x80, (size_t)a_u);
-    memset(all_img  + a_u, 0x80, (size_t)(a_u/2));
+    tile_strm = strm_indx;
+    tile_imgtyp = imgtyp;
+    tile_changed = 0;
+    app->workpool->run(allcam_tile_process, this, active_cnt);
 
-    for (indx=0; indx<active_cnt; indx++) {
-        p_cam = active_cam[indx];
-        dst_w = p_cam->all_sizes.dst_w;
-        dst_h = p_cam->all_sizes.dst_h;
-
-        img_orow = p_cam->all_loc.offset_row;
-        img_ocol = p_cam->all_loc.offset_col;
-
-        dst_img = (unsigned char*) mymalloc((uint)p_cam->all_sizes.dst_sz);
-        src_img = (unsigned char*) mymalloc((uint)p_cam->all_sizes.src_sz);
-
-        getimg_src(p_cam, imgtyp, dst_img, src_img);
-
-        a_y = (img_orow * all_sizes.src_w) + img_ocol;
-        a_u =(all_sizes.src_h * all_sizes.src_w) +
-            ((img_orow / 4) * all_sizes.src_w) + (img_ocol / 2) ;
-        a_v = a_u + ((all_sizes.src_h * all_sizes.src_w) / 4);
-
-        c_y = 0;
-        c_u = (dst_w * dst_h);
-        c_v = c_u + (c_u / 4);
-
-        for (row=0; row<dst_h; row++) {
-            memcpy(all_img  + a_y, dst_img + c_y, (uint)dst_w);
-            a_y += all_sizes.src_w;
-            c_y += dst_w;
-            if (row % 2) {
-                memcpy(all_img  + a_u, dst_img + c_u, (uint)dst_w / 2);
-                //mymemset(all_img  + a_u, 0xFA, dst_w/2);
-                a_u += (all_sizes.src_w / 2);
-                c_u += (dst_w / 2);
-                memcpy(all_img  + a_v, dst_img + c_v, (uint)dst_w / 2);
-                a_v += (all_sizes.src_w / 2);
-                c_v += (dst_w / 2);
-            }
-        }
-
-        myfree(dst_img);
-        myfree(src_img);
+    if ((tile_changed == 0) && (cnvs->redraw == false)) {
+        return false;
     }
+    cnvs->redraw = false;
+
+    app->resize->scale(cnvs->all_img, all_sizes.src_w, all_sizes.src_h
+        , cnvs->img_data, all_sizes.dst_w, all_sizes.dst_h
+        , AV_PIX_FMT_YUV420P);
+
+    jpg_sz = jpgutl_put_yuv420p(
+        cnvs->jpg_data, all_sizes.dst_sz, cnvs->img_data
+        , all_sizes.dst_w, all_sizes.dst_h
+        , 70, NULL,NULL,NULL);
 
     pthread_mutex_lock(&stream.mutex);
-        memset(strm_a->img_data, 0x80, (size_t)all_sizes.dst_sz);
-        util_resize(all_img, all_sizes.src_w, all_sizes.src_h
-            , strm_a->img_data, all_sizes.dst_w, all_sizes.dst_h);
-        myfree(all_img);
+        tmp = strm_a->img_data;
+        strm_a->img_data = cnvs->img_data;
+        cnvs->img_data = tmp;
 
-        strm_a->jpg_sz = jpgutl_put_yuv420p(
-            strm_a->jpg_data, all_sizes.dst_sz, strm_a->img_data
-            , all_sizes.dst_w, all_sizes.dst_h
-            , 70, NULL,NULL,NULL);
+        tmp = strm_a->jpg_data;
+        strm_a->jpg_data = cnvs->jpg_data;
+        cnvs->jpg_data = tmp;
 
+        strm_a->jpg_sz = jpg_sz;
+        strm_a->img_nbr++;
         strm_a->consumed = false;
+        webu_getimg_part(strm_a);
     pthread_mutex_unlock(&stream.mutex);
 
+    return true;
+}
+
+/* Fill the canvas with gray and have it encoded again */
+void cls_allcam::canvas_clear(ctx_allcam_canvas *cnvs)
+{
+    int img_sz;
+
+    if (cnvs->all_img == nullptr) {
+        return;
+    }
+    img_sz = all_sizes.src_w * all_sizes.src_h;
+    memset(cnvs->all_img , 0x80, (size_t)img_sz);
+    memset(cnvs->all_img  + img_sz, 0x80, (size_t)(img_sz/2));
+    cnvs->redraw = true;
 }
 
 void cls_allcam::stream_free()
 {
     int indx;
+    std::string imgtyp;
     ctx_stream_data *strm;
 
-    for (indx=0;indx<5;indx++) {
-        if (indx == 0) {
-            strm = &stream.norm;
-        } else if (indx == 1) {
-            strm = &stream.motion;
-        } else if (indx == 2) {
-            strm = &stream.secondary;
-        } else if (indx == 3) {
-            strm = &stream.source;
-        } else if (indx == 4) {
-            strm = &stream.sub;
-        }
+    for (indx=0;indx<ALLCAM_STRM_CNT;indx++) {
+        strm = stream_data(indx, imgtyp);
         myfree(strm->img_data);
         myfree(strm->jpg_data);
+        myfree(canvas[indx].all_img);
+        myfree(canvas[indx].img_data);
+        myfree(canvas[indx].jpg_data);
     }
 
 }
@@ -215,25 +326,23 @@ void cls_allcam::stream_free()
 void cls_allcam::stream_alloc()
 {
     int indx;
+    std::string imgtyp;
     ctx_stream_data *strm;
 
-    for (indx=0;indx<5;indx++) {
-        if (indx == 0) {
-            strm = &stream.norm;
-        } else if (indx == 1) {
-            strm = &stream.motion;
-        } else if (indx == 2) {
-            strm = &stream.secondary;
-        } else if (indx == 3) {
-            strm = &stream.source;
-        } else if (indx == 4) {
-            strm = &stream.sub;
-        }
+    for (indx=0;indx<ALLCAM_STRM_CNT;indx++) {
+        strm = stream_data(indx, imgtyp);
         strm->img_data = (unsigned char*)
             mymalloc((size_t)all_sizes.dst_sz);
         strm->jpg_data = (unsigned char*)
             mymalloc((size_t)all_sizes.dst_sz);
         strm->consumed = true;
+        canvas[indx].all_img = (unsigned char*)
+            mymalloc((size_t)all_sizes.src_sz);
+        canvas[indx].img_data = (unsigned char*)
+            mymalloc((size_t)all_sizes.dst_sz);
+        canvas[indx].jpg_data = (unsigned char*)
+            mymalloc((size_t)all_sizes.dst_sz);
+        canvas_clear(&canvas[indx]);
     }
 
 }
@@ -697,8 +806,11 @@ void cls_allcam::getsizes()
     getsizes_alignh();
     getsizes_offset_user();
     getsizes_pct();
-    stream_free();
-    stream_alloc();
+    tiles_free();
+    pthread_mutex_lock(&stream.mutex);
+        stream_free();
+        stream_alloc();
+    pthread_mutex_unlock(&stream.mutex);
 
 }
 
@@ -730,28 +842,30 @@ void cls_allcam::timing()
 
 void cls_allcam::handler()
 {
+    int indx;
+    bool published;
+    std::string imgtyp;
+    ctx_stream_data *strm;
+
     mythreadname_set("ac", 0, "allcam");
 
     while (handler_stop == false) {
-        if ((stream.norm.all_cnct > 0) &&
-            (stream.norm.consumed == true)) {
-            getimg(&stream.norm,"norm");
-        }
-        if ((stream.sub.all_cnct > 0) &&
-            (stream.sub.consumed == true)) {
-            getimg(&stream.sub,"norm");
-        }
-        if ((stream.motion.all_cnct > 0) &&
-            (stream.motion.consumed == true)) {
-            getimg(&stream.motion,"motion");
-        }
-        if ((stream.source.all_cnct > 0) &&
-            (stream.source.consumed == true)) {
-            getimg(&stream.source,"source");
+        published = false;
+        for (indx=0; indx<ALLCAM_STRM_CNT; indx++) {
+            strm = stream_data(indx, imgtyp);
+            if ((strm->all_cnct > 0) &&
+                (strm->consumed == true)) {
+                if (getimg(indx)) {
+                    published = true;
+                }
+            }
         }
-        if ((stream.secondary.all_cnct > 0) &&
-            (stream.secondary.consumed == true)) {
-            getimg(&stream.secondary,"secondary");
+        if (published) {
+            pthread_mutex_lock(&stream.mutex);
+                stream.pub_nbr++;
+                pthread_cond_broadcast(&stream.cond_pub);
+                webu_getimg_resume(&stream);
+            pthread_mutex_unlock(&stream.mutex);
         }
         timing();
     }
@@ -826,6 +940,8 @@ void cls_allcam::handler_shutdown()
 
 cls_allcam::cls_allcam(cls_motapp *p_app)
 {
+    pthread_condattr_t condattr;
+
     app = p_app;
 
     watchdog = app->cfg->watchdog_tmo;
@@ -834,8 +950,13 @@ cls_allcam::cls_allcam(cls_motapp *p_app)
     finish = false;
     memset(&all_sizes, 0, sizeof(ctx_all_sizes));
     memset(&stream, 0, sizeof(ctx_stream));
+    memset(canvas, 0, sizeof(canvas));
     all_sizes.reset = true;
     pthread_mutex_init(&stream.mutex, NULL);
+    pthread_condattr_init(&condattr);
+    pthread_condattr_setclock(&condattr, CLOCK_MONOTONIC);
+    pthread_cond_init(&stream.cond_pub, &condattr);
+    pthread_condattr_destroy(&condattr);
     stream.motion.consumed = true;
     stream.norm.consumed = true;
     stream.secondary.consumed = true;
@@ -844,14 +965,25 @@ cls_allcam::cls_allcam(cls_motapp *p_app)
     clock_gettime(CLOCK_MONOTONIC, &curr_ts);
     active_cnt    = 0;
     active_cam.clear();
+    tiles.clear();
+    tile_strm = 0;
+    tile_changed = 0;
 
     handler_startup();
 }
 
 cls_allcam::~cls_allcam()
 {
+    int indx;
+    std::string imgtyp;
+
     finish = true;
     handler_shutdown();
+    for (indx=0; indx<ALLCAM_STRM_CNT; indx++) {
+        webu_getimg_part_free(stream_data(indx, imgtyp));
+    }
     pthread_mutex_destroy(&stream.mutex);
+    pthread_cond_destroy(&stream.cond_pub);
     stream_free();
+    tiles_free();
 }
@@ -19,6 +19,23 @@
 #ifndef _INCLUDE_ALLCAM_HPP_
 #define _INCLUDE_ALLCAM_HPP_
 
+#define ALLCAM_STRM_CNT 5   /* norm, motion, secondary, source and sub */
+
+/* The place of one camera on the all camera image */
+struct ctx_allcam_tile {
+    cls_camera  *cam;
+    u_char      *src_img;                   /* Copy of the camera image to scale */
+    int64_t     img_nbr[ALLCAM_STRM_CNT];   /* Camera image last drawn on each canvas */
+};
+
+/* The all camera image kept for a stream along with its spare buffers */
+struct ctx_allcam_canvas {
+    u_char  *all_img;   /* Tiles at full size.  Only redrawn where changed */
+    u_char  *img_data;  /* Spare for the scaled image.  Swapped with the stream */
+    u_char  *jpg_data;  /* Spare for the jpg.  Swapped with the stream */
+    bool    redraw;     /* Encode again even without a new tile */
+};
+
 class cls_allcam {
     public:
         cls_allcam(cls_motapp *p_app);
@@ -28,6 +45,7 @@ class cls_allcam {
         bool            handler_running;
         pthread_t       handler_thread;
         void            handler();
+        void            tile_process(int indx);
         ctx_stream      stream;
         ctx_all_sizes   all_sizes;
 
@@ -44,6 +62,12 @@ class cls_allcam {
         int max_row;
         struct timespec     curr_ts;
 
+        std::vector<ctx_allcam_tile>    tiles;
+        ctx_allcam_canvas   canvas[ALLCAM_STRM_CNT];
+        int                 tile_strm;      /* Stream index of the tiles being drawn */
+        std::string         tile_imgtyp;
+        std::atomic<int>    tile_changed;   /* Tiles with a new image */
+
         void handler_startup();
         void handler_shutdown();
         void timing();
@@ -60,8 +84,11 @@ class cls_allcam {
         void init_params();
         void init_validate();
         void init_cams();
-        void getimg_src(cls_camera *p_cam, std::string imgtyp, u_char *dst_img, u_char *src_img);
-        void getimg(ctx_stream_data *strm_a, std::string imgtyp);
+        ctx_stream_data *stream_data(int indx, std::string &imgtyp);
+        void tiles_check();
+        void tiles_free();
+        void canvas_clear(ctx_allcam_canvas *cnvs);
+        bool getimg(int strm_indx);
 
 };
 
@@ -28,6 +28,7 @@
 #include "video_loopback.hpp"
 #include "netcam.hpp"
 #include "conf.hpp"
+#include "alg_simd.hpp"
 #include "alg.hpp"
 #include "alg_sec.hpp"
 #include "picture.hpp"
@@ -309,93 +310,123 @@ void cls_camera::detected()
     track_move();
 }
 
-/* Apply the privacy mask to image*/
-void cls_camera::mask_privacy()
+/* Apply the privacy mask to a strip of the luminance or the chrominance */
+void cls_camera::mask_privacy_strip(u_char *image, const u_char *mask
+    , const u_char *maskuv, int len)
 {
-    if (imgs.mask_privacy == NULL) {
-        return;
-    }
-
     /*
     * This function uses long operations to process 4 (32 bit) or 8 (64 bit)
     * bytes at a time, providing a significant boost in performance.
     * Then a trailer loop takes care of any remaining bytes.
     */
-    u_char *image;
-    const u_char *mask;
-    const u_char *maskuv;
-
-    int index_y;
-    int index_crcb;
     int increment;
-    int indx_img;                /* Counter for how many images we need to apply the mask to */
-    int indx_max;                /* 1 if we are only doing norm, 2 if we are doing both norm and high */
 
-    indx_img = 1;
-    if (imgs.size_high > 0) {
-        indx_max = 2;
-    } else {
-        indx_max = 1;
-    }
     increment = sizeof(unsigned long);
 
-    while (indx_img <= indx_max) {
-        if (indx_img == 1) {
-            /* Normal Resolution */
-            index_y = imgs.height * imgs.width;
-            image = current_image->image_norm;
-            mask = imgs.mask_privacy;
-            index_crcb = imgs.size_norm - index_y;
-            maskuv = imgs.mask_privacy_uv;
-        } else {
-            /* High Resolution */
-            index_y = imgs.height_high * imgs.width_high;
-            image = current_image->image_high;
-            mask = imgs.mask_privacy_high;
-            index_crcb = imgs.size_high - index_y;
-            maskuv = imgs.mask_privacy_high_uv;
-        }
-
-        while (index_y >= increment) {
+    if (maskuv == NULL) {
+        while (len >= increment) {
             *((unsigned long *)image) &= *((unsigned long *)mask);
             image += increment;
             mask += increment;
-            index_y -= increment;
+            len -= increment;
         }
-        while (--index_y >= 0) {
+        while (--len >= 0) {
             *(image++) &= *(mask++);
         }
+        return;
+    }
 
-        /* Mask chrominance. */
-        while (index_crcb >= increment) {
-            index_crcb -= increment;
-            /*
-            * Replace the masked bytes with 0x080. This is done using two masks:
-            * the normal privacy mask is used to clear the masked bits, the
-            * "or" privacy mask is used to write 0x80. The benefit of that method
-            * is that we process 4 or 8 bytes in just two operations.
-            */
-            *((unsigned long *)image) &= *((unsigned long *)mask);
-            mask += increment;
-            *((unsigned long *)image) |= *((unsigned long *)maskuv);
-            maskuv += increment;
-            image += increment;
+    /* Mask chrominance. */
+    while (len >= increment) {
+        len -= increment;
+        /*
+        * Replace the masked bytes with 0x080. This is done using two masks:
+        * the normal privacy mask is used to clear the masked bits, the
+        * "or" privacy mask is used to write 0x80. The benefit of that method
+        * is that we process 4 or 8 bytes in just two operations.
+        */
+        *((unsigned long *)image) &= *((unsigned long *)mask);
+        mask += increment;
+        *((unsigned long *)image) |= *((unsigned long *)maskuv);
+        maskuv += increment;
+        image += increment;
+    }
+
+    while (--len >= 0) {
+        if (*(mask++) == 0x00) {
+            *image = 0x80; // Mask last remaining bytes.
+        }
+        image += 1;
+    }
+}
+
+/*
+ * Save the virgin image, apply the privacy mask and save the privacy
+ * image in a single pass.  The image is processed in strips small enough
+ * to stay in the cache so each byte is only read once from memory.  When
+ * the standard diff is certain to be needed, it is also done on each strip.
+ */
+void cls_camera::capture_copy()
+{
+    u_char *image;
+    int indx, len, size_y;
+    bool diff_strip;
+
+    image = current_image->image_norm;
+    size_y = imgs.width * imgs.height;
+    diff_strip = alg->diff_strip_start();
+
+    for (indx = 0; indx < imgs.size_norm; indx += len) {
+        /* Strips do not cross from the luminance into the chrominance */
+        if (indx < size_y) {
+            len = MIN(CAPTURE_STRIP_SIZE, size_y - indx);
+        } else {
+            len = MIN(CAPTURE_STRIP_SIZE, imgs.size_norm - indx);
         }
 
-        while (--index_crcb >= 0) {
-            if (*(mask++) == 0x00) {
-                *image = 0x80; // Mask last remaining bytes.
+        memcpy(imgs.image_virgin + indx, image + indx, (uint)len);
+
+        if (imgs.mask_privacy != NULL) {
+            if (indx < size_y) {
+                mask_privacy_strip(image + indx
+                    , imgs.mask_privacy + indx, NULL, len);
+            } else {
+                mask_privacy_strip(image + indx
+                    , imgs.mask_privacy + indx
+                    , imgs.mask_privacy_uv + (indx - size_y), len);
             }
-            image += 1;
         }
 
-        indx_img++;
+        memcpy(imgs.image_vprvcy + indx, image + indx, (uint)len);
+
+        if (diff_strip && (indx < size_y)) {
+            alg->diff_strip(indx, len);
+        }
+    }
+
+    if (diff_strip) {
+        alg->diff_strip_finish();
+    }
+
+    /* High resolution image only needs the privacy mask */
+    if ((imgs.mask_privacy != NULL) && (imgs.size_high > 0)) {
+        size_y = imgs.width_high * imgs.height_high;
+        mask_privacy_strip(current_image->image_high
+            , imgs.mask_privacy_high, NULL, size_y);
+        mask_privacy_strip(current_image->image_high + size_y
+            , imgs.mask_privacy_high + size_y
+            , imgs.mask_privacy_high_uv, imgs.size_high - size_y);
     }
 }
 
 /* Close and clean up camera*/
 void cls_camera::cam_close()
 {
+    /* Streams using the device see this before it is deleted */
+    pthread_mutex_lock(&stream.mutex);
+        stream.dev_nbr++;
+    pthread_mutex_unlock(&stream.mutex);
+
     mydelete(libcam);
     mydelete(v4l2cam);
     mydelete(netcam);
@@ -583,8 +614,10 @@ void cls_camera::init_areadetect()
 void cls_camera::init_buffers()
 {
     imgs.ref =(u_char*) mymalloc((uint)imgs.size_norm);
+    imgs.ref_max =(u_char*) mymalloc((uint)imgs.motionsize / (PYRAMID_SCALE * PYRAMID_SCALE));
+    imgs.ref_min =(u_char*) mymalloc((uint)imgs.motionsize / (PYRAMID_SCALE * PYRAMID_SCALE));
     imgs.image_motion.image_norm = (u_char*)mymalloc((uint)imgs.size_norm);
-    imgs.ref_dyn =(int*) mymalloc((uint)imgs.motionsize * sizeof(*imgs.ref_dyn));
+    imgs.ref_dyn =(uint16_t*) mymalloc((uint)imgs.motionsize * sizeof(*imgs.ref_dyn));
     imgs.image_virgin =(u_char*) mymalloc((uint)imgs.size_norm);
     imgs.image_vprvcy = (u_char*)mymalloc((uint)imgs.size_norm);
     imgs.labels =(int*)mymalloc((uint)imgs.motionsize * sizeof(*imgs.labels));
@@ -688,13 +721,7 @@ void cls_camera::init_cam_start()
 /* initialize reference images*/
 void cls_camera::init_ref()
 {
-    memcpy(imgs.image_virgin, current_image->image_norm
-        , (uint)imgs.size_norm);
-
-    mask_privacy();
-
-    memcpy(imgs.image_vprvcy, current_image->image_norm
-        , (uint)imgs.size_norm);
+    capture_copy();
 
     alg->ref_frame_reset();
 }
@@ -722,6 +749,8 @@ void cls_camera::cleanup()
 
     myfree(imgs.image_motion.image_norm);
     myfree(imgs.ref);
+    myfree(imgs.ref_max);
+    myfree(imgs.ref_min);
     myfree(imgs.ref_dyn);
     myfree(imgs.image_virgin);
     myfree(imgs.image_vprvcy);
@@ -1326,11 +1355,7 @@ int cls_camera::capture()
             }
         }
         missing_frame_counter = 0;
-        memcpy(imgs.image_virgin, current_image->image_norm
-            , (uint)imgs.size_norm);
-        mask_privacy();
-        memcpy(imgs.image_vprvcy, current_image->image_norm
-            , (uint)imgs.size_norm);
+        capture_copy();
 
     } else {
         if (connectionlosttime.tv_sec == 0) {
@@ -1982,6 +2007,8 @@ void cls_camera::handler_shutdown()
 
 cls_camera::cls_camera(cls_motapp *p_app)
 {
+    pthread_condattr_t condattr;
+
     app = p_app;
 
     cfg = nullptr;
@@ -2044,6 +2071,10 @@ cls_camera::cls_camera(cls_motapp *p_app)
     device_status = STATUS_CLOSED;
     memset(&imgs, 0, sizeof(ctx_images));
     memset(&stream, 0, sizeof(ctx_stream));
+    pthread_condattr_init(&condattr);
+    pthread_condattr_setclock(&condattr, CLOCK_MONOTONIC);
+    pthread_cond_init(&stream.cond_pub, &condattr);
+    pthread_condattr_destroy(&condattr);
     memset(&all_loc, 0, sizeof(ctx_all_loc));
     memset(&all_sizes, 0, sizeof(ctx_all_sizes));
     all_sizes.reset = true;
@@ -2054,5 +2085,6 @@ cls_camera::~cls_camera()
     mydelete(conf_src);
     mydelete(cfg);
     pthread_mutex_destroy(&stream.mutex);
+    pthread_cond_destroy(&stream.cond_pub);
     device_status = STATUS_CLOSED;
 }
@@ -27,6 +27,8 @@
 #define IMAGE_PRECAP    16
 #define IMAGE_POSTCAP   32
 
+#define CAPTURE_STRIP_SIZE  16384   /* Bytes per strip when copying and masking captured images */
+
 enum CAMERA_TYPE {
     CAMERA_TYPE_UNKNOWN,
     CAMERA_TYPE_V4L2,
@@ -77,6 +79,8 @@ struct ctx_images {
     ctx_image_data image_preview;  /* Picture buffer for best image when enables */
 
     u_char *ref;               /* The reference frame */
+    u_char *ref_max;           /* Largest pixel of each PYRAMID_SCALE block of ref */
+    u_char *ref_min;           /* Smallest pixel of each PYRAMID_SCALE block of ref */
     u_char *ref_next;          /* The reference frame */
     u_char *mask;              /* Buffer for the mask file */
     u_char *common_buffer;
@@ -93,7 +97,7 @@ struct ctx_images {
     int ring_in;                /* Index in image ring buffer we last added a image into */
     int ring_out;               /* Index in image ring buffer we want to process next time */
 
-    int *ref_dyn;               /* Dynamic objects to be excluded from reference frame */
+    uint16_t *ref_dyn;          /* Dynamic objects to be excluded from reference frame */
     int *labels;
     int *labelsize;
 
@@ -241,7 +245,9 @@ class cls_camera {
         void track_center();
         void track_move();
         void detected();
-        void mask_privacy();
+        void mask_privacy_strip(u_char *image, const u_char *mask
+            , const u_char *maskuv, int len);
+        void capture_copy();
         void cam_close();
         void cam_start();
         int cam_next(ctx_image_data *img_data);
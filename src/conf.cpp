@@ -100,14 +100,17 @@ ctx_parm config_parms[] = {
     {"mask_file",                 PARM_TYP_STRING, PARM_CAT_06, PARM_LEVEL_ADVANCED },
     {"mask_privacy",              PARM_TYP_STRING, PARM_CAT_06, PARM_LEVEL_ADVANCED },
     {"smart_mask_speed",          PARM_TYP_LIST,   PARM_CAT_06, PARM_LEVEL_LIMITED },
+    {"background_model",          PARM_TYP_LIST,   PARM_CAT_06, PARM_LEVEL_ADVANCED },
 
     {"lightswitch_percent",       PARM_TYP_INT,    PARM_CAT_07, PARM_LEVEL_LIMITED },
     {"lightswitch_frames",        PARM_TYP_INT,    PARM_CAT_07, PARM_LEVEL_LIMITED },
     {"minimum_motion_frames",     PARM_TYP_INT,    PARM_CAT_07, PARM_LEVEL_LIMITED },
     {"static_object_time",        PARM_TYP_INT,    PARM_CAT_07, PARM_LEVEL_LIMITED },
+    {"reference_weight",          PARM_TYP_INT,    PARM_CAT_07, PARM_LEVEL_ADVANCED },
     {"event_gap",                 PARM_TYP_INT,    PARM_CAT_07, PARM_LEVEL_LIMITED },
     {"pre_capture",               PARM_TYP_INT,    PARM_CAT_07, PARM_LEVEL_LIMITED },
     {"post_capture",              PARM_TYP_INT,    PARM_CAT_07, PARM_LEVEL_LIMITED },
+    {"detect_threads",            PARM_TYP_INT,    PARM_CAT_07, PARM_LEVEL_ADVANCED },
 
     {"on_event_start",            PARM_TYP_STRING, PARM_CAT_08, PARM_LEVEL_RESTRICTED },
     {"on_event_end",              PARM_TYP_STRING, PARM_CAT_08, PARM_LEVEL_RESTRICTED },
@@ -154,6 +157,7 @@ ctx_parm config_parms[] = {
 
     {"webcontrol_port",           PARM_TYP_INT,    PARM_CAT_13, PARM_LEVEL_ADVANCED },
     {"webcontrol_port2",          PARM_TYP_INT,    PARM_CAT_13, PARM_LEVEL_ADVANCED },
+    {"webcontrol_threads",        PARM_TYP_INT,    PARM_CAT_13, PARM_LEVEL_ADVANCED },
     {"webcontrol_base_path",      PARM_TYP_STRING, PARM_CAT_13, PARM_LEVEL_ADVANCED },
     {"webcontrol_ipv6",           PARM_TYP_BOOL,   PARM_CAT_13, PARM_LEVEL_ADVANCED },
     {"webcontrol_localhost",      PARM_TYP_BOOL,   PARM_CAT_13, PARM_LEVEL_ADVANCED },
@@ -177,6 +181,7 @@ ctx_parm config_parms[] = {
     {"stream_preview_method",     PARM_TYP_LIST,   PARM_CAT_14, PARM_LEVEL_LIMITED },
     {"stream_preview_ptz",        PARM_TYP_BOOL,   PARM_CAT_14, PARM_LEVEL_LIMITED },
     {"stream_quality",            PARM_TYP_INT,    PARM_CAT_14, PARM_LEVEL_LIMITED },
+    {"stream_ladder",             PARM_TYP_STRING, PARM_CAT_14, PARM_LEVEL_LIMITED },
     {"stream_grey",               PARM_TYP_BOOL,   PARM_CAT_14, PARM_LEVEL_LIMITED },
     {"stream_motion",             PARM_TYP_BOOL,   PARM_CAT_14, PARM_LEVEL_LIMITED },
     {"stream_maxrate",            PARM_TYP_INT,    PARM_CAT_14, PARM_LEVEL_LIMITED },
@@ -1476,6 +1481,27 @@ void cls_config::edit_smart_mask_speed(std::string &parm, enum PARM_ACT pact)
     MOTPLS_LOG(DBG, TYPE_ALL, NO_ERRNO,"%s:%s","smart_mask_speed",_("smart_mask_speed"));
 }
 
+void cls_config::edit_background_model(std::string &parm, enum PARM_ACT pact)
+{
+    if (pact == PARM_ACT_DFLT) {
+        background_model = "reference";
+    } else if (pact == PARM_ACT_SET) {
+        if ((parm == "reference") || (parm == "gaussian")) {
+            background_model = parm;
+        } else if (parm == "") {
+            background_model = "reference";
+        } else {
+          MOTPLS_LOG(NTC, TYPE_ALL, NO_ERRNO, _("Invalid background_model %s"), parm.c_str());
+        }
+    } else if (pact == PARM_ACT_GET) {
+        parm = background_model;
+    } else if (pact == PARM_ACT_LIST) {
+        parm = "[\"reference\",\"gaussian\"]";
+    }
+    return;
+    MOTPLS_LOG(DBG, TYPE_ALL, NO_ERRNO,"%s:%s","background_model",_("background_model"));
+}
+
 void cls_config::edit_lightswitch_percent(std::string &parm, enum PARM_ACT pact)
 {
     int parm_in;
@@ -1552,6 +1578,25 @@ void cls_config::edit_static_object_time(std::string &parm, enum PARM_ACT pact)
     MOTPLS_LOG(DBG, TYPE_ALL, NO_ERRNO,"%s:%s","static_object_time",_("static_object_time"));
 }
 
+void cls_config::edit_reference_weight(std::string &parm, enum PARM_ACT pact)
+{
+    int parm_in;
+    if (pact == PARM_ACT_DFLT) {
+        reference_weight = 50;
+    } else if (pact == PARM_ACT_SET) {
+        parm_in = atoi(parm.c_str());
+        if ((parm_in < 1) || (parm_in > 100)) {
+            MOTPLS_LOG(NTC, TYPE_ALL, NO_ERRNO, _("Invalid reference_weight %d"),parm_in);
+        } else {
+            reference_weight = parm_in;
+        }
+    } else if (pact == PARM_ACT_GET) {
+        parm = std::to_string(reference_weight);
+    }
+    return;
+    MOTPLS_LOG(DBG, TYPE_ALL, NO_ERRNO,"%s:%s","reference_weight",_("reference_weight"));
+}
+
 void cls_config::edit_event_gap(std::string &parm, enum PARM_ACT pact)
 {
     int parm_in;
@@ -1609,6 +1654,25 @@ void cls_config::edit_post_capture(std::string &parm, enum PARM_ACT pact)
     MOTPLS_LOG(DBG, TYPE_ALL, NO_ERRNO,"%s:%s","post_capture",_("post_capture"));
 }
 
+void cls_config::edit_detect_threads(std::string &parm, enum PARM_ACT pact)
+{
+    int parm_in;
+    if (pact == PARM_ACT_DFLT) {
+        detect_threads = 1;
+    } else if (pact == PARM_ACT_SET) {
+        parm_in = atoi(parm.c_str());
+        if ((parm_in < 1) || (parm_in > 32)) {
+            MOTPLS_LOG(NTC, TYPE_ALL, NO_ERRNO, _("Invalid detect_threads %d"),parm_in);
+        } else {
+            detect_threads = parm_in;
+        }
+    } else if (pact == PARM_ACT_GET) {
+        parm = std::to_string(detect_threads);
+    }
+    return;
+    MOTPLS_LOG(DBG, TYPE_ALL, NO_ERRNO,"%s:%s","detect_threads",_("detect_threads"));
+}
+
 void cls_config::edit_on_event_start(std::string &parm, enum PARM_ACT pact)
 {
     if (pact == PARM_ACT_DFLT) {
@@ -2289,6 +2353,25 @@ void cls_config::edit_webcontrol_port2(std::string &parm, enum PARM_ACT pact)
     MOTPLS_LOG(DBG, TYPE_ALL, NO_ERRNO,"%s:%s","webcontrol_port2",_("webcontrol_port2"));
 }
 
+void cls_config::edit_webcontrol_threads(std::string &parm, enum PARM_ACT pact)
+{
+    int parm_in;
+    if (pact == PARM_ACT_DFLT) {
+        webcontrol_threads = 0;
+    } else if (pact == PARM_ACT_SET) {
+        parm_in = atoi(parm.c_str());
+        if ((parm_in < 0) || (parm_in > 256)) {
+            MOTPLS_LOG(NTC, TYPE_ALL, NO_ERRNO, _("Invalid webcontrol_threads %d"),parm_in);
+        } else {
+            webcontrol_threads = parm_in;
+        }
+    } else if (pact == PARM_ACT_GET) {
+        parm = std::to_string(webcontrol_threads);
+    }
+    return;
+    MOTPLS_LOG(DBG, TYPE_ALL, NO_ERRNO,"%s:%s","webcontrol_threads",_("webcontrol_threads"));
+}
+
 void cls_config::edit_webcontrol_base_path(std::string &parm, enum PARM_ACT pact)
 {
     if (pact == PARM_ACT_DFLT) {
@@ -2653,6 +2736,19 @@ void cls_config::edit_stream_quality(std::string &parm, enum PARM_ACT pact)
     MOTPLS_LOG(DBG, TYPE_ALL, NO_ERRNO,"%s:%s","stream_quality",_("stream_quality"));
 }
 
+void cls_config::edit_stream_ladder(std::string &parm, enum PARM_ACT pact)
+{
+    if (pact == PARM_ACT_DFLT) {
+        stream_ladder = "";
+    } else if (pact == PARM_ACT_SET) {
+        stream_ladder = parm;
+    } else if (pact == PARM_ACT_GET) {
+        parm = stream_ladder;
+    }
+    return;
+    MOTPLS_LOG(DBG, TYPE_ALL, NO_ERRNO,"%s:%s","stream_ladder",_("stream_ladder"));
+}
+
 void cls_config::edit_stream_grey(std::string &parm, enum PARM_ACT pact)
 {
     if (pact == PARM_ACT_DFLT) {
@@ -3233,6 +3329,7 @@ void cls_config::edit_cat06(std::string parm_nm, std::string &parm_val, enum PAR
     } else if (parm_nm == "mask_file") {               edit_mask_file(parm_val, pact);
     } else if (parm_nm == "mask_privacy") {            edit_mask_privacy(parm_val, pact);
     } else if (parm_nm == "smart_mask_speed") {        edit_smart_mask_speed(parm_val, pact);
+    } else if (parm_nm == "background_model") {        edit_background_model(parm_val, pact);
     }
 
 }
@@ -3243,9 +3340,11 @@ void cls_config::edit_cat07(std::string parm_nm, std::string &parm_val, enum PAR
     } else if (parm_nm == "lightswitch_frames") {      edit_lightswitch_frames(parm_val, pact);
     } else if (parm_nm == "minimum_motion_frames") {   edit_minimum_motion_frames(parm_val, pact);
     } else if (parm_nm == "static_object_time") {      edit_static_object_time(parm_val, pact);
+    } else if (parm_nm == "reference_weight") {        edit_reference_weight(parm_val, pact);
     } else if (parm_nm == "event_gap") {               edit_event_gap(parm_val, pact);
     } else if (parm_nm == "pre_capture") {             edit_pre_capture(parm_val, pact);
     } else if (parm_nm == "post_capture") {            edit_post_capture(parm_val, pact);
+    } else if (parm_nm == "detect_threads") {          edit_detect_threads(parm_val, pact);
     }
 
 }
@@ -3322,6 +3421,7 @@ void cls_config::edit_cat13(std::string parm_nm, std::string &parm_val, enum PAR
 {
     if (parm_nm == "webcontrol_port") {                    edit_webcontrol_port(parm_val, pact);
     } else if (parm_nm == "webcontrol_port2") {            edit_webcontrol_port2(parm_val, pact);
+    } else if (parm_nm == "webcontrol_threads") {          edit_webcontrol_threads(parm_val, pact);
     } else if (parm_nm == "webcontrol_base_path") {        edit_webcontrol_base_path(parm_val, pact);
     } else if (parm_nm == "webcontrol_ipv6") {             edit_webcontrol_ipv6(parm_val, pact);
     } else if (parm_nm == "webcontrol_localhost") {        edit_webcontrol_localhost(parm_val, pact);
@@ -3350,6 +3450,7 @@ void cls_config::edit_cat14(std::string parm_nm, std::string &parm_val, enum PAR
     } else if (parm_nm == "stream_preview_method") {       edit_stream_preview_method(parm_val, pact);
     } else if (parm_nm == "stream_preview_ptz") {          edit_stream_preview_ptz(parm_val, pact);
     } else if (parm_nm == "stream_quality") {              edit_stream_quality(parm_val, pact);
+    } else if (parm_nm == "stream_ladder") {               edit_stream_ladder(parm_val, pact);
     } else if (parm_nm == "stream_grey") {                 edit_stream_grey(parm_val, pact);
     } else if (parm_nm == "stream_motion") {               edit_stream_motion(parm_val, pact);
     } else if (parm_nm == "stream_maxrate") {              edit_stream_maxrate(parm_val, pact);
@@ -160,13 +160,16 @@
             std::string     mask_file;
             std::string     mask_privacy;
             int             smart_mask_speed;
+            std::string     background_model;
             int             lightswitch_percent;
             int             lightswitch_frames;
             int             minimum_motion_frames;
             int             static_object_time;
+            int             reference_weight;
             int             event_gap;
             int             pre_capture;
             int             post_capture;
+            int             detect_threads;
 
             /* Script execution configuration parameters */
             std::string     on_event_start;
@@ -221,6 +224,7 @@
             /* Webcontrol configuration parameters */
             int             webcontrol_port;
             int             webcontrol_port2;
+            int             webcontrol_threads;
             std::string     webcontrol_base_path;
             bool            webcontrol_ipv6;
             bool            webcontrol_localhost;
@@ -245,6 +249,7 @@
             std::string     stream_preview_method;
             bool            stream_preview_ptz;
             int             stream_quality;
+            std::string     stream_ladder;
             bool            stream_grey;
             bool            stream_motion;
             int             stream_maxrate;
@@ -410,14 +415,17 @@
             void edit_mask_file(std::string &parm, enum PARM_ACT pact);
             void edit_mask_privacy(std::string &parm, enum PARM_ACT pact);
             void edit_smart_mask_speed(std::string &parm, enum PARM_ACT pact);
+            void edit_background_model(std::string &parm, enum PARM_ACT pact);
 
             void edit_lightswitch_frames(std::string &parm, enum PARM_ACT pact);
             void edit_lightswitch_percent(std::string &parm, enum PARM_ACT pact);
             void edit_minimum_motion_frames(std::string &parm, enum PARM_ACT pact);
             void edit_event_gap(std::string &parm, enum PARM_ACT pact);
             void edit_static_object_time(std::string &parm, enum PARM_ACT pact);
+            void edit_reference_weight(std::string &parm, enum PARM_ACT pact);
             void edit_post_capture(std::string &parm, enum PARM_ACT pact);
             void edit_pre_capture(std::string &parm, enum PARM_ACT pact);
+            void edit_detect_threads(std::string &parm, enum PARM_ACT pact);
 
             void edit_on_action_user(std::string &parm, enum PARM_ACT pact);
             void edit_on_area_detected(std::string &parm, enum PARM_ACT pact);
@@ -479,6 +487,7 @@
             void edit_webcontrol_parms(std::string &parm, enum PARM_ACT pact);
             void edit_webcontrol_port(std::string &parm, enum PARM_ACT pact);
             void edit_webcontrol_port2(std::string &parm, enum PARM_ACT pact);
+            void edit_webcontrol_threads(std::string &parm, enum PARM_ACT pact);
             void edit_webcontrol_tls(std::string &parm, enum PARM_ACT pact);
 
             void edit_stream_grey(std::string &parm, enum PARM_ACT pact);
@@ -490,6 +499,7 @@
             void edit_stream_preview_ptz(std::string &parm, enum PARM_ACT pact);
             void edit_stream_preview_scale(std::string &parm, enum PARM_ACT pact);
             void edit_stream_quality(std::string &parm, enum PARM_ACT pact);
+            void edit_stream_ladder(std::string &parm, enum PARM_ACT pact);
             void edit_stream_scan_scale(std::string &parm, enum PARM_ACT pact);
             void edit_stream_scan_time(std::string &parm, enum PARM_ACT pact);
 
@@ -21,6 +21,7 @@
 #include "camera.hpp"
 #include "conf.hpp"
 #include "logger.hpp"
+#include "alg_simd.hpp"
 #include "alg.hpp"
 #include "draw.hpp"
 
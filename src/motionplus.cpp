@@ -29,6 +29,9 @@
 #include "video_v4l2.hpp"
 #include "movie.hpp"
 #include "netcam.hpp"
+#include "alg_simd.hpp"
+#include "workpool.hpp"
+#include "resize.hpp"
 
 volatile enum MOTPLS_SIGNAL motsignal;
 
@@ -359,6 +362,8 @@ void cls_motapp::ntc()
         MOTPLS_LOG(DBG, TYPE_ALL, NO_ERRNO,_("fftw3  : not available"));
     #endif
 
+    MOTPLS_LOG(NTC, TYPE_ALL, NO_ERRNO,_("simd   : %s"), simd_name());
+
 }
 
 /* Check for whether any cams are locked */
@@ -389,14 +394,12 @@ void cls_motapp::watchdog(uint camindx)
 
         if ((cam_list[indx]->camera_type == CAMERA_TYPE_NETCAM) &&
             (cam_list[indx]->netcam != nullptr)) {
-            pthread_mutex_unlock(&cam_list[indx]->netcam->mutex);
             pthread_mutex_unlock(&cam_list[indx]->netcam->mutex_pktarray);
             pthread_mutex_unlock(&cam_list[indx]->netcam->mutex_transfer);
             cam_list[indx]->netcam->handler_stop = true;
         }
         if ((cam_list[indx]->camera_type == CAMERA_TYPE_NETCAM) &&
             (cam_list[indx]->netcam_high != nullptr)) {
-            pthread_mutex_unlock(&cam_list[indx]->netcam_high->mutex);
             pthread_mutex_unlock(&cam_list[indx]->netcam_high->mutex_pktarray);
             pthread_mutex_unlock(&cam_list[indx]->netcam_high->mutex_transfer);
             cam_list[indx]->netcam_high->handler_stop = true;
@@ -510,12 +513,15 @@ void cls_motapp::init(int p_argc, char *p_argv[])
     cam_delete = -1;
     cam_cnt = 0;
     snd_cnt = 0;
+    decode_threads = 0;
     conf_src = nullptr;
     cfg = nullptr;
     dbse = nullptr;
     webu = nullptr;
     allcam = nullptr;
     schedule = nullptr;
+    workpool = nullptr;
+    resize = nullptr;
 
     pthread_mutex_init(&mutex_camlst, NULL);
     pthread_mutex_init(&mutex_post, NULL);
@@ -541,12 +547,16 @@ void cls_motapp::init(int p_argc, char *p_argv[])
 
     pid_write();
 
+    simd_init();
+
     ntc();
 
     av_init();
 
     dbse = new cls_dbse(this);
     webu = new cls_webu(this);
+    workpool = new cls_workpool(this);
+    resize = new cls_resize(this);
     allcam = new cls_allcam(this);
     schedule = new cls_schedule(this);
 
@@ -588,6 +598,9 @@ void cls_motapp::deinit()
         mydelete(snd_list[indx]);
     }
 
+    mydelete(workpool);
+    mydelete(resize);
+
     pthread_mutex_destroy(&mutex_camlst);
     pthread_mutex_destroy(&mutex_post);
 
@@ -56,6 +56,7 @@
 #include <arpa/inet.h>
 #include <sys/socket.h>
 #include <thread>
+#include <atomic>
 #include "zlib.h"
 
 #if defined(HAVE_PTHREAD_NP_H)
@@ -102,6 +103,7 @@ class cls_log;
 class cls_movie;
 class cls_netcam;
 class cls_picture;
+class cls_resize;
 class cls_rotate;
 class cls_v4l2cam;
 class cls_convert;
@@ -111,10 +113,15 @@ class cls_webu_ans;
 class cls_webu_file;
 class cls_webu_html;
 class cls_webu_json;
+class cls_webu_mp4;
 class cls_webu_mpegts;
+class cls_webu_tsenc;
 class cls_webu_post;
 class cls_webu_common;
 class cls_webu_stream;
+class cls_workpool;
+
+#define STREAM_LADDER_MAX   4   /* Rungs of lower resolution for the mjpeg stream */
 
 enum MOTPLS_SIGNAL {
     MOTPLS_SIGNAL_NONE,
@@ -154,23 +161,60 @@ struct ctx_all_sizes {
     bool    reset;
 };
 
+/*
+ * A jpg of a stream with the header and terminator of a mjpeg part.  It is
+ * not changed once published so all the mjpeg connections send the same
+ * one.  The refcnt is changed with the mutex of the stream locked.
+ */
+struct ctx_stream_jpg {
+    u_char  *buf;       /* Part header, jpg and terminator */
+    size_t  buf_sz;     /* Allocated size of buf */
+    size_t  part_sz;    /* Bytes of buf in use */
+    int     refcnt;     /* The stream and each connection sending it */
+};
+
 struct ctx_stream_data {
     u_char  *jpg_data;  /* Image compressed as JPG */
     int     jpg_sz;     /* The number of bytes for jpg */
     int     consumed;   /* Bool for whether the jpeg data was consumed*/
     u_char  *img_data;  /* The base data used for image */
+    int64_t img_nbr;    /* Counter of the updates of img_data */
+    ctx_stream_jpg  *jpg_part;  /* Latest jpg as a mjpeg part */
+    ctx_stream_jpg  *jpg_spare; /* Released part kept for the next one */
+    cls_webu_tsenc  *ts_enc;    /* Encoder shared by the mpegts connections */
     int     jpg_cnct;   /* Counter of the number of jpg connections*/
     int     ts_cnct;    /* Counter of the number of mpegts connections */
     int     all_cnct;   /* Counter of the number of all camera connections */
 };
 
+/*
+ * A lower resolution and quality of the normal mjpeg stream.  The image is
+ * scaled and compressed into img and jpg outside of the stream mutex and
+ * jpg is then swapped with the jpg_data of the ladder stream.
+ */
+struct ctx_stream_rung {
+    int     width;
+    int     height;
+    int     quality;
+    int     img_sz;     /* Bytes of img and of jpg */
+    u_char  *img;       /* Scaled image */
+    u_char  *jpg;       /* Image compressed as JPG */
+};
+
 struct ctx_stream {
     pthread_mutex_t  mutex;
+    pthread_cond_t   cond_pub;   /* Broadcast when new images are published */
+    int64_t          pub_nbr;    /* Count of the images published */
+    cls_webu_stream  *pub_wait;  /* Suspended connections waiting for new images */
+    int64_t          dev_nbr;    /* Changed each time the camera closes its device */
     ctx_stream_data  norm;       /* Copy of the image to use for web stream*/
     ctx_stream_data  sub;        /* Copy of the image to use for web stream*/
     ctx_stream_data  motion;     /* Copy of the image to use for web stream*/
     ctx_stream_data  source;     /* Copy of the image to use for web stream*/
     ctx_stream_data  secondary;  /* Copy of the image to use for web stream*/
+    ctx_stream_data  ladder[STREAM_LADDER_MAX];  /* Lower rungs of the norm stream */
+    ctx_stream_rung  rung[STREAM_LADDER_MAX];
+    int              rung_cnt;   /* Rungs set up from stream_ladder */
 };
 
 class cls_motapp {
@@ -186,6 +230,7 @@ class cls_motapp {
         int     cam_delete;
         int     cam_cnt;
         int     snd_cnt;
+        std::atomic<int>    decode_threads;     /* Netcam decoder threads of all cameras */
 
         int     argc;
         char    **argv;
@@ -197,6 +242,8 @@ class cls_motapp {
         cls_dbse            *dbse;
         cls_allcam          *allcam;
         cls_schedule        *schedule;
+        cls_workpool        *workpool;
+        cls_resize          *resize;
 
         pthread_mutex_t     mutex_camlst;       /* Lock the list of cams while adding/removing */
         pthread_mutex_t     mutex_post;         /* mutex to allow for processing of post actions*/
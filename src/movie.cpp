@@ -739,17 +739,12 @@ int cls_movie::put_frame(const struct timespec *ts1)
 
 }
 
-/* Reset the written flag and movie start time at opening of each event */
+/* Reset the last packet written and the start times at opening of each event */
 void cls_movie::passthru_reset()
 {
-    int indx;
-
-    pthread_mutex_lock(&netcam_data->mutex_pktarray);
-        for(indx = 0; indx < netcam_data->pktarray_size; indx++) {
-            netcam_data->pktarray[indx].iswritten = false;
-        }
-    pthread_mutex_unlock(&netcam_data->mutex_pktarray);
-
+    pass_idnbr_last = 0;
+    pass_audio_base = AV_NOPTS_VALUE;
+    pass_video_base = AV_NOPTS_VALUE;
 }
 
 int cls_movie::passthru_pktpts()
@@ -759,6 +754,15 @@ int cls_movie::passthru_pktpts()
     int indx;
 
     if (pkt->stream_index == netcam_data->audio_stream_index) {
+        /* Audio starts from the first of its packets in the movie */
+        if (pass_audio_base == AV_NOPTS_VALUE) {
+            if ((pkt->dts != AV_NOPTS_VALUE) &&
+                ((pkt->pts == AV_NOPTS_VALUE) || (pkt->dts < pkt->pts))) {
+                pass_audio_base = pkt->dts;
+            } else {
+                pass_audio_base = pkt->pts;
+            }
+        }
         tmpbase = strm_audio->time_base;
         indx = netcam_data->audio_stream_index;
         base_pdts = pass_audio_base;
@@ -824,7 +828,6 @@ void cls_movie::passthru_write(int indx)
     int retcd;
 
     pkt = mypacket_alloc(pkt);
-    netcam_data->pktarray[indx].iswritten = true;
 
     retcd = av_packet_ref(pkt, netcam_data->pktarray[indx].packet);
     if (retcd < 0) {
@@ -851,65 +854,17 @@ void cls_movie::passthru_write(int indx)
 
 }
 
-void cls_movie::passthru_minpts()
-{
-    int indx, indx_audio, indx_video;
-
-    pass_audio_base = 0;
-    pass_video_base = 0;
-
-    pthread_mutex_lock(&netcam_data->mutex_pktarray);
-        indx_audio =  netcam_data->audio_stream_index;
-        indx_video =  netcam_data->video_stream_index;
-
-        for (indx = 0; indx < netcam_data->pktarray_size; indx++) {
-            if ((netcam_data->pktarray[indx].packet->stream_index == indx_audio) &&
-                (netcam_data->pktarray[indx].packet->pts != AV_NOPTS_VALUE)) {
-                pass_audio_base = netcam_data->pktarray[indx].packet->pts;
-            }
-            if ((netcam_data->pktarray[indx].packet->stream_index == indx_video) &&
-                (netcam_data->pktarray[indx].packet->pts != AV_NOPTS_VALUE)) {
-                pass_video_base = netcam_data->pktarray[indx].packet->pts;
-            }
-        }
-        for (indx = 0; indx < netcam_data->pktarray_size; indx++) {
-            if ((netcam_data->pktarray[indx].packet->stream_index == indx_audio) &&
-                (netcam_data->pktarray[indx].packet->pts != AV_NOPTS_VALUE) &&
-                (netcam_data->pktarray[indx].packet->pts < pass_audio_base)) {
-                pass_audio_base = netcam_data->pktarray[indx].packet->pts;
-            }
-            if ((netcam_data->pktarray[indx].packet->stream_index == indx_audio) &&
-                (netcam_data->pktarray[indx].packet->dts != AV_NOPTS_VALUE) &&
-                (netcam_data->pktarray[indx].packet->dts < pass_audio_base)) {
-                pass_audio_base = netcam_data->pktarray[indx].packet->dts;
-            }
-            if ((netcam_data->pktarray[indx].packet->stream_index == indx_video) &&
-                (netcam_data->pktarray[indx].packet->pts != AV_NOPTS_VALUE) &&
-                (netcam_data->pktarray[indx].packet->pts < pass_video_base)) {
-                pass_video_base = netcam_data->pktarray[indx].packet->pts;
-            }
-            if ((netcam_data->pktarray[indx].packet->stream_index == indx_video) &&
-                (netcam_data->pktarray[indx].packet->dts != AV_NOPTS_VALUE) &&
-                (netcam_data->pktarray[indx].packet->dts < pass_video_base)) {
-                pass_video_base = netcam_data->pktarray[indx].packet->dts;
-            }
-        }
-    pthread_mutex_unlock(&netcam_data->mutex_pktarray);
-
-    if (pass_audio_base < 0) {
-         pass_audio_base = 0;
-    }
-
-    if (pass_video_base < 0) {
-        pass_video_base = 0;
-    }
-
-}
-
+/*
+ * Write the packets up to the one for the image.  The movie starts from
+ * the newest keyframe at or before the first image which the netcam
+ * keeps in an index along with its time stamp so nothing is searched.
+ * If the packets after the last one written have been replaced in the
+ * ring, the movie skips ahead to the next keyframe.
+ */
 int cls_movie::passthru_put(ctx_image_data *img_data)
 {
-    int64_t idnbr_image, idnbr_lastwritten, idnbr_stop, idnbr_firstkey;
-    int indx, indx_lastwritten, indx_firstkey, indx_video;
+    int64_t idnbr_image, key_pdts;
+    int indx, indx_image;
 
     if (netcam_data == nullptr) {
         return -1;
@@ -926,55 +881,41 @@ int cls_movie::passthru_put(ctx_image_data *img_data)
         idnbr_image = img_data->idnbr_norm;
     }
 
-    pthread_mutex_lock(&netcam_data->mutex_pktarray);
-        idnbr_lastwritten = 0;
-        idnbr_firstkey = idnbr_image;
-        idnbr_stop = 0;
-        indx_lastwritten = -1;
-        indx_firstkey = -1;
-        indx_video = netcam_data->video_stream_index;
-
-        for(indx = 0; indx < netcam_data->pktarray_size; indx++) {
-            if ((netcam_data->pktarray[indx].iswritten) &&
-                (netcam_data->pktarray[indx].idnbr > idnbr_lastwritten) &&
-                (netcam_data->pktarray[indx].packet->stream_index == indx_video)) {
-                idnbr_lastwritten=netcam_data->pktarray[indx].idnbr;
-                indx_lastwritten = indx;
-            }
-            if ((netcam_data->pktarray[indx].idnbr >  idnbr_stop) &&
-                (netcam_data->pktarray[indx].idnbr <= idnbr_image)&&
-                (netcam_data->pktarray[indx].packet->stream_index == indx_video)) {
-                idnbr_stop=netcam_data->pktarray[indx].idnbr;
-            }
-            if ((netcam_data->pktarray[indx].iskey) &&
-                (netcam_data->pktarray[indx].idnbr <= idnbr_firstkey)&&
-                (netcam_data->pktarray[indx].packet->stream_index == indx_video)) {
-                    idnbr_firstkey=netcam_data->pktarray[indx].idnbr;
-                    indx_firstkey = indx;
-            }
-        }
+    if (idnbr_image == pass_idnbr_last) {
+        return 0;
+    }
 
-        if (idnbr_stop == 0) {
+    pthread_mutex_lock(&netcam_data->mutex_pktarray);
+        indx_image = netcam_data->pktarray_find(idnbr_image);
+        if (indx_image == -1) {
             pthread_mutex_unlock(&netcam_data->mutex_pktarray);
             return 0;
         }
 
-        if (indx_lastwritten != -1) {
-            indx = indx_lastwritten;
-        } else if (indx_firstkey != -1) {
-            indx = indx_firstkey;
-        } else {
-            indx = 0;
+        indx = -1;
+        if (pass_idnbr_last != 0) {
+            indx = netcam_data->pktarray_find(pass_idnbr_last + 1);
+        }
+        if (indx == -1) {
+            indx = netcam_data->pktarray_key(idnbr_image, &key_pdts);
+            if (indx == -1) {
+                pthread_mutex_unlock(&netcam_data->mutex_pktarray);
+                return 0;
+            }
+            if (pass_idnbr_last == 0) {
+                pass_video_base = key_pdts;
+            } else {
+                MOTPLS_LOG(NTC, TYPE_ENCODER, NO_ERRNO
+                    ,_("Pass-through packets lost.  Skipping to next keyframe."));
+            }
         }
 
-        while (true){
-            if ((!netcam_data->pktarray[indx].iswritten) &&
-                (netcam_data->pktarray[indx].packet->size > 0) &&
-                (netcam_data->pktarray[indx].idnbr >  idnbr_lastwritten) &&
-                (netcam_data->pktarray[indx].idnbr <= idnbr_image)) {
+        while (true) {
+            if (netcam_data->pktarray[indx].packet->size > 0) {
                 passthru_write(indx);
             }
-            if (netcam_data->pktarray[indx].idnbr == idnbr_stop) {
+            pass_idnbr_last = netcam_data->pktarray[indx].idnbr;
+            if (indx == indx_image) {
                 break;
             }
             indx++;
@@ -1120,8 +1061,6 @@ int cls_movie::passthru_open()
         container = "mp4";
     }
 
-    passthru_minpts();
-
     retcd = get_oformat();
     if (retcd < 0 ) {
         MOTPLS_LOG(ERR, TYPE_ENCODER, NO_ERRNO, _("Could not get output format!"));
@@ -1723,6 +1662,7 @@ void cls_movie::init_vars()
     base_pts = 0;
     pass_audio_base = 0;
     pass_video_base = 0;
+    pass_idnbr_last = 0;
     test_mode = false;
     gop_cnt = 5;
     start_time.tv_nsec = 0;
@@ -73,7 +73,6 @@ class cls_movie {
         void passthru_reset();
         int passthru_pktpts();
         void passthru_write(int indx);
-        void passthru_minpts();
         int passthru_put(ctx_image_data *img_data);
         int passthru_streams_video(AVStream *stream_in);
         int passthru_streams_audio(AVStream *stream_in);
@@ -106,6 +105,7 @@ class cls_movie {
         int64_t             base_pts;
         int64_t             pass_audio_base;
         int64_t             pass_video_base;
+        int64_t             pass_idnbr_last;    /* Last packet written for pass-through */
         bool                test_mode;
         int                 gop_cnt;
         struct timespec     start_time;
@@ -372,19 +372,18 @@ void cls_netcam::pktarray_free()
 void cls_netcam::context_null()
 {
     swsctx          = nullptr;
-    swsframe_in     = nullptr;
     swsframe_out    = nullptr;
     frame           = nullptr;
     codec_context   = nullptr;
     format_context  = nullptr;
     transfer_format = nullptr;
     hw_device_ctx   = nullptr;
+    decode_thread_cnt = 0;
 }
 
 void cls_netcam::context_close()
 {
     if (swsctx          != nullptr) sws_freeContext(swsctx);
-    if (swsframe_in     != nullptr) av_frame_free(&swsframe_in);
     if (swsframe_out    != nullptr) av_frame_free(&swsframe_out);
     if (frame           != nullptr) av_frame_free(&frame);
     if (pktarray        != nullptr) pktarray_free();
@@ -392,104 +391,99 @@ void cls_netcam::context_close()
     if (format_context  != nullptr) avformat_close_input(&format_context);
     if (transfer_format != nullptr) avformat_close_input(&transfer_format);
     if (hw_device_ctx   != nullptr) av_buffer_unref(&hw_device_ctx);
+    cam->app->decode_threads -= decode_thread_cnt;
     context_null();
 }
 
-void cls_netcam::pktarray_resize()
+/*
+ * Allocate the packet ring once for the connection.  The handler thread
+ * adds packets to it while the movie writes the ones for the images
+ * leaving the camera ring so it is sized to hold the packets for the
+ * duration of the camera ring plus passthrough_secs of older packets
+ * which keeps the keyframe that the images in the ring start from.
+ * The ring never grows so its memory is bounded by its duration and the
+ * bit rate of the streams.
+ */
+void cls_netcam::pktarray_init()
 {
-    /* This is called from next and is on the motion loop thread
-     * The mutex is locked around the call to this function.
-    */
-
-    /* Remember that this is a ring and we have two threads chasing around it
-     * the ffmpeg is writing out of this ring while we are filling it up.  "Bad"
-     * things will occur if the "add" thread catches up with the "write" thread.
-     * We need this ring to be big enough so they don't collide.
-     * The alternative is that we'd need to make a copy of the entire packet
-     * array in the ffmpeg module and do our writing from that copy.  The
-     * downside is that is a lot to be copying around for each image we want
-     * to write out.  And putting a mutex on the array during adding function would
-     * slow down the capture thread to the speed of the writing thread.  And that
-     * writing thread operates at the user specified FPS which could be really slow
-     * ...So....make this array big enough so we never catch our tail.  :)
-     */
-
-    int64_t         idnbr_last, idnbr_first;
-    int             indx;
-    ctx_packet_item *tmp;
-    int             newsize;
-
-    if (high_resolution) {
-        idnbr_last = cam->imgs.image_ring[cam->imgs.ring_out].idnbr_high;
-        idnbr_first = cam->imgs.image_ring[cam->imgs.ring_in].idnbr_high;
+    int indx, newsize, secs, pkt_rate;
+    AVStream *stream;
+    AVCodecParameters *codecpar;
+
+    stream = format_context->streams[video_stream_index];
+    if ((stream->avg_frame_rate.num > 0) && (stream->avg_frame_rate.den > 0)) {
+        pkt_rate = (int)((stream->avg_frame_rate.num +
+            stream->avg_frame_rate.den - 1) / stream->avg_frame_rate.den);
     } else {
-        idnbr_last = cam->imgs.image_ring[cam->imgs.ring_out].idnbr_norm;
-        idnbr_first = cam->imgs.image_ring[cam->imgs.ring_in].idnbr_norm;
+        pkt_rate = MAX(capture_rate, cam->cfg->framerate);
     }
 
-    if (!passthrough) {
-        return;
+    if (audio_stream_index != -1) {
+        codecpar = format_context->streams[audio_stream_index]->codecpar;
+        if ((codecpar->sample_rate > 0) && (codecpar->frame_size > 0)) {
+            pkt_rate += (codecpar->sample_rate + codecpar->frame_size - 1) /
+                codecpar->frame_size;
+        } else {
+            pkt_rate += 50;
+        }
     }
 
-    /* The 30 is arbitrary */
-    /* Double the size plus double last diff so we don't catch our tail */
-    newsize =(int)(((idnbr_first - idnbr_last) * 1 ) +
-        ((idnbr - idnbr_last ) * 2));
-    if (newsize < 30) {
-        newsize = 30;
-    }
+    secs = ((cam->cfg->pre_capture + cam->cfg->minimum_motion_frames) /
+        MAX(cam->cfg->framerate, 1)) + 1 + cfg_pktsecs;
+    newsize = MAX(pkt_rate * secs, NETCAM_PKTARRAY_MIN);
 
     pthread_mutex_lock(&mutex_pktarray);
-        if ((pktarray_size < newsize) ||  (pktarray_size < 30)) {
-            tmp =(ctx_packet_item*) mymalloc((uint)newsize * sizeof(ctx_packet_item));
-            if (pktarray_size > 0 ) {
-                memcpy(tmp, pktarray, sizeof(ctx_packet_item) * (uint)pktarray_size);
-            }
-            for(indx = pktarray_size; indx < newsize; indx++) {
-                tmp[indx].packet = nullptr;
-                tmp[indx].packet = mypacket_alloc(tmp[indx].packet);
-                tmp[indx].idnbr = 0;
-                tmp[indx].iskey = false;
-                tmp[indx].iswritten = false;
-            }
-
-            myfree(pktarray);
-            pktarray = tmp;
-            pktarray_size = newsize;
-
-            MOTPLS_LOG(INF, TYPE_NETCAM, NO_ERRNO
-                , _("%s:Resized packet array to %d")
-                , cameratype.c_str(), newsize);
+        pktarray =(ctx_packet_item*) mymalloc((uint)newsize * sizeof(ctx_packet_item));
+        for(indx = 0; indx < newsize; indx++) {
+            pktarray[indx].packet = nullptr;
+            pktarray[indx].packet = mypacket_alloc(pktarray[indx].packet);
+            pktarray[indx].idnbr = 0;
+            pktarray[indx].iskey = false;
+        }
+        pktarray_size = newsize;
+        pktarray_index = -1;
+        for(indx = 0; indx < NETCAM_KEYARRAY_CNT; indx++) {
+            keyarray[indx].idnbr = 0;
+            keyarray[indx].pdts = 0;
         }
+        keyarray_index = -1;
     pthread_mutex_unlock(&mutex_pktarray);
+
+    if (stream->codecpar->bit_rate > 0) {
+        MOTPLS_LOG(INF, TYPE_NETCAM, NO_ERRNO
+            , _("%s:Packet array of %d for %d seconds (about %d KB)")
+            , cameratype.c_str(), newsize, secs
+            , (int)((stream->codecpar->bit_rate / 8 / 1024) * secs));
+    } else {
+        MOTPLS_LOG(INF, TYPE_NETCAM, NO_ERRNO
+            , _("%s:Packet array of %d for %d seconds")
+            , cameratype.c_str(), newsize, secs);
+    }
 }
 
-void cls_netcam::pktarray_add()
+/*
+ * Put the packet into the oldest slot of the ring.  The slot keeps its
+ * AVPacket and only takes a new reference to the data.  The index is
+ * published once the slot is complete.
+ */
+void cls_netcam::pktarray_add(int64_t pkt_idnbr)
 {
     int indx_next;
     int retcd;
     char errstr[128];
 
-    pthread_mutex_lock(&mutex_pktarray);
-
-        if (pktarray_size == 0) {
-            pthread_mutex_unlock(&mutex_pktarray);
-            return;
-        }
-
-        /* Recall pktarray_size is one based but pktarray is zero based */
-        if (pktarray_index == (pktarray_size-1)) {
-            indx_next = 0;
-        } else {
-            indx_next = pktarray_index + 1;
-        }
-
-        pktarray[indx_next].idnbr = idnbr;
+    if (pktarray_size == 0) {
+        return;
+    }
 
-        av_packet_free(&pktarray[indx_next].packet);
-        pktarray[indx_next].packet = nullptr;
-        pktarray[indx_next].packet = mypacket_alloc(pktarray[indx_next].packet);
+    /* Recall pktarray_size is one based but pktarray is zero based */
+    indx_next = pktarray_index + 1;
+    if (indx_next == pktarray_size) {
+        indx_next = 0;
+    }
 
+    pthread_mutex_lock(&mutex_pktarray);
+        av_packet_unref(pktarray[indx_next].packet);
         retcd = av_packet_ref(pktarray[indx_next].packet, packet_recv);
         if ((interrupted) || (retcd < 0)) {
             av_strerror(retcd, errstr, sizeof(errstr));
@@ -497,21 +491,110 @@ void cls_netcam::pktarray_add()
                 ,_("%s:av_copy_packet:%s ,Interrupt:%s")
                 ,cameratype.c_str()
                 ,errstr, interrupted ? _("true"):_("false"));
-            av_packet_free(&pktarray[indx_next].packet);
-            pktarray[indx_next].packet = nullptr;
+            av_packet_unref(pktarray[indx_next].packet);
         }
 
+        pktarray[indx_next].idnbr = pkt_idnbr;
         if (pktarray[indx_next].packet->flags & AV_PKT_FLAG_KEY) {
             pktarray[indx_next].iskey = true;
         } else {
             pktarray[indx_next].iskey = false;
         }
-        pktarray[indx_next].iswritten = false;
 
+        if ((pktarray[indx_next].iskey) &&
+            (pktarray[indx_next].packet->stream_index == video_stream_index)) {
+            keyarray_add(pktarray[indx_next].packet, pkt_idnbr);
+        }
         pktarray_index = indx_next;
     pthread_mutex_unlock(&mutex_pktarray);
 }
 
+/* Add a video keyframe to the index.  Called with mutex_pktarray locked */
+void cls_netcam::keyarray_add(AVPacket *pkt, int64_t pkt_idnbr)
+{
+    int indx_next;
+
+    indx_next = keyarray_index + 1;
+    if (indx_next == NETCAM_KEYARRAY_CNT) {
+        indx_next = 0;
+    }
+
+    keyarray[indx_next].idnbr = pkt_idnbr;
+    if (pkt->pts == AV_NOPTS_VALUE) {
+        keyarray[indx_next].pdts = pkt->dts;
+    } else if ((pkt->dts != AV_NOPTS_VALUE) && (pkt->dts < pkt->pts)) {
+        keyarray[indx_next].pdts = pkt->dts;
+    } else {
+        keyarray[indx_next].pdts = pkt->pts;
+    }
+
+    keyarray_index = indx_next;
+}
+
+/*
+ * Index of the newest video keyframe at or before pkt_idnbr that is
+ * still in the ring or -1 when there is none.  pdts is set to the lower
+ * of its pts and dts which no later video packet goes below.  Called
+ * with mutex_pktarray locked.
+ */
+int cls_netcam::pktarray_key(int64_t pkt_idnbr, int64_t *pdts)
+{
+    int indx, cnt, pkt_indx;
+
+    indx = keyarray_index;
+    for (cnt = 0; (indx >= 0) && (cnt < NETCAM_KEYARRAY_CNT); cnt++) {
+        if (keyarray[indx].idnbr == 0) {
+            break;
+        }
+        if (keyarray[indx].idnbr <= pkt_idnbr) {
+            pkt_indx = pktarray_find(keyarray[indx].idnbr);
+            if (pkt_indx != -1) {
+                *pdts = keyarray[indx].pdts;
+            }
+            return pkt_indx;
+        }
+        indx--;
+        if (indx < 0) {
+            indx = NETCAM_KEYARRAY_CNT - 1;
+        }
+    }
+
+    return -1;
+}
+
+/*
+ * Index of the packet with pkt_idnbr or -1 when it is not in the ring.
+ * Every packet read goes into the ring so the numbers are consecutive
+ * and the index follows from the newest one.
+ */
+int cls_netcam::pktarray_find(int64_t pkt_idnbr)
+{
+    int indx;
+    int64_t back;
+
+    indx = pktarray_index;
+    if ((indx < 0) || (pktarray_size == 0)) {
+        return -1;
+    }
+
+    back = pktarray[indx].idnbr - pkt_idnbr;
+    if ((back < 0) || (back >= pktarray_size)) {
+        return -1;
+    }
+
+    indx -= (int)back;
+    if (indx < 0) {
+        indx += pktarray_size;
+    }
+
+    /* A slot being rewritten no longer holds the packet asked for */
+    if (pktarray[indx].idnbr != pkt_idnbr) {
+        return -1;
+    }
+
+    return indx;
+}
+
 int cls_netcam::decode_sw()
 {
     int retcd;
@@ -683,6 +766,35 @@ int cls_netcam::decode_drm()
     return 1;
 }
 
+/*
+ * While there is no event, have the decoder drop the frames named by the
+ * decode_skip param and go back to decoding all of them once one starts.
+ * Frames that were dropped for nonkey are missing from the references of
+ * the frames that follow so the full decode waits for the next keyframe.
+ */
+void cls_netcam::decode_skip()
+{
+    if (cfg_decskip == AVDISCARD_DEFAULT) {
+        return;
+    }
+
+    if ((cam->detecting_motion == false) && (cam->event_user == false)) {
+        if (codec_context->skip_frame != cfg_decskip) {
+            MOTPLS_LOG(DBG, TYPE_NETCAM, NO_ERRNO
+                ,_("%s:Skipping frames while idle"), cameratype.c_str());
+            codec_context->skip_frame = cfg_decskip;
+        }
+    } else if (codec_context->skip_frame != AVDISCARD_DEFAULT) {
+        if ((cfg_decskip == AVDISCARD_NONKEY) &&
+            ((packet_recv->flags & AV_PKT_FLAG_KEY) == 0)) {
+            return;
+        }
+        MOTPLS_LOG(DBG, TYPE_NETCAM, NO_ERRNO
+            ,_("%s:Decoding all frames"), cameratype.c_str());
+        codec_context->skip_frame = AVDISCARD_DEFAULT;
+    }
+}
+
 int cls_netcam::decode_video()
 {
     int retcd;
@@ -697,6 +809,8 @@ int cls_netcam::decode_video()
         return 0;
     }
 
+    decode_skip();
+
     retcd = avcodec_send_packet(codec_context, packet_recv);
     if ((interrupted) || (handler_stop)) {
         MOTPLS_LOG(INF, TYPE_NETCAM, NO_ERRNO
@@ -754,12 +868,26 @@ int cls_netcam::decode_packet()
     if (retcd <= 0) {
         return retcd;
     }
+
+    /*
+     * Frames that are not already the size and format of the image go
+     * through the scaling into the receive buffer.  Others are only
+     * copied out of the decoder's padded planes.
+     */
+    if ((imgsize.width  != frame->width) ||
+        (imgsize.height != frame->height) ||
+        (check_pixfmt() != 0)) {
+        if (resize() < 0) {
+            return -1;
+        }
+        return swsframe_size;
+    }
+
     frame_size = av_image_get_buffer_size(
         (enum AVPixelFormat) frame->format
         , frame->width, frame->height, 1);
 
     check_buffsize(img_recv, (uint)frame_size);
-    check_buffsize(img_latest, (uint)frame_size);
 
     retcd = av_image_copy_to_buffer(
         (uint8_t *)img_recv->ptr
@@ -1090,9 +1218,65 @@ int cls_netcam::init_swdecoder()
     codec_context->error_concealment = FF_EC_GUESS_MVS | FF_EC_DEBLOCK;
     codec_context->err_recognition = AV_EF_IGNORE_ERR;
 
+    decoder_threads();
+
     return 0;
 }
 
+/*
+ * Set the threading of the software decoder.  Unless the params give a
+ * count, the cores are split over the decoding netcam streams of all the
+ * cameras so the total decoder threads track the core count.  Slice
+ * threading adds no frames of delay so it suits latency sensitive cameras
+ * while frame threading gets more out of the cores for most codecs.
+ */
+void cls_netcam::decoder_threads()
+{
+    int indx, cpu_cnt, strm_cnt;
+    cls_camera *camitm;
+
+    cpu_cnt = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    if (cpu_cnt < 1) {
+        cpu_cnt = 1;
+    }
+
+    if (cfg_decthreads > 0) {
+        decode_thread_cnt = cfg_decthreads;
+    } else {
+        strm_cnt = 0;
+        pthread_mutex_lock(&cam->app->mutex_camlst);
+            for (indx=0; indx<cam->app->cam_cnt; indx++) {
+                camitm = cam->app->cam_list[indx];
+                if (camitm->cfg->netcam_url != "") {
+                    strm_cnt++;
+                    if ((camitm->cfg->netcam_high_url != "") &&
+                        (camitm->cfg->movie_passthrough == false)) {
+                        strm_cnt++;
+                    }
+                }
+            }
+        pthread_mutex_unlock(&cam->app->mutex_camlst);
+        decode_thread_cnt = cpu_cnt / MAX(strm_cnt, 1);
+    }
+    decode_thread_cnt = MAX(MIN(decode_thread_cnt, NETCAM_DECODE_MAX), 1);
+
+    codec_context->thread_count = decode_thread_cnt;
+    if (cfg_decthreading == "slice") {
+        codec_context->thread_type = FF_THREAD_SLICE;
+    } else if (cfg_decthreading == "frame") {
+        codec_context->thread_type = FF_THREAD_FRAME;
+    } else {
+        codec_context->thread_type = FF_THREAD_FRAME | FF_THREAD_SLICE;
+    }
+
+    cam->app->decode_threads += decode_thread_cnt;
+    if (cam->app->decode_threads > cpu_cnt) {
+        MOTPLS_LOG(NTC, TYPE_NETCAM, NO_ERRNO
+            ,_("%s:Decoder threads for all cameras %d exceed the %d cores")
+            , cameratype.c_str(), cam->app->decode_threads.load(), cpu_cnt);
+    }
+}
+
 int cls_netcam::open_codec()
 {
     int retcd;
@@ -1146,8 +1330,16 @@ int cls_netcam::open_codec()
         return -1;
     }
 
-    MOTPLS_LOG(INF, TYPE_NETCAM, NO_ERRNO
-        ,_("%s:Decoder opened"),cameratype.c_str());
+    if (decode_thread_cnt > 0) {
+        MOTPLS_LOG(INF, TYPE_NETCAM, NO_ERRNO
+            ,_("%s:Decoder opened with %d %s threads")
+            , cameratype.c_str(), codec_context->thread_count
+            , (codec_context->active_thread_type == FF_THREAD_SLICE)
+                ? "slice" : "frame");
+    } else {
+        MOTPLS_LOG(INF, TYPE_NETCAM, NO_ERRNO
+            ,_("%s:Decoder opened"),cameratype.c_str());
+    }
 
     return 0;
 }
@@ -1158,17 +1350,6 @@ int cls_netcam::open_sws()
         return -1;
     }
 
-    swsframe_in = av_frame_alloc();
-    if (swsframe_in == nullptr) {
-        if (status == NETCAM_NOTCONNECTED) {
-            MOTPLS_LOG(ERR, TYPE_NETCAM, NO_ERRNO
-                , _("%s:Unable to allocate swsframe_in.")
-                , cameratype.c_str());
-        }
-        context_close();
-        return -1;
-    }
-
     swsframe_out = av_frame_alloc();
     if (swsframe_out == nullptr) {
         if (status == NETCAM_NOTCONNECTED) {
@@ -1222,18 +1403,14 @@ int cls_netcam::open_sws()
         return -1;
     }
 
-    /* the image buffers must be big enough to hold the final frame after resizing */
-    check_buffsize(img_recv, (uint)swsframe_size);
-    check_buffsize(img_latest, (uint)swsframe_size);
-
     return 0;
 }
 
+/* Scale and convert the decoded frame straight into the receive buffer */
 int cls_netcam::resize()
 {
     int      retcd;
     char     errstr[128];
-    uint8_t *buffer_out;
 
     if (handler_stop) {
         return -1;
@@ -1244,29 +1421,13 @@ int cls_netcam::resize()
             return -1;
         }
     }
-    retcd = av_image_fill_arrays(
-        swsframe_in->data
-        , swsframe_in->linesize
-        , (uint8_t*)img_recv->ptr
-        , (enum AVPixelFormat)frame->format
-        , frame->width, frame->height, 1);
-    if (retcd < 0) {
-        if (status == NETCAM_NOTCONNECTED) {
-            av_strerror(retcd, errstr, sizeof(errstr));
-            MOTPLS_LOG(ERR, TYPE_NETCAM, NO_ERRNO
-                ,_("%s:Error allocating picture in:%s")
-                , cameratype.c_str(), errstr);
-        }
-        context_close();
-        return -1;
-    }
 
-    buffer_out=(uint8_t *)av_malloc((uint)swsframe_size*sizeof(uint8_t));
+    check_buffsize(img_recv, (uint)swsframe_size);
 
     retcd = av_image_fill_arrays(
         swsframe_out->data
         , swsframe_out->linesize
-        , buffer_out, AV_PIX_FMT_YUV420P
+        , (uint8_t*)img_recv->ptr, AV_PIX_FMT_YUV420P
         , imgsize.width, imgsize.height, 1);
     if (retcd < 0) {
         if (status == NETCAM_NOTCONNECTED) {
@@ -1281,8 +1442,8 @@ int cls_netcam::resize()
 
     retcd = sws_scale(
         swsctx
-        ,(const uint8_t* const *)swsframe_in->data
-        ,swsframe_in->linesize
+        ,(const uint8_t* const *)frame->data
+        ,frame->linesize
         ,0
         ,frame->height
         ,swsframe_out->data
@@ -1297,28 +1458,8 @@ int cls_netcam::resize()
         context_close();
         return -1;
     }
-
-    retcd = av_image_copy_to_buffer(
-        (uint8_t *)img_recv->ptr
-        , swsframe_size
-        , (const uint8_t * const*)swsframe_out
-        , swsframe_out->linesize
-        , AV_PIX_FMT_YUV420P
-        , imgsize.width, imgsize.height, 1);
-    if (retcd < 0) {
-        if (status == NETCAM_NOTCONNECTED) {
-            av_strerror(retcd, errstr, sizeof(errstr));
-            MOTPLS_LOG(ERR, TYPE_NETCAM, NO_ERRNO
-                ,_("%s:Error putting frame into output buffer:%s")
-                , cameratype.c_str(), errstr);
-        }
-        context_close();
-        return -1;
-    }
     img_recv->used = (uint)swsframe_size;
 
-    av_free(buffer_out);
-
     return 0;
 }
 
@@ -1371,7 +1512,6 @@ int cls_netcam::read_image()
     int  size_decoded, retcd, errcnt, nodata;
     bool haveimage;
     char errstr[128];
-    netcam_buff *xchg;
 
     if (handler_stop) {
         return -1;
@@ -1427,11 +1567,20 @@ int cls_netcam::read_image()
                 haveimage = true;
             } else if (size_decoded == 0) {
                 /* Did not fail, just didn't get anything.  Try again */
+                if (passthrough &&
+                    (packet_recv->stream_index == video_stream_index)) {
+                    /* The movie still needs the packets of skipped frames */
+                    pktarray_add(idnbr + 1);
+                    idnbr++;
+                }
                 free_pkt();
                 packet_recv = mypacket_alloc(packet_recv);
 
-                /* The 1000 is arbitrary */
-                nodata++;
+                /* The 1000 is arbitrary.  Frames skipped while idle do not count */
+                if ((codec_context == nullptr) ||
+                    (codec_context->skip_frame == AVDISCARD_DEFAULT)) {
+                    nodata++;
+                }
                 if (nodata > 1000) {
                     context_close();
                     return -1;
@@ -1454,34 +1603,16 @@ int cls_netcam::read_image()
         status = NETCAM_CONNECTED;
     }
 
-    /* Skip resize/pix format for high pass-through */
+    /* The packet is in the array before next() can see its number */
+    if (passthrough) {
+        pktarray_add(idnbr + 1);
+    }
+    idnbr++;
     if (!(high_resolution && passthrough) &&
         (packet_recv->stream_index == video_stream_index)) {
-
-        if ((imgsize.width  != frame->width) ||
-            (imgsize.height != frame->height) ||
-            (check_pixfmt() != 0)) {
-            if (resize() < 0) {
-                free_pkt();
-                context_close();
-                return -1;
-            }
-        }
+        mbox_put();
     }
 
-    pthread_mutex_lock(&mutex);
-        idnbr++;
-        if (passthrough) {
-            pktarray_add();
-        }
-        if (!(high_resolution && passthrough) &&
-            (packet_recv->stream_index == video_stream_index)) {
-            xchg = img_latest;
-            img_latest = img_recv;
-            img_recv = xchg;
-        }
-    pthread_mutex_unlock(&mutex);
-
     clock_gettime(CLOCK_MONOTONIC, &ist_tm);
     free_pkt();
 
@@ -1695,13 +1826,20 @@ void cls_netcam::set_parms ()
 
     status = NETCAM_NOTCONNECTED;
     util_parms_add_default(params,"decoder","NULL");
-    img_recv =(netcam_buff_ptr) mymalloc(sizeof(netcam_buff));
-    img_recv->ptr =(char*) mymalloc(NETCAM_BUFFSIZE);
-    img_latest =(netcam_buff_ptr) mymalloc(sizeof(netcam_buff));
-    img_latest->ptr =(char*) mymalloc(NETCAM_BUFFSIZE);
+    for (indx = 0; indx < NETCAM_MBOX_CNT; indx++) {
+        memset(&img_buff[indx], 0, sizeof(netcam_buff));
+        img_buff[indx].ptr =(char*) mymalloc(NETCAM_BUFFSIZE);
+    }
+    img_recv = &img_buff[0];
+    img_mbox = 1;
+    img_latest = &img_buff[2];
+    frame_nbr = 0;
+    frame_taken = 0;
+    frame_dropped = 0;
     pktarray_size = 0;
     pktarray_index = -1;
     pktarray = nullptr;
+    keyarray_index = -1;
     packet_recv = nullptr;
     first_image = true;
     src_fps =  -1; /* Default to neg so we know it has not been set */
@@ -1714,6 +1852,8 @@ void cls_netcam::set_parms ()
     opts = nullptr;
     decoder = nullptr;
     idnbr = 0;
+    latest_handed = false;
+    img_handed = nullptr;
     swsframe_size = 0;
     hw_type = AV_HWDEVICE_TYPE_NONE;
     hw_pix_fmt = AV_PIX_FMT_NONE;
@@ -1723,6 +1863,10 @@ void cls_netcam::set_parms ()
     filelist.clear();
     filedir = "";
     cfg_idur = 3;
+    cfg_pktsecs = 10;
+    cfg_decthreads = 0;
+    cfg_decthreading = "auto";
+    cfg_decskip = AVDISCARD_DEFAULT;
 
     for (indx=0;indx<params->params_cnt;indx++) {
         if (params->params_array[indx].param_name == "decoder") {
@@ -1738,6 +1882,23 @@ void cls_netcam::set_parms ()
         if (params->params_array[indx].param_name == "interrupt") {
             cfg_idur = mtoi(params->params_array[indx].param_value);
         }
+        if (params->params_array[indx].param_name == "passthrough_secs") {
+            cfg_pktsecs = MAX(mtoi(params->params_array[indx].param_value), 0);
+        }
+        if (params->params_array[indx].param_name == "decode_threads") {
+            cfg_decthreads = mtoi(params->params_array[indx].param_value);
+        }
+        if (params->params_array[indx].param_name == "decode_threading") {
+            cfg_decthreading = params->params_array[indx].param_value;
+        }
+        if ((params->params_array[indx].param_name == "decode_skip") &&
+            (high_resolution == false)) {
+            if (params->params_array[indx].param_value == "nonref") {
+                cfg_decskip = AVDISCARD_NONREF;
+            } else if (params->params_array[indx].param_value == "nonkey") {
+                cfg_decskip = AVDISCARD_NONKEY;
+            }
+        }
     }
 
     /* If this is the norm and we have a highres, then disable passthru on the norm */
@@ -1930,6 +2091,8 @@ int cls_netcam::open_context()
                     ,cameratype.c_str());
             }
             passthrough = false;
+        } else {
+            pktarray_init();
         }
     }
 
@@ -2184,11 +2347,9 @@ void cls_netcam::handler_startup()
      */
     wait_counter = 60;
     while (wait_counter > 0) {
-        pthread_mutex_lock(&mutex);
-            if (img_latest->ptr != nullptr ) {
-                wait_counter = -1;
-            }
-        pthread_mutex_unlock(&mutex);
+        if (img_latest->ptr != nullptr ) {
+            wait_counter = -1;
+        }
         if (wait_counter > 0 ) {
             MOTPLS_LOG(INF, TYPE_NETCAM, NO_ERRNO
                 ,_("%s:Waiting for first image from the handler.")
@@ -2202,7 +2363,7 @@ void cls_netcam::handler_startup()
 
 void cls_netcam::handler_shutdown()
 {
-    int waitcnt;
+    int waitcnt, indx;
 
     idur = 0;
     handler_stop = true;
@@ -2246,15 +2407,17 @@ void cls_netcam::handler_shutdown()
 
     context_close();
 
-    if (img_latest != nullptr) {
-        myfree(img_latest->ptr);
-        myfree(img_latest);
-        img_latest = nullptr;
-    }
-
     if (img_recv != nullptr) {
-        myfree(img_recv->ptr);
-        myfree(img_recv);
+        if (frame_nbr > 0) {
+            MOTPLS_LOG(INF, TYPE_NETCAM, NO_ERRNO
+                ,_("%s:Images dropped before capture: %lld of %lld")
+                ,cameratype.c_str(), (long long)frame_dropped
+                ,(long long)frame_nbr);
+        }
+        for (indx = 0; indx < NETCAM_MBOX_CNT; indx++) {
+            myfree(img_buff[indx].ptr);
+        }
+        img_latest = nullptr;
         img_recv   = nullptr;
     }
 
@@ -2367,6 +2530,75 @@ void cls_netcam::noimage()
     }
 }
 
+/*
+ * Put the received image in the mailbox and take back the buffer that
+ * was there.  If the camera thread has not taken that one, its image
+ * is dropped.  Called from the handler thread.
+ */
+void cls_netcam::mbox_put()
+{
+    int prev;
+
+    img_recv->frame_nbr = ++frame_nbr;
+    prev = img_mbox.exchange(
+        (int)(img_recv - img_buff) | NETCAM_MBOX_NEW);
+    img_recv = &img_buff[prev & NETCAM_MBOX_INDX];
+}
+
+/*
+ * Take the newest image from the mailbox when there is one not taken
+ * yet, leaving the buffer of the prior image in its place.  Called
+ * from the camera thread.
+ */
+void cls_netcam::mbox_take()
+{
+    int prev;
+
+    if ((img_mbox.load() & NETCAM_MBOX_NEW) == 0) {
+        return;
+    }
+    prev = img_mbox.exchange((int)(img_latest - img_buff));
+    img_latest = &img_buff[prev & NETCAM_MBOX_INDX];
+    latest_handed = false;
+
+    if (frame_taken > 0) {
+        frame_dropped += img_latest->frame_nbr - frame_taken - 1;
+    }
+    frame_taken = img_latest->frame_nbr;
+}
+
+/*
+ * Put the latest image into the ring image.  A complete image is handed
+ * over by exchanging its buffer with the ring buffer so it is not copied
+ * and the ring buffer is used for a later image.  Once handed over, the
+ * image is not in img_latest so if no new image has arrived by the next
+ * call it is copied from prev instead.  The ring images are marked up
+ * after capture so prev is the virgin image for the normal resolution and
+ * the ring buffer itself for the high resolution which only gets the
+ * privacy mask.  Rotation is done in place on the ring image so it also
+ * needs the copy.
+ */
+void cls_netcam::next_image(u_char **image, int size, const u_char *prev)
+{
+    char *xchg;
+
+    if (latest_handed == false) {
+        if ((img_latest->used == (size_t)size) &&
+            (cam->rotate->active() == false)) {
+            xchg = (char *)*image;
+            *image = (u_char *)img_latest->ptr;
+            img_latest->ptr = xchg;
+            img_latest->size = (size_t)size;
+            img_handed = *image;
+            latest_handed = true;
+        } else {
+            memcpy(*image, img_latest->ptr, img_latest->used);
+        }
+    } else if (*image != prev) {
+        memcpy(*image, prev, (uint)size);
+    }
+}
+
 int cls_netcam::next(ctx_image_data *img_data)
 {
     if ((status == NETCAM_RECONNECTING) ||
@@ -2374,22 +2606,18 @@ int cls_netcam::next(ctx_image_data *img_data)
         return CAPTURE_ATTEMPTED;
     }
 
-    pthread_mutex_lock(&mutex);
-        pktarray_resize();
-        if (high_resolution == false) {
-            memcpy(img_data->image_norm
-                , img_latest->ptr
-                , img_latest->used);
-            img_data->idnbr_norm = idnbr;
-        } else {
-            img_data->idnbr_high = idnbr;
-            if (cam->netcam_high->passthrough == false) {
-                memcpy(img_data->image_high
-                    , img_latest->ptr
-                    , img_latest->used);
-            }
+    mbox_take();
+    if (high_resolution == false) {
+        next_image(&img_data->image_norm
+            , cam->imgs.size_norm, cam->imgs.image_virgin);
+        img_data->idnbr_norm = idnbr;
+    } else {
+        img_data->idnbr_high = idnbr;
+        if (cam->netcam_high->passthrough == false) {
+            next_image(&img_data->image_high
+                , cam->imgs.size_high, img_handed);
         }
-    pthread_mutex_unlock(&mutex);
+    }
 
     return CAPTURE_SUCCESS;
 }
@@ -2401,7 +2629,6 @@ cls_netcam::cls_netcam(cls_camera *p_cam, bool p_is_high)
     reconnect_count = 0;
     cameratype = "";
 
-    pthread_mutex_init(&mutex, nullptr);
     pthread_mutex_init(&mutex_pktarray, nullptr);
     pthread_mutex_init(&mutex_transfer, nullptr);
 
@@ -2411,7 +2638,6 @@ cls_netcam::~cls_netcam()
 {
     handler_shutdown();
 
-    pthread_mutex_destroy(&mutex);
     pthread_mutex_destroy(&mutex_pktarray);
     pthread_mutex_destroy(&mutex_transfer);
 
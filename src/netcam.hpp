@@ -22,6 +22,12 @@
 #define _INCLUDE_NETCAM_HPP_
 
 #define NETCAM_BUFFSIZE 4096
+#define NETCAM_PKTARRAY_MIN 30  /* Fewest packets in the pass-through ring */
+#define NETCAM_KEYARRAY_CNT 64  /* Keyframes kept in the index of the pass-through ring */
+#define NETCAM_MBOX_CNT  3     /* Image buffers used by the mailbox */
+#define NETCAM_MBOX_INDX 3     /* Bits of img_mbox holding the buffer index */
+#define NETCAM_MBOX_NEW  4     /* Bit of img_mbox set when the buffer has not been taken */
+#define NETCAM_DECODE_MAX 16    /* Most decoder threads for one stream */
 
 enum NETCAM_STATUS {
     NETCAM_CONNECTED,      /* The camera is currently connected */
@@ -44,9 +50,11 @@ struct ctx_url {
 };
 
 /*
- * We use a special "triple-buffer" technique.  There are
- * three separate buffers (latest, receiving and jpegbuf)
- * which are each described using a struct netcam_image_buff
+ * We use a special "triple-buffer" technique.  The decode thread
+ * owns the receiving buffer and the camera thread owns the latest
+ * buffer.  The third is in a mailbox and each thread exchanges its
+ * own buffer with it without a lock so the decode thread always has
+ * a buffer to fill and the camera thread always gets the newest image.
  */
 typedef struct netcam_image_buff {
     char *ptr;
@@ -54,6 +62,7 @@ typedef struct netcam_image_buff {
     size_t size;                    /* total allocated size */
     size_t used;                    /* bytes already used */
     struct timespec image_time;      /* time this image was received */
+    int64_t frame_nbr;              /* sequence number of the image */
 } netcam_buff;
 typedef netcam_buff *netcam_buff_ptr;
 
@@ -61,7 +70,12 @@ struct ctx_packet_item{
     AVPacket                 *packet;
     int64_t                   idnbr;
     bool                      iskey;
-    bool                      iswritten;
+};
+
+/* A video keyframe in the pass-through ring */
+struct ctx_packet_key {
+    int64_t                   idnbr;
+    int64_t                   pdts;     /* Lower of the pts and dts */
 };
 
 struct ctx_filelist_item {
@@ -84,13 +98,14 @@ class cls_netcam {
         std::string               camera_name;      /* The name of the camera as provided in the config file */
         std::string               cameratype;       /* String specifying Normal or High for use in logging */
 
-        pthread_mutex_t           mutex;            /* mutex used with conditional waits */
         pthread_mutex_t           mutex_transfer;   /* mutex used with transferring stream info for pass-through */
         pthread_mutex_t           mutex_pktarray;   /* mutex used with the packet array */
 
         AVFormatContext          *transfer_format;       /* Format context just for transferring to pass-through */
         ctx_packet_item          *pktarray;              /* Pointer to array of packets for passthru processing */
         int                       pktarray_size;         /* The number of packets in array.  1 based */
+        ctx_packet_key            keyarray[NETCAM_KEYARRAY_CNT];  /* Ring of the newest keyframes in pktarray */
+        int                       keyarray_index;        /* The index to the most current keyframe */
         int                       video_stream_index;       /* Stream index associated with video from camera */
         int                       audio_stream_index;       /* Stream index associated with audio from camera */
 
@@ -100,6 +115,8 @@ class cls_netcam {
         void            handler();
 
         int next(ctx_image_data *img_data);
+        int pktarray_find(int64_t pkt_idnbr);
+        int pktarray_key(int64_t pkt_idnbr, int64_t *pdts);
         void noimage();
         void netcam_start();
         void netcam_stop();
@@ -109,13 +126,12 @@ class cls_netcam {
         AVCodecContext           *codec_context;         /* Codec being sent from the camera */
         AVStream                 *strm;
         AVFrame                  *frame;                 /* Reusable frame for images from camera */
-        AVFrame                  *swsframe_in;           /* Used when resizing image sent from camera */
         AVFrame                  *swsframe_out;          /* Used when resizing image sent from camera */
         struct SwsContext        *swsctx;                /* Context for the resizing of the image */
         AVPacket                 *packet_recv;           /* The packet that is currently being processed */
 
-        int                       pktarray_index;        /* The index to the most current packet in array */
-        int64_t                   idnbr;                 /* A ID number to track the packet vs image */
+        std::atomic<int>          pktarray_index;        /* The index to the most current packet in array */
+        std::atomic<int64_t>      idnbr;                 /* A ID number to track the packet vs image */
         AVDictionary             *opts;                  /* AVOptions when opening the format context */
         int                       swsframe_size;         /* The size of the image after resizing */
 
@@ -124,8 +140,15 @@ class cls_netcam {
         AVBufferRef              *hw_device_ctx;
         myAVCodec                *decoder;
 
+        netcam_buff               img_buff[NETCAM_MBOX_CNT];  /* The image buffers */
+        std::atomic<int>          img_mbox;         /* Index of the buffer in the mailbox plus NETCAM_MBOX_NEW */
         netcam_buff_ptr           img_recv;         /* The image buffer that is currently being processed */
-        netcam_buff_ptr           img_latest;       /* The most recent image buffer that finished processing */
+        netcam_buff_ptr           img_latest;       /* The most recent image buffer taken from the mailbox */
+        int64_t                   frame_nbr;        /* Sequence number of the last image put in the mailbox */
+        int64_t                   frame_taken;      /* Sequence number of the last image taken from the mailbox */
+        int64_t                   frame_dropped;    /* Images replaced in the mailbox before being taken */
+        bool                      latest_handed;    /* The buffer of img_latest was handed to the image ring */
+        u_char                    *img_handed;      /* The ring buffer last handed the image */
 
         bool                      high_resolution;  /* Boolean for whether this context is the Norm or High */
 
@@ -158,6 +181,11 @@ class cls_netcam {
         int         cfg_height;
         int         cfg_framerate;
         int         cfg_idur;
+        int         cfg_pktsecs;
+        int         cfg_decthreads;
+        std::string cfg_decthreading;
+        enum AVDiscard  cfg_decskip;
+        int         decode_thread_cnt;  /* Decoder threads counted in the app total */
         std::string cfg_params;
 
         std::vector<ctx_filelist_item>    filelist;
@@ -166,6 +194,10 @@ class cls_netcam {
 
         void filelist_load();
         void check_buffsize(netcam_buff_ptr buff, size_t numbytes);
+        void decoder_threads();
+        void next_image(u_char **image, int size, const u_char *prev);
+        void mbox_put();
+        void mbox_take();
         char *url_match(regmatch_t m, const char *input);
         void url_invalid(ctx_url *parse_url);
         void url_parse(ctx_url *parse_url, std::string text_url);
@@ -174,12 +206,14 @@ class cls_netcam {
         void pktarray_free();
         void context_null();
         void context_close();
-        void pktarray_resize();
-        void pktarray_add();
+        void pktarray_init();
+        void pktarray_add(int64_t pkt_idnbr);
+        void keyarray_add(AVPacket *pkt, int64_t pkt_idnbr);
         int decode_sw();
         int decode_vaapi();
         int decode_cuda();
         int decode_drm();
+        void decode_skip();
         int decode_video();
         int decode_packet();
         void hwdecoders();
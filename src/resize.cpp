@@ -0,0 +1,203 @@
+/*
+ *    This file is part of MotionPlus.
+ *
+ *    MotionPlus is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ *
+ *    MotionPlus is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License
+ *    along with MotionPlus.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "motionplus.hpp"
+#include "util.hpp"
+#include "logger.hpp"
+#include "resize.hpp"
+
+void cls_resize::item_free(ctx_resize_item *itm)
+{
+    if (itm->swsctx != nullptr) {
+        sws_freeContext(itm->swsctx);
+    }
+    delete itm;
+}
+
+/* Hold a context for the sizes, reusing an idle one when there is one */
+ctx_resize_item *cls_resize::item_get(int src_w, int src_h
+    , int dst_w, int dst_h, enum AVPixelFormat pix_fmt)
+{
+    int indx, lru_indx, idle_cnt;
+    ctx_resize_item *itm;
+
+    pthread_mutex_lock(&mutex);
+        use_nbr++;
+        lru_indx = -1;
+        idle_cnt = 0;
+        for (indx=0; indx<(int)items.size(); indx++) {
+            itm = items[indx];
+            if (itm->in_use) {
+                continue;
+            }
+            if ((itm->src_w == src_w) && (itm->src_h == src_h) &&
+                (itm->dst_w == dst_w) && (itm->dst_h == dst_h) &&
+                (itm->pix_fmt == pix_fmt)) {
+                itm->in_use = true;
+                itm->use_nbr = use_nbr;
+                pthread_mutex_unlock(&mutex);
+                return itm;
+            }
+            idle_cnt++;
+            if ((lru_indx == -1) ||
+                (itm->use_nbr < items[lru_indx]->use_nbr)) {
+                lru_indx = indx;
+            }
+        }
+
+        /* Free the idle context used longest ago to make room */
+        if ((idle_cnt >= RESIZE_MAX_ITEMS) && (lru_indx != -1)) {
+            item_free(items[lru_indx]);
+            items.erase(items.begin() + lru_indx);
+        }
+
+        itm = new ctx_resize_item;
+        itm->src_w = src_w;
+        itm->src_h = src_h;
+        itm->dst_w = dst_w;
+        itm->dst_h = dst_h;
+        itm->pix_fmt = pix_fmt;
+        itm->in_use = true;
+        itm->use_nbr = use_nbr;
+        itm->swsctx = sws_getContext(
+            src_w, src_h, pix_fmt
+            ,dst_w, dst_h, pix_fmt
+            ,SWS_BICUBIC, NULL, NULL, NULL);
+        if (itm->swsctx == nullptr) {
+            MOTPLS_LOG(ERR, TYPE_ALL, NO_ERRNO
+                , _("Unable to allocate scaling context."));
+            item_free(itm);
+            pthread_mutex_unlock(&mutex);
+            return nullptr;
+        }
+        items.push_back(itm);
+    pthread_mutex_unlock(&mutex);
+
+    return itm;
+}
+
+void cls_resize::item_put(ctx_resize_item *itm)
+{
+    pthread_mutex_lock(&mutex);
+        itm->in_use = false;
+    pthread_mutex_unlock(&mutex);
+}
+
+/*
+ * Scale src into the planes of dst.  The planes may be a part of a larger
+ * image when the linesizes are those of the larger image.
+ */
+int cls_resize::scale_planes(const u_char *src, int src_w, int src_h
+    , uint8_t *dst_data[4], int dst_linesize[4], int dst_w, int dst_h
+    , enum AVPixelFormat pix_fmt)
+{
+    int             retcd;
+    char            errstr[128];
+    uint8_t         *src_data[4];
+    int             src_linesize[4];
+    ctx_resize_item *itm;
+
+    retcd = av_image_fill_arrays(src_data, src_linesize
+        , src, pix_fmt, src_w, src_h, 1);
+    if (retcd < 0) {
+        av_strerror(retcd, errstr, sizeof(errstr));
+        MOTPLS_LOG(ERR, TYPE_ALL, NO_ERRNO
+            , _("Error filling arrays: %s"), errstr);
+        return -1;
+    }
+
+    itm = item_get(src_w, src_h, dst_w, dst_h, pix_fmt);
+    if (itm == nullptr) {
+        return -1;
+    }
+
+    retcd = sws_scale(itm->swsctx
+        , (const uint8_t* const *)src_data, src_linesize
+        , 0, src_h, dst_data, dst_linesize);
+
+    item_put(itm);
+
+    if (retcd < 0) {
+        av_strerror(retcd, errstr, sizeof(errstr));
+        MOTPLS_LOG(ERR, TYPE_ALL, NO_ERRNO
+            ,_("Error resizing/reformatting: %s"), errstr);
+        return -1;
+    }
+
+    return 0;
+}
+
+/*
+ * Scale src into dst.  Both are packed images of the format so the planes
+ * are found in place and the scaler writes straight into dst.  On an error
+ * dst is left as a black image.
+ */
+int cls_resize::scale(const u_char *src, int src_w, int src_h
+    , u_char *dst, int dst_w, int dst_h
+    , enum AVPixelFormat pix_fmt)
+{
+    int             retcd, dst_sz;
+    char            errstr[128];
+    uint8_t         *dst_data[4];
+    int             dst_linesize[4];
+
+    dst_sz = av_image_get_buffer_size(pix_fmt, dst_w, dst_h, 1);
+    if (dst_sz < 0) {
+        MOTPLS_LOG(ERR, TYPE_ALL, NO_ERRNO
+            , _("Invalid resize image %dx%d"), dst_w, dst_h);
+        return -1;
+    }
+
+    retcd = av_image_fill_arrays(dst_data, dst_linesize
+        , dst, pix_fmt, dst_w, dst_h, 1);
+    if (retcd < 0) {
+        av_strerror(retcd, errstr, sizeof(errstr));
+        MOTPLS_LOG(ERR, TYPE_ALL, NO_ERRNO
+            , _("Error filling arrays: %s"), errstr);
+        memset(dst, 0x00, (size_t)dst_sz);
+        return -1;
+    }
+
+    retcd = scale_planes(src, src_w, src_h
+        , dst_data, dst_linesize, dst_w, dst_h, pix_fmt);
+    if (retcd < 0) {
+        memset(dst, 0x00, (size_t)dst_sz);
+        return -1;
+    }
+
+    return 0;
+}
+
+cls_resize::cls_resize(cls_motapp *p_app)
+{
+    app = p_app;
+    use_nbr = 0;
+    items.clear();
+    pthread_mutex_init(&mutex, NULL);
+}
+
+cls_resize::~cls_resize()
+{
+    int indx;
+
+    for (indx=0; indx<(int)items.size(); indx++) {
+        item_free(items[indx]);
+    }
+    items.clear();
+    pthread_mutex_destroy(&mutex);
+}
@@ -0,0 +1,65 @@
+/*
+ *    This file is part of MotionPlus.
+ *
+ *    MotionPlus is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ *
+ *    MotionPlus is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License
+ *    along with MotionPlus.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef _INCLUDE_RESIZE_HPP_
+#define _INCLUDE_RESIZE_HPP_
+
+    #define RESIZE_MAX_ITEMS   16   /* Idle scaling contexts kept */
+
+    struct ctx_resize_item {
+        int                 src_w;
+        int                 src_h;
+        int                 dst_w;
+        int                 dst_h;
+        enum AVPixelFormat  pix_fmt;
+        struct SwsContext   *swsctx;
+        bool                in_use;     /* Held by a caller while scaling */
+        int64_t             use_nbr;    /* When last used.  Lowest is freed first */
+    };
+
+    /*
+     * Scaling contexts kept by the sizes and format of the images so that
+     * repeated resizes skip the setup of the scaler.  Any thread may call
+     * scale.  Each context is held by one caller at a time and another is
+     * made for the same sizes when callers overlap.
+     */
+    class cls_resize {
+        public:
+            cls_resize(cls_motapp *p_app);
+            ~cls_resize();
+
+            int scale(const u_char *src, int src_w, int src_h
+                , u_char *dst, int dst_w, int dst_h
+                , enum AVPixelFormat pix_fmt);
+            int scale_planes(const u_char *src, int src_w, int src_h
+                , uint8_t *dst_data[4], int dst_linesize[4], int dst_w, int dst_h
+                , enum AVPixelFormat pix_fmt);
+
+        private:
+            cls_motapp                      *app;
+            pthread_mutex_t                 mutex;
+            std::vector<ctx_resize_item*>   items;
+            int64_t                         use_nbr;
+
+            ctx_resize_item *item_get(int src_w, int src_h
+                , int dst_w, int dst_h, enum AVPixelFormat pix_fmt);
+            void item_put(ctx_resize_item *itm);
+            void item_free(ctx_resize_item *itm);
+    };
+
+#endif /* _INCLUDE_RESIZE_HPP_ */
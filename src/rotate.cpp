@@ -118,6 +118,12 @@ void cls_rotate::rot90ccw(u_char *src, u_char *dst, int size, int width, int hei
     }
 }
 
+/* Whether process changes the images at all */
+bool cls_rotate::active()
+{
+    return ((degrees != 0) || (axis != FLIP_TYPE_NONE));
+}
+
 void cls_rotate::process(ctx_image_data *img_data)
 {
     /*
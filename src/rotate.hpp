@@ -30,6 +30,7 @@ class cls_rotate {
         ~cls_rotate();
 
         void process(ctx_image_data *img_data);
+        bool active();
 
     private:
         cls_camera *cam;
@@ -19,6 +19,7 @@
 #include "motionplus.hpp"
 #include "util.hpp"
 #include "camera.hpp"
+#include "allcam.hpp"
 #include "conf.hpp"
 #include "logger.hpp"
 #include "webu.hpp"
@@ -29,6 +30,7 @@
 #include "webu_file.hpp"
 #include "webu_stream.hpp"
 #include "webu_mpegts.hpp"
+#include "webu_getimg.hpp"
 #include "video_v4l2.hpp"
 
 /* Initialize the MHD answer */
@@ -146,6 +148,26 @@ void cls_webu::mhd_features_ipv6()
     #endif
 }
 
+/* Validate that the MHD version installed can suspend connections in a thread pool */
+void cls_webu::mhd_features_pool()
+{
+    stream_suspend = false;
+    if (app->cfg->webcontrol_threads == 0) {
+        return;
+    }
+    #if MHD_VERSION < 0x00095300
+        MOTPLS_LOG(INF, TYPE_STREAM, NO_ERRNO
+            ,_("libmicrohttpd libary too old for webcontrol_threads.  Using a thread per connection"));
+    #else
+        stream_suspend = true;
+        if (MHD_is_feature_supported(MHD_FEATURE_EPOLL) == MHD_YES) {
+            MOTPLS_LOG(DBG, TYPE_STREAM, NO_ERRNO ,_("EPOLL: available"));
+        } else {
+            MOTPLS_LOG(NTC, TYPE_STREAM, NO_ERRNO ,_("EPOLL: disabled"));
+        }
+    #endif
+}
+
 /* Validate that the MHD version installed can process tls */
 void cls_webu::mhd_features_tls()
 {
@@ -177,6 +199,7 @@ void cls_webu::mhd_features()
     mhd_features_digest();
     mhd_features_ipv6();
     mhd_features_tls();
+    mhd_features_pool();
 }
 
 /* Load a either the key or cert file for MHD*/
@@ -344,6 +367,7 @@ void cls_webu::mhd_opts()
     mhd_opts_localhost();
     mhd_opts_digest();
     mhd_opts_tls();
+    mhd_opts_pool();
 
     mhdst->mhd_ops[mhdst->mhd_opt_nbr].option = MHD_OPTION_END;
     mhdst->mhd_ops[mhdst->mhd_opt_nbr].value = 0;
@@ -352,11 +376,35 @@ void cls_webu::mhd_opts()
 
 }
 
+/* Set the MHD option on the number of threads polling the connections */
+void cls_webu::mhd_opts_pool()
+{
+    if (stream_suspend) {
+        mhdst->mhd_ops[mhdst->mhd_opt_nbr].option = MHD_OPTION_THREAD_POOL_SIZE;
+        mhdst->mhd_ops[mhdst->mhd_opt_nbr].value = app->cfg->webcontrol_threads;
+        mhdst->mhd_ops[mhdst->mhd_opt_nbr].ptr_value = NULL;
+        mhdst->mhd_opt_nbr++;
+    }
+}
+
 /* Set the mhd start up flags */
 void cls_webu::mhd_flags()
 {
     mhdst->mhd_flags = MHD_USE_THREAD_PER_CONNECTION;
 
+    #if MHD_VERSION >= 0x00095300
+        if (stream_suspend) {
+            if (MHD_is_feature_supported(MHD_FEATURE_EPOLL) == MHD_YES) {
+                mhdst->mhd_flags = MHD_USE_EPOLL_INTERNAL_THREAD;
+            } else if (MHD_is_feature_supported(MHD_FEATURE_POLL) == MHD_YES) {
+                mhdst->mhd_flags = MHD_USE_POLL_INTERNAL_THREAD;
+            } else {
+                mhdst->mhd_flags = MHD_USE_INTERNAL_POLLING_THREAD;
+            }
+            mhdst->mhd_flags = mhdst->mhd_flags | MHD_ALLOW_SUSPEND_RESUME;
+        }
+    #endif
+
     if (mhdst->ipv6) {
         mhdst->mhd_flags = mhdst->mhd_flags | MHD_USE_DUAL_STACK;
     }
@@ -496,6 +544,7 @@ void cls_webu::startup()
     wb_daemon = nullptr;
     wb_daemon2 = nullptr;
     finish = false;
+    stream_suspend = false;
     wb_clients.clear();
 
     memset(wb_digest_rand, 0, sizeof(wb_digest_rand));
@@ -526,12 +575,28 @@ void cls_webu::startup()
 
 void cls_webu::shutdown()
 {
-    int chkcnt;
+    int chkcnt, indx;
 
     finish = true;
 
     MOTPLS_LOG(NTC, TYPE_STREAM, NO_ERRNO, _("Closing webcontrol"));
 
+    /* Suspended streams only see the finish once they are resumed */
+    if (stream_suspend) {
+        pthread_mutex_lock(&app->mutex_camlst);
+            for (indx=0; indx<app->cam_cnt; indx++) {
+                pthread_mutex_lock(&app->cam_list[indx]->stream.mutex);
+                    webu_getimg_resume(&app->cam_list[indx]->stream);
+                pthread_mutex_unlock(&app->cam_list[indx]->stream.mutex);
+            }
+        pthread_mutex_unlock(&app->mutex_camlst);
+        if (app->allcam != nullptr) {
+            pthread_mutex_lock(&app->allcam->stream.mutex);
+                webu_getimg_resume(&app->allcam->stream);
+            pthread_mutex_unlock(&app->allcam->stream.mutex);
+        }
+    }
+
     chkcnt = 0;
     while ((chkcnt < 1000) && (cnct_cnt >0)) {
         SLEEP(0, 5000000);
@@ -23,7 +23,7 @@
     #define WEBUI_LEN_PARM 512          /* Parameters specified */
     #define WEBUI_LEN_URLI 512          /* Maximum URL permitted */
     #define WEBUI_LEN_RESP 1024         /* Initial response size */
-    #define WEBUI_MHD_OPTS 10           /* Maximum number of options permitted for MHD */
+    #define WEBUI_MHD_OPTS 12           /* Maximum number of options permitted for MHD */
 
     #define WEBUI_POST_BFRSZ  512
 
@@ -35,6 +35,7 @@
     enum WEBUI_CNCT {
         WEBUI_CNCT_CONTROL,
         WEBUI_CNCT_FILE,
+        WEBUI_CNCT_MP4,
         WEBUI_CNCT_JPG_MIN,
         WEBUI_CNCT_JPG_FULL,
         WEBUI_CNCT_JPG_SUB,
@@ -98,6 +99,7 @@
             std::list<ctx_webu_clients> wb_clients;
             std::string                 info_tls;
             int                         cnct_cnt;
+            bool                        stream_suspend; /* Streams suspend the connection instead of waiting */
             bool                        restart;
             void startup();
             void shutdown();
@@ -112,6 +114,7 @@
             void mhd_features_digest();
             void mhd_features_ipv6();
             void mhd_features_tls();
+            void mhd_features_pool();
             void mhd_features();
             void mhd_loadfile(std::string fname, std::string &filestr);
             void mhd_checktls();
@@ -120,6 +123,7 @@
             void mhd_opts_localhost();
             void mhd_opts_digest();
             void mhd_opts_tls();
+            void mhd_opts_pool();
             void mhd_opts();
             void mhd_flags();
     };
@@ -746,7 +746,7 @@ void cls_webu_ans::answer_get()
         ,"processing get: %s",uri_cmd1.c_str());
 
     if ((uri_cmd1 == "mjpg") || (uri_cmd1 == "mpegts") ||
-        (uri_cmd1 == "static")) {
+        (uri_cmd1 == "mp4") || (uri_cmd1 == "static")) {
         if (webu_stream == nullptr) {
             webu_stream  = new cls_webu_stream(this);
         }
@@ -1000,13 +1000,14 @@ cls_webu_ans::cls_webu_ans(cls_motapp *p_app, const char *uri)
 
 cls_webu_ans::~cls_webu_ans()
 {
+    /* The stream moves its count off any rung before the counters */
+    mydelete(webu_stream);
     deinit_counter();
 
     mydelete(webu_file);
     mydelete(webu_html);
     mydelete(webu_json);
     mydelete(webu_post);
-    mydelete(webu_stream);
 
     myfree(auth_user);
     myfree(auth_pass);
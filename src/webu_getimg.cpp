@@ -23,13 +23,154 @@
 #include "camera.hpp"
 #include "picture.hpp"
 #include "alg_sec.hpp"
+#include "resize.hpp"
+#include "webu_stream.hpp"
 #include "webu_getimg.hpp"
 
 /* NOTE:  These run on the camera thread. */
 
+/*
+ * Let go of a reference to the part.  The last one out keeps it as the
+ * spare of the stream or frees it once the stream no longer publishes.
+ * Called with the stream mutex locked.
+ */
+void webu_getimg_release(ctx_stream_data *strm, ctx_stream_jpg *part)
+{
+    if (part == NULL) {
+        return;
+    }
+    part->refcnt--;
+    if (part->refcnt > 0) {
+        return;
+    }
+    if ((strm->jpg_spare == NULL) && (strm->jpg_part != NULL)) {
+        strm->jpg_spare = part;
+    } else {
+        myfree(part->buf);
+        myfree(part);
+    }
+}
+
+/*
+ * Publish the jpg of the stream as the part for the mjpeg connections.
+ * The jpg is copied once here and the connections send the part as is.
+ * Called with the stream mutex locked.
+ */
+void webu_getimg_part(ctx_stream_data *strm)
+{
+    ctx_stream_jpg *part, *prev;
+    char    part_head[80];
+    int     head_sz;
+    size_t  part_sz;
+
+    if ((strm->jpg_data == NULL) || (strm->jpg_sz <= 0)) {
+        return;
+    }
+
+    head_sz = snprintf(part_head, 80
+        ,"--BoundaryString\r\n"
+        "Content-type: image/jpeg\r\n"
+        "Content-Length: %9d\r\n\r\n"
+        ,strm->jpg_sz);
+    part_sz = (size_t)head_sz + (size_t)strm->jpg_sz + 2;
+
+    part = strm->jpg_spare;
+    strm->jpg_spare = NULL;
+    if (part == NULL) {
+        part = (ctx_stream_jpg*)mymalloc(sizeof(ctx_stream_jpg));
+        part->buf = NULL;
+        part->buf_sz = 0;
+    }
+    if (part->buf_sz < part_sz) {
+        myfree(part->buf);
+        part->buf = (u_char*)mymalloc(part_sz);
+        part->buf_sz = part_sz;
+    }
+    memcpy(part->buf, part_head, (uint)head_sz);
+    memcpy(part->buf + head_sz, strm->jpg_data, (uint)strm->jpg_sz);
+    memcpy(part->buf + head_sz + strm->jpg_sz, "\r\n", 2);
+    part->part_sz = part_sz;
+    part->refcnt = 1;
+
+    prev = strm->jpg_part;
+    strm->jpg_part = part;
+    webu_getimg_release(strm, prev);
+}
+
+/* Free the parts of the stream other than those still being sent */
+void webu_getimg_part_free(ctx_stream_data *strm)
+{
+    ctx_stream_jpg *prev;
+
+    prev = strm->jpg_part;
+    strm->jpg_part = NULL;
+    webu_getimg_release(strm, prev);
+    if (strm->jpg_spare != NULL) {
+        myfree(strm->jpg_spare->buf);
+        myfree(strm->jpg_spare);
+    }
+}
+
+/*
+ * Set up the rungs of the ladder from the stream_ladder parameter.  Each
+ * rung is the percent of the image size with an optional jpg quality such
+ * as 50:60,25:40.  The sizes are kept to multiples of 16.
+ */
+static void webu_getimg_ladder_init(cls_camera *cam)
+{
+    std::string parm, rung_parm;
+    size_t pos;
+    int pct, quality;
+    ctx_stream_rung *rung;
+
+    cam->stream.rung_cnt = 0;
+    parm = cam->cfg->stream_ladder;
+    while ((parm != "") && (cam->stream.rung_cnt < STREAM_LADDER_MAX)) {
+        pos = parm.find(",");
+        if (pos == std::string::npos) {
+            rung_parm = parm;
+            parm = "";
+        } else {
+            rung_parm = parm.substr(0, pos);
+            parm = parm.substr(pos + 1);
+        }
+
+        pct = 0;
+        quality = cam->cfg->stream_quality;
+        sscanf(rung_parm.c_str(), "%d:%d", &pct, &quality);
+        if ((pct < 1) || (pct > 99) || (quality < 1) || (quality > 100)) {
+            MOTPLS_LOG(NTC, TYPE_STREAM, NO_ERRNO
+                , _("Invalid stream_ladder rung %s"), rung_parm.c_str());
+            continue;
+        }
+
+        rung = &cam->stream.rung[cam->stream.rung_cnt];
+        rung->width = ((cam->imgs.width * pct) / 100);
+        rung->width = rung->width - (rung->width % 16);
+        rung->height = ((cam->imgs.height * pct) / 100);
+        rung->height = rung->height - (rung->height % 16);
+        if ((rung->width < 16) || (rung->height < 16)) {
+            MOTPLS_LOG(NTC, TYPE_STREAM, NO_ERRNO
+                , _("stream_ladder rung %s is too small"), rung_parm.c_str());
+            continue;
+        }
+        rung->quality = quality;
+        rung->img_sz = (rung->width * rung->height * 3) / 2;
+        rung->img = (u_char*)mymalloc((uint)rung->img_sz);
+        rung->jpg = (u_char*)mymalloc((uint)rung->img_sz);
+        cam->stream.rung_cnt++;
+
+        MOTPLS_LOG(INF, TYPE_STREAM, NO_ERRNO
+            , _("Stream rung %d: %dx%d quality %d")
+            , cam->stream.rung_cnt, rung->width, rung->height, rung->quality);
+    }
+}
+
 /* Initial the stream context items for the camera */
 void webu_getimg_init(cls_camera *cam)
 {
+    int indx;
+
     cam->imgs.image_substream = NULL;
 
     cam->stream.norm.jpg_sz = 0;
@@ -39,6 +180,10 @@ void webu_getimg_init(cls_camera *cam)
     cam->stream.norm.all_cnct = 0;
     cam->stream.norm.consumed = true;
     cam->stream.norm.img_data = NULL;
+    cam->stream.norm.img_nbr = 0;
+    cam->stream.norm.jpg_part = NULL;
+    cam->stream.norm.jpg_spare = NULL;
+    cam->stream.norm.ts_enc = NULL;
 
     cam->stream.sub.jpg_sz = 0;
     cam->stream.sub.jpg_data = NULL;
@@ -47,6 +192,10 @@ void webu_getimg_init(cls_camera *cam)
     cam->stream.sub.all_cnct = 0;
     cam->stream.sub.consumed = true;
     cam->stream.sub.img_data = NULL;
+    cam->stream.sub.img_nbr = 0;
+    cam->stream.sub.jpg_part = NULL;
+    cam->stream.sub.jpg_spare = NULL;
+    cam->stream.sub.ts_enc = NULL;
 
     cam->stream.motion.jpg_sz = 0;
     cam->stream.motion.jpg_data = NULL;
@@ -55,6 +204,10 @@ void webu_getimg_init(cls_camera *cam)
     cam->stream.motion.all_cnct = 0;
     cam->stream.motion.consumed = true;
     cam->stream.motion.img_data = NULL;
+    cam->stream.motion.img_nbr = 0;
+    cam->stream.motion.jpg_part = NULL;
+    cam->stream.motion.jpg_spare = NULL;
+    cam->stream.motion.ts_enc = NULL;
 
     cam->stream.source.jpg_sz = 0;
     cam->stream.source.jpg_data = NULL;
@@ -63,6 +216,10 @@ void webu_getimg_init(cls_camera *cam)
     cam->stream.source.all_cnct = 0;
     cam->stream.source.consumed = true;
     cam->stream.source.img_data = NULL;
+    cam->stream.source.img_nbr = 0;
+    cam->stream.source.jpg_part = NULL;
+    cam->stream.source.jpg_spare = NULL;
+    cam->stream.source.ts_enc = NULL;
 
     cam->stream.secondary.jpg_sz = 0;
     cam->stream.secondary.jpg_data = NULL;
@@ -71,12 +228,33 @@ void webu_getimg_init(cls_camera *cam)
     cam->stream.secondary.all_cnct = 0;
     cam->stream.secondary.consumed = true;
     cam->stream.secondary.img_data = NULL;
+    cam->stream.secondary.img_nbr = 0;
+    cam->stream.secondary.jpg_part = NULL;
+    cam->stream.secondary.jpg_spare = NULL;
+    cam->stream.secondary.ts_enc = NULL;
+
+    for (indx=0; indx<STREAM_LADDER_MAX; indx++) {
+        cam->stream.ladder[indx].jpg_sz = 0;
+        cam->stream.ladder[indx].jpg_data = NULL;
+        cam->stream.ladder[indx].jpg_cnct = 0;
+        cam->stream.ladder[indx].ts_cnct = 0;
+        cam->stream.ladder[indx].all_cnct = 0;
+        cam->stream.ladder[indx].consumed = true;
+        cam->stream.ladder[indx].img_data = NULL;
+        cam->stream.ladder[indx].img_nbr = 0;
+        cam->stream.ladder[indx].jpg_part = NULL;
+        cam->stream.ladder[indx].jpg_spare = NULL;
+        cam->stream.ladder[indx].ts_enc = NULL;
+    }
+    webu_getimg_ladder_init(cam);
 
 }
 
 /* Free the stream buffers and mutex for shutdown */
 void webu_getimg_deinit(cls_camera *cam)
 {
+    int indx;
+
     /* NOTE:  This runs on the camera thread. */
     myfree(cam->imgs.image_substream);
 
@@ -92,6 +270,23 @@ void webu_getimg_deinit(cls_camera *cam)
         myfree(cam->stream.motion.img_data) ;
         myfree(cam->stream.source.img_data) ;
         myfree(cam->stream.secondary.img_data) ;
+
+        webu_getimg_part_free(&cam->stream.norm);
+        webu_getimg_part_free(&cam->stream.sub);
+        webu_getimg_part_free(&cam->stream.motion);
+        webu_getimg_part_free(&cam->stream.source);
+        webu_getimg_part_free(&cam->stream.secondary);
+
+        for (indx=0; indx<cam->stream.rung_cnt; indx++) {
+            myfree(cam->stream.ladder[indx].jpg_data);
+            webu_getimg_part_free(&cam->stream.ladder[indx]);
+            myfree(cam->stream.rung[indx].img);
+            myfree(cam->stream.rung[indx].jpg);
+        }
+        cam->stream.rung_cnt = 0;
+
+        /* Let the suspended connections see the camera has stopped */
+        webu_getimg_resume(&cam->stream);
     pthread_mutex_unlock(&cam->stream.mutex);
 
 }
@@ -119,6 +314,7 @@ static void webu_getimg_norm(cls_camera *cam)
                 ,cam->imgs.width
                 ,cam->imgs.height);
             cam->stream.norm.consumed = false;
+            webu_getimg_part(&cam->stream.norm);
         }
     }
     if ((cam->stream.norm.ts_cnct > 0) || (cam->stream.norm.all_cnct > 0)) {
@@ -128,6 +324,7 @@ static void webu_getimg_norm(cls_camera *cam)
         }
         memcpy(cam->stream.norm.img_data, cam->current_image->image_norm
             , (uint)cam->imgs.size_norm);
+        cam->stream.norm.img_nbr++;
     }
 }
 
@@ -179,6 +376,7 @@ static void webu_getimg_sub(cls_camera *cam)
                     ,cam->imgs.height);
             }
             cam->stream.sub.consumed = false;
+            webu_getimg_part(&cam->stream.sub);
         }
     }
 
@@ -201,6 +399,7 @@ static void webu_getimg_sub(cls_camera *cam)
             memcpy(cam->stream.sub.img_data, cam->current_image->image_norm
                 , (uint)cam->imgs.size_norm);
         }
+        cam->stream.sub.img_nbr++;
     }
 
 }
@@ -227,6 +426,7 @@ static void webu_getimg_motion(cls_camera *cam)
                 ,cam->imgs.width
                 ,cam->imgs.height);
             cam->stream.motion.consumed = false;
+            webu_getimg_part(&cam->stream.motion);
         }
     }
     if ((cam->stream.motion.ts_cnct > 0) || (cam->stream.motion.all_cnct > 0)) {
@@ -236,6 +436,7 @@ static void webu_getimg_motion(cls_camera *cam)
         memcpy(cam->stream.motion.img_data
             , cam->imgs.image_motion.image_norm
             , (uint)cam->imgs.size_norm);
+        cam->stream.motion.img_nbr++;
     }
 }
 
@@ -261,6 +462,7 @@ static void webu_getimg_source(cls_camera *cam)
                 ,cam->imgs.width
                 ,cam->imgs.height);
             cam->stream.source.consumed = false;
+            webu_getimg_part(&cam->stream.source);
         }
     }
     if ((cam->stream.source.ts_cnct > 0) || (cam->stream.source.all_cnct > 0)) {
@@ -270,6 +472,7 @@ static void webu_getimg_source(cls_camera *cam)
         memcpy(cam->stream.source.img_data
             , cam->imgs.image_virgin
             , (uint)cam->imgs.size_norm);
+        cam->stream.source.img_nbr++;
     }
 }
 
@@ -294,9 +497,11 @@ static void webu_getimg_secondary(cls_camera *cam)
                     , cam->imgs.image_secondary
                     , (uint)cam->imgs.size_secondary);
                 cam->stream.secondary.jpg_sz = cam->imgs.size_secondary;
+                webu_getimg_part(&cam->stream.secondary);
             pthread_mutex_unlock(&cam->algsec->mutex);
         } else {
             myfree(cam->stream.secondary.jpg_data);
+            webu_getimg_part_free(&cam->stream.secondary);
         }
     }
     if ((cam->stream.secondary.ts_cnct > 0) || (cam->stream.secondary.all_cnct > 0)) {
@@ -306,19 +511,90 @@ static void webu_getimg_secondary(cls_camera *cam)
         }
         memcpy(cam->stream.secondary.img_data
             , cam->current_image->image_norm, (uint)cam->imgs.size_norm);
+        cam->stream.secondary.img_nbr++;
+    }
+
+}
+
+/*
+ * Resume the stream connections that were suspended until new images are
+ * published.  Called with the stream mutex locked.
+ */
+void webu_getimg_resume(ctx_stream *stream)
+{
+    cls_webu_stream *webus;
+
+    while (stream->pub_wait != nullptr) {
+        webus = stream->pub_wait;
+        stream->pub_wait = webus->pub_next;
+        webus->pub_next = nullptr;
+        webus->resume();
     }
+}
 
+/*
+ * Scale and compress the image for each rung of the ladder with clients.
+ * This is done outside of the stream mutex and only the finished jpg is
+ * swapped in with the mutex locked so the other streams are not held up.
+ */
+static void webu_getimg_ladder(cls_camera *cam)
+{
+    int indx, jpg_sz;
+    bool busy;
+    u_char *tmp;
+    ctx_stream_data *strm;
+    ctx_stream_rung *rung;
+
+    if (cam->current_image->image_norm == NULL) {
+        return;
+    }
+
+    for (indx=0; indx<cam->stream.rung_cnt; indx++) {
+        strm = &cam->stream.ladder[indx];
+        rung = &cam->stream.rung[indx];
+
+        pthread_mutex_lock(&cam->stream.mutex);
+            busy = ((strm->jpg_cnct > 0) && strm->consumed);
+        pthread_mutex_unlock(&cam->stream.mutex);
+        if (busy == false) {
+            continue;
+        }
+
+        cam->app->resize->scale(cam->current_image->image_norm
+            , cam->imgs.width, cam->imgs.height
+            , rung->img, rung->width, rung->height
+            , AV_PIX_FMT_YUV420P);
+        jpg_sz = cam->picture->put_memory(rung->jpg, rung->img_sz
+            , rung->img, rung->quality, rung->width, rung->height);
+
+        pthread_mutex_lock(&cam->stream.mutex);
+            if (strm->jpg_data == NULL) {
+                strm->jpg_data = (u_char*)mymalloc((uint)rung->img_sz);
+            }
+            tmp = strm->jpg_data;
+            strm->jpg_data = rung->jpg;
+            rung->jpg = tmp;
+            strm->jpg_sz = jpg_sz;
+            strm->consumed = false;
+            webu_getimg_part(strm);
+        pthread_mutex_unlock(&cam->stream.mutex);
+    }
 }
 
 /* Get image from the motion loop and compress it*/
 void webu_getimg_main(cls_camera *cam)
 {
     /*This is on the camera thread */
+    webu_getimg_ladder(cam);
+
     pthread_mutex_lock(&cam->stream.mutex);
         webu_getimg_norm(cam);
         webu_getimg_sub(cam);
         webu_getimg_motion(cam);
         webu_getimg_source(cam);
         webu_getimg_secondary(cam);
+        cam->stream.pub_nbr++;
+        pthread_cond_broadcast(&cam->stream.cond_pub);
+        webu_getimg_resume(&cam->stream);
     pthread_mutex_unlock(&cam->stream.mutex);
 }
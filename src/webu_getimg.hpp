@@ -22,5 +22,9 @@
     void webu_getimg_init(cls_camera *cam);
     void webu_getimg_deinit(cls_camera *cam);
     void webu_getimg_main(cls_camera *cam);
+    void webu_getimg_part(ctx_stream_data *strm);
+    void webu_getimg_release(ctx_stream_data *strm, ctx_stream_jpg *part);
+    void webu_getimg_part_free(ctx_stream_data *strm);
+    void webu_getimg_resume(ctx_stream *stream);
 
 #endif
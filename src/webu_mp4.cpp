@@ -0,0 +1,452 @@
+/*
+ *    This file is part of MotionPlus.
+ *
+ *    MotionPlus is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ *
+ *    MotionPlus is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License
+ *    along with MotionPlus.  If not, see <https://www.gnu.org/licenses/>.
+ *
+*/
+
+#include "motionplus.hpp"
+#include "util.hpp"
+#include "camera.hpp"
+#include "conf.hpp"
+#include "logger.hpp"
+#include "netcam.hpp"
+#include "webu.hpp"
+#include "webu_ans.hpp"
+#include "webu_stream.hpp"
+#include "webu_mp4.hpp"
+
+/****** Callback functions for MHD ****************************************/
+
+static int webu_mp4_avio_buf(void *opaque, myuint *buf, int buf_size)
+{
+    cls_webu_mp4 *webu_mp4;
+    webu_mp4 =(cls_webu_mp4 *)opaque;
+    return webu_mp4->avio_buf(buf, buf_size);
+}
+
+static ssize_t webu_mp4_response(void *cls, uint64_t pos, char *buf, size_t max)
+{
+    cls_webu_mp4 *webu_mp4;
+    (void)pos;
+    webu_mp4 =(cls_webu_mp4 *)cls;
+    return webu_mp4->response(buf, max);
+}
+
+/********Class Functions ****************************************************/
+
+/*
+ * Lock the stream mutex of the camera and look up its netcam.  The camera
+ * changes dev_nbr with this mutex locked before it deletes the netcam so
+ * the netcam stays valid until netcam_unlock.  Returns false with nothing
+ * locked once the device the stream was opened on has been closed.
+ */
+bool cls_webu_mp4::netcam_lock()
+{
+    pthread_mutex_lock(&webua->cam->stream.mutex);
+    if (webua->cam->imgs.size_high > 0) {
+        netcam = webua->cam->netcam_high;
+    } else {
+        netcam = webua->cam->netcam;
+    }
+    if ((netcam == nullptr) || (webua->cam->stream.dev_nbr != dev_nbr)) {
+        netcam = nullptr;
+        pthread_mutex_unlock(&webua->cam->stream.mutex);
+        return false;
+    }
+    return true;
+}
+
+void cls_webu_mp4::netcam_unlock()
+{
+    netcam = nullptr;
+    pthread_mutex_unlock(&webua->cam->stream.mutex);
+}
+
+/*
+ * Reference the video packets the camera sent since the last call.  A new
+ * connection or one that has fallen behind the array starts again at the
+ * newest keyframe.  Returns the count of packets put in pkts or -1 once
+ * the camera has closed the netcam.
+ */
+int cls_webu_mp4::pkts_get()
+{
+    int indx, cnt;
+    int64_t key_pdts;
+
+    if (netcam_lock() == false) {
+        return -1;
+    }
+
+    cnt = 0;
+    pthread_mutex_lock(&netcam->mutex_pktarray);
+        if (netcam->pktarray_size == 0) {
+            pthread_mutex_unlock(&netcam->mutex_pktarray);
+            netcam_unlock();
+            return 0;
+        }
+
+        indx = -1;
+        if (idnbr_last != 0) {
+            indx = netcam->pktarray_find(idnbr_last + 1);
+        }
+        if (indx == -1) {
+            indx = netcam->pktarray_key(INT64_MAX, &key_pdts);
+            if ((indx == -1) ||
+                (netcam->pktarray[indx].idnbr <= idnbr_last)) {
+                /* Nothing new from the camera yet */
+                pthread_mutex_unlock(&netcam->mutex_pktarray);
+                netcam_unlock();
+                return 0;
+            }
+            if (idnbr_last == 0) {
+                base_pdts = key_pdts;
+            } else {
+                MOTPLS_LOG(NTC, TYPE_STREAM, NO_ERRNO
+                    ,_("Pass-through packets lost.  Skipping to next keyframe."));
+            }
+        }
+
+        while ((indx != -1) && (cnt < WEBU_MP4_PKTS)) {
+            if ((netcam->pktarray[indx].packet->stream_index ==
+                    netcam->video_stream_index) &&
+                (netcam->pktarray[indx].packet->size > 0)) {
+                if (av_packet_ref(pkts[cnt], netcam->pktarray[indx].packet) == 0) {
+                    cnt++;
+                }
+            }
+            idnbr_last = netcam->pktarray[indx].idnbr;
+            indx = netcam->pktarray_find(idnbr_last + 1);
+        }
+    pthread_mutex_unlock(&netcam->mutex_pktarray);
+    netcam_unlock();
+
+    return cnt;
+}
+
+/* Mux the packets received since the last call into the response */
+int cls_webu_mp4::getimg()
+{
+    int retcd, indx, cnt;
+    char errstr[128];
+    AVPacket *pkt;
+
+    if (webus->check_finish() == true) {
+        return 0;
+    }
+
+    retcd = 0;
+    cnt = pkts_get();
+    if (cnt < 0) {
+        return -1;
+    }
+    for (indx=0; indx<cnt; indx++) {
+        pkt = pkts[indx];
+        if ((retcd >= 0) &&
+            (pkt->pts != AV_NOPTS_VALUE) && (pkt->pts >= base_pdts) &&
+            (pkt->dts != AV_NOPTS_VALUE) && (pkt->dts >= base_pdts)) {
+            pkt->stream_index = 0;
+            pkt->pts -= base_pdts;
+            pkt->dts -= base_pdts;
+            if (pkt->duration <= 0) {
+                pkt->duration = frame_dur;
+            }
+            av_packet_rescale_ts(pkt, src_tbase, fmtctx->streams[0]->time_base);
+            /* The muxer refuses time stamps that go back */
+            if (pkt->dts > dts_last) {
+                dts_last = pkt->dts;
+                retcd = av_write_frame(fmtctx, pkt);
+                if (retcd < 0) {
+                    av_strerror(retcd, errstr, sizeof(errstr));
+                    MOTPLS_LOG(ERR, TYPE_STREAM, NO_ERRNO
+                        ,_("Error while writing video frame. %s"), errstr);
+                }
+            }
+        }
+        av_packet_unref(pkt);
+    }
+
+    /* Send what there is as a fragment rather than wait for the next keyframe */
+    if ((retcd >= 0) && (cnt > 0)) {
+        retcd = av_write_frame(fmtctx, nullptr);
+        avio_flush(fmtctx->pb);
+    }
+
+    if (retcd < 0) {
+        return -1;
+    }
+
+    return 0;
+}
+
+int cls_webu_mp4::avio_buf(myuint *buf, int buf_size)
+{
+    if (webus->resp_size < (size_t)buf_size + webus->resp_used) {
+        webus->resp_size = (size_t)buf_size + webus->resp_used;
+        webus->resp_image = (unsigned char*)realloc(
+            webus->resp_image, webus->resp_size);
+    }
+
+    memcpy(webus->resp_image + webus->resp_used, buf, (uint)buf_size);
+    webus->resp_used += (uint)buf_size;
+
+    return buf_size;
+}
+
+ssize_t cls_webu_mp4::response(char *buf, size_t max)
+{
+    size_t sent_bytes;
+
+    if (webus->check_finish()) {
+        return -1;
+    }
+
+    /* The packets after a reconnect may not match the header sent */
+    if (netcam_lock() == false) {
+        return -1;
+    }
+    if ((netcam->status == NETCAM_NOTCONNECTED) ||
+        (netcam->status == NETCAM_RECONNECTING)) {
+        netcam_unlock();
+        return -1;
+    }
+    netcam_unlock();
+
+    /* The header is already in the response so packets are added after it */
+    if (stream_pos == 0) {
+        if (webus->delay() == false) {
+            return 0;
+        }
+        if (getimg() < 0) {
+            return -1;
+        }
+    }
+
+    if (webus->resp_used == 0) {
+        return 0;
+    }
+
+    if ((webus->resp_used - stream_pos) > max) {
+        sent_bytes = max;
+    } else {
+        sent_bytes = webus->resp_used - stream_pos;
+    }
+
+    memcpy(buf, webus->resp_image + stream_pos, (uint)sent_bytes);
+
+    stream_pos = stream_pos + sent_bytes;
+    if (stream_pos >= webus->resp_used) {
+        stream_pos = 0;
+        webus->resp_used = 0;
+    }
+
+    return (ssize_t)sent_bytes;
+}
+
+int cls_webu_mp4::open_mp4()
+{
+    int retcd, indx;
+    char errstr[128];
+    unsigned char   *buf_image;
+    AVStream        *fmt_strm, *stream_in;
+    AVRational      frame_rate;
+    AVDictionary    *opts;
+    size_t          aviobuf_sz;
+
+    opts = NULL;
+    aviobuf_sz = 4096;
+
+    if (webua->cam->movie_passthrough == false) {
+        MOTPLS_LOG(ERR, TYPE_STREAM, NO_ERRNO
+            ,_("The mp4 stream requires movie_passthrough on a netcam"));
+        return -1;
+    }
+
+    pthread_mutex_lock(&webua->cam->stream.mutex);
+        dev_nbr = webua->cam->stream.dev_nbr;
+    pthread_mutex_unlock(&webua->cam->stream.mutex);
+
+    if (netcam_lock() == false) {
+        MOTPLS_LOG(NTC, TYPE_STREAM, NO_ERRNO
+            ,_("Netcam not ready for the mp4 stream"));
+        return -1;
+    }
+    if ((netcam->status == NETCAM_NOTCONNECTED) ||
+        (netcam->status == NETCAM_RECONNECTING)) {
+        netcam_unlock();
+        MOTPLS_LOG(NTC, TYPE_STREAM, NO_ERRNO
+            ,_("Netcam not ready for the mp4 stream"));
+        return -1;
+    }
+
+    retcd = -1;
+    stream_in = nullptr;
+    frame_rate = av_make_q(0, 1);
+    pthread_mutex_lock(&netcam->mutex_transfer);
+        if (netcam->transfer_format != nullptr) {
+            for (indx=0; indx<(int)netcam->transfer_format->nb_streams; indx++) {
+                stream_in = netcam->transfer_format->streams[indx];
+                if (stream_in->codecpar->codec_type == AVMEDIA_TYPE_VIDEO) {
+                    break;
+                }
+                stream_in = nullptr;
+            }
+        }
+        if (stream_in != nullptr) {
+            fmtctx = avformat_alloc_context();
+            fmtctx->oformat = av_guess_format("mp4", NULL, NULL);
+            fmt_strm = avformat_new_stream(fmtctx, NULL);
+            retcd = avcodec_parameters_copy(fmt_strm->codecpar, stream_in->codecpar);
+            fmt_strm->codecpar->codec_tag = 0;
+            fmt_strm->time_base = stream_in->time_base;
+            src_tbase = stream_in->time_base;
+            frame_rate = stream_in->avg_frame_rate;
+        }
+    pthread_mutex_unlock(&netcam->mutex_transfer);
+    netcam_unlock();
+
+    if (stream_in == nullptr) {
+        MOTPLS_LOG(ERR, TYPE_STREAM, NO_ERRNO
+            ,_("No pass-through video from the netcam"));
+        return -1;
+    }
+    if (retcd < 0) {
+        av_strerror(retcd, errstr, sizeof(errstr));
+        MOTPLS_LOG(ERR, TYPE_STREAM, NO_ERRNO
+            ,_("Unable to copy codec parameters: %s"), errstr);
+        return -1;
+    }
+
+    if ((frame_rate.num <= 0) || (frame_rate.den <= 0)) {
+        frame_rate = av_make_q(MAX(webua->cam->cfg->framerate, 1), 1);
+    }
+    frame_dur = av_rescale_q(1, av_inv_q(frame_rate), src_tbase);
+    webus->stream_fps = (int)((frame_rate.num + frame_rate.den - 1) / frame_rate.den);
+
+    webus->one_buffer();
+    webus->resp_used = 0;
+
+    buf_image = (unsigned char*)av_malloc(aviobuf_sz);
+    fmtctx->pb = avio_alloc_context(
+        buf_image, (int)aviobuf_sz, 1, this
+        , NULL, &webu_mp4_avio_buf, NULL);
+    fmtctx->flags = AVFMT_FLAG_CUSTOM_IO;
+
+    av_dict_set(&opts, "movflags", "frag_keyframe+empty_moov+default_base_moof", 0);
+    retcd = avformat_write_header(fmtctx, &opts);
+    av_dict_free(&opts);
+    if (retcd < 0) {
+        av_strerror(retcd, errstr, sizeof(errstr));
+        MOTPLS_LOG(ERR, TYPE_STREAM, NO_ERRNO
+            ,_("Failed to write header!: %s"), errstr);
+        return -1;
+    }
+    avio_flush(fmtctx->pb);
+
+    for (indx=0; indx<WEBU_MP4_PKTS; indx++) {
+        pkts[indx] = mypacket_alloc(pkts[indx]);
+    }
+    idnbr_last = 0;
+    dts_last = -1;
+    stream_pos = 0;
+
+    return 0;
+}
+
+mhdrslt cls_webu_mp4::main()
+{
+    mhdrslt retcd;
+    struct MHD_Response *response;
+    int indx;
+
+    if (open_mp4() < 0 ) {
+        MOTPLS_LOG(ERR, TYPE_STREAM, NO_ERRNO, _("Unable to open mp4"));
+        return MHD_NO;
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &webus->time_last);
+
+    response = MHD_create_response_from_callback (MHD_SIZE_UNKNOWN, 4096
+        ,&webu_mp4_response, this, NULL);
+    if (!response) {
+        MOTPLS_LOG(ERR, TYPE_STREAM, NO_ERRNO, _("Invalid response"));
+        return MHD_NO;
+    }
+
+    if (webu->wb_headers->params_cnt > 0) {
+        for (indx=0;indx<webu->wb_headers->params_cnt;indx++) {
+            MHD_add_response_header (response
+                , webu->wb_headers->params_array[indx].param_name.c_str()
+                , webu->wb_headers->params_array[indx].param_value.c_str());
+        }
+    }
+
+    MHD_add_response_header(response, "Content-Type", "video/mp4");
+    MHD_add_response_header(response, "Cache-Control", "no-cache");
+
+    retcd = MHD_queue_response (webua->connection, MHD_HTTP_OK, response);
+    MHD_destroy_response (response);
+
+    return retcd;
+}
+
+cls_webu_mp4::cls_webu_mp4(cls_webu_ans *p_webua, cls_webu_stream *p_webus)
+{
+    int indx;
+
+    app    = p_webua->app;
+    webu   = p_webua->webu;
+    webua  = p_webua;
+    webus  = p_webus;
+
+    netcam = nullptr;
+    dev_nbr = 0;
+    fmtctx = nullptr;
+    src_tbase = av_make_q(1, 90000);
+    frame_dur = 0;
+    idnbr_last = 0;
+    base_pdts = 0;
+    dts_last = -1;
+    stream_pos = 0;
+    for (indx=0; indx<WEBU_MP4_PKTS; indx++) {
+        pkts[indx] = nullptr;
+    }
+}
+
+cls_webu_mp4::~cls_webu_mp4()
+{
+    int indx;
+
+    app    = nullptr;
+    webu   = nullptr;
+    webua  = nullptr;
+    netcam = nullptr;
+    for (indx=0; indx<WEBU_MP4_PKTS; indx++) {
+        if (pkts[indx] != nullptr) {
+            av_packet_free(&pkts[indx]);
+        }
+    }
+    if (fmtctx != nullptr) {
+        if (fmtctx->pb != nullptr) {
+            if (fmtctx->pb->buffer != nullptr) {
+                av_free(fmtctx->pb->buffer);
+                fmtctx->pb->buffer = nullptr;
+            }
+            avio_context_free(&fmtctx->pb);
+            fmtctx->pb = nullptr;
+        }
+        avformat_free_context(fmtctx);
+        fmtctx = nullptr;
+    }
+}
@@ -0,0 +1,61 @@
+/*
+ *    This file is part of MotionPlus.
+ *
+ *    MotionPlus is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ *
+ *    MotionPlus is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License
+ *    along with MotionPlus.  If not, see <https://www.gnu.org/licenses/>.
+ *
+*/
+
+#ifndef _INCLUDE_WEBU_MP4_HPP_
+#define _INCLUDE_WEBU_MP4_HPP_
+
+    #define WEBU_MP4_PKTS   64  /* Packets taken from the camera in one pass */
+
+    /*
+     * Fragmented mp4 of the packets the camera sent.  The packets are taken
+     * from the pass-through array of the netcam and muxed as they are so
+     * nothing is decoded or encoded for the connection.
+     */
+    class cls_webu_mp4 {
+        public:
+            cls_webu_mp4(cls_webu_ans *p_webua, cls_webu_stream *p_webus);
+            ~cls_webu_mp4();
+            int avio_buf(myuint *buf, int buf_size);
+            ssize_t response(char *buf, size_t max);
+            mhdrslt main();
+
+        private:
+            cls_motapp      *app;
+            cls_webu        *webu;
+            cls_webu_ans    *webua;
+            cls_webu_stream *webus;
+
+            cls_netcam      *netcam;        /* Only set between netcam_lock and netcam_unlock */
+            int64_t         dev_nbr;        /* dev_nbr of the camera when the stream opened */
+            AVFormatContext *fmtctx;
+            AVPacket        *pkts[WEBU_MP4_PKTS];
+            AVRational      src_tbase;      /* Time base of the packets from the camera */
+            int64_t         frame_dur;      /* Duration of a frame in src_tbase */
+            int64_t         idnbr_last;     /* Id of the last packet taken from the array */
+            int64_t         base_pdts;      /* Time stamp of the first packet sent */
+            int64_t         dts_last;       /* Last dts written to the muxer */
+            size_t          stream_pos;     /* Position in the response of the data sent */
+
+            bool netcam_lock();
+            void netcam_unlock();
+            int pkts_get();
+            int getimg();
+            int open_mp4();
+    };
+
+#endif /* _INCLUDE_WEBU_MP4_HPP_ */
@@ -45,119 +45,291 @@ static ssize_t webu_mpegts_response(void *cls, uint64_t pos, char *buf, size_t m
     return webu_mpegts->response(buf, max);
 }
 
-/********Class Functions ****************************************************/
+/********Shared encoder ****************************************************/
 
-int cls_webu_mpegts::pic_send(unsigned char *img)
+int cls_webu_tsenc::pic_send()
 {
     int retcd;
     char errstr[128];
     struct timespec curr_ts;
-    int64_t pts_interval;
-
-    if (picture == NULL) {
-        picture = av_frame_alloc();
-        picture->linesize[0] = ctx_codec->width;
-        picture->linesize[1] = ctx_codec->width / 2;
-        picture->linesize[2] = ctx_codec->width / 2;
-
-        picture->format = ctx_codec->pix_fmt;
-        picture->width  = ctx_codec->width;
-        picture->height = ctx_codec->height;
-
-        picture->pict_type = AV_PICTURE_TYPE_I;
-        myframe_key(picture);
-        picture->pts = 1;
-    }
-
-    picture->data[0] = img;
-    picture->data[1] = picture->data[0] +
-        (ctx_codec->width * ctx_codec->height);
-    picture->data[2] = picture->data[1] +
-        ((ctx_codec->width * ctx_codec->height) / 4);
+    int64_t pts_interval, pts_prev;
 
+    pts_prev = picture->pts;
     clock_gettime(CLOCK_REALTIME, &curr_ts);
     pts_interval = ((1000000L * (curr_ts.tv_sec - start_time.tv_sec)) +
         (curr_ts.tv_nsec/1000) - (start_time.tv_nsec/1000));
     picture->pts = av_rescale_q(pts_interval
         ,av_make_q(1,1000000L), ctx_codec->time_base);
+    if (picture->pts <= pts_prev) {
+        picture->pts = pts_prev + 1;
+    }
+
+    if (idr_req) {
+        picture->pict_type = AV_PICTURE_TYPE_I;
+        idr_req = false;
+    } else {
+        picture->pict_type = AV_PICTURE_TYPE_NONE;
+    }
 
     retcd = avcodec_send_frame(ctx_codec, picture);
     if (retcd < 0 ) {
         av_strerror(retcd, errstr, sizeof(errstr));
         MOTPLS_LOG(ERR, TYPE_STREAM, NO_ERRNO
             , _("Error sending frame for encoding:%s"), errstr);
-        av_frame_free(&picture);
-        picture = NULL;
         return -1;
     }
 
     return 0;
 }
 
-int cls_webu_mpegts::pic_get()
+/*
+ * Move the packets from the encoder into the ring.  Each packet is received
+ * into pkt_recv and only replaces the oldest packet of the ring once it is
+ * in hand so the ring always holds WEBU_TS_PKTS valid packets.
+ */
+int cls_webu_tsenc::pic_get()
 {
     int retcd;
     char errstr[128];
     AVPacket *pkt;
 
-    pkt = NULL;
-    pkt = mypacket_alloc(pkt);
-
-    retcd = avcodec_receive_packet(ctx_codec, pkt);
-    if (retcd == AVERROR(EAGAIN)) {
-        av_packet_free(&pkt);
-        pkt = NULL;
-        return -1;
+    while (true) {
+        retcd = avcodec_receive_packet(ctx_codec, pkt_recv);
+        if (retcd == AVERROR(EAGAIN)) {
+            return 0;
+        }
+        if (retcd < 0 ) {
+            av_strerror(retcd, errstr, sizeof(errstr));
+            MOTPLS_LOG(ERR, TYPE_STREAM, NO_ERRNO
+                ,_("Error receiving encoded packet video:%s"), errstr);
+            return -1;
+        }
+        pkt = pkts[(pkt_seq + 1) % WEBU_TS_PKTS];
+        av_packet_unref(pkt);
+        av_packet_move_ref(pkt, pkt_recv);
+        pkt_seq++;
     }
-    if (retcd < 0 ) {
-        av_strerror(retcd, errstr, sizeof(errstr));
+}
+
+/*
+ * Encode the image of the stream unless it was already encoded.  Whichever
+ * connection gets here first after a new image does the work for all.
+ */
+int cls_webu_tsenc::encode(ctx_stream_data *strm, pthread_mutex_t *strm_mutex)
+{
+    int retcd;
+
+    pthread_mutex_lock(&mutex);
+        pthread_mutex_lock(strm_mutex);
+            if ((strm->img_data == nullptr) || (strm->img_nbr == img_nbr)) {
+                pthread_mutex_unlock(strm_mutex);
+                pthread_mutex_unlock(&mutex);
+                return 0;
+            }
+            memcpy(img_buf, strm->img_data, (uint)((width * height * 3)/2));
+            img_nbr = strm->img_nbr;
+            strm->consumed = true;
+        pthread_mutex_unlock(strm_mutex);
+
+        retcd = pic_send();
+        if (retcd == 0) {
+            retcd = pic_get();
+        }
+    pthread_mutex_unlock(&mutex);
+
+    return retcd;
+}
+
+/*
+ * Reference the packets after cnct_seq for a connection.  A connection that
+ * is new or has fallen behind the ring waits for a keyframe and asks the
+ * encoder for one.  Returns the count of packets put in cnct_pkts.
+ */
+int cls_webu_tsenc::pkts_get(int64_t *cnct_seq, bool *cnct_wait, AVPacket **cnct_pkts)
+{
+    int cnt;
+    AVPacket *pkt;
+
+    cnt = 0;
+    pthread_mutex_lock(&mutex);
+        if ((*cnct_seq < 0) || ((pkt_seq - *cnct_seq) > WEBU_TS_PKTS)) {
+            *cnct_seq = pkt_seq;
+            *cnct_wait = true;
+            idr_req = true;
+        }
+        while (*cnct_seq < pkt_seq) {
+            (*cnct_seq)++;
+            pkt = pkts[*cnct_seq % WEBU_TS_PKTS];
+            if (*cnct_wait) {
+                if ((pkt->flags & AV_PKT_FLAG_KEY) == 0) {
+                    continue;
+                }
+                *cnct_wait = false;
+            }
+            if (av_packet_ref(cnct_pkts[cnt], pkt) == 0) {
+                cnt++;
+            }
+        }
+    pthread_mutex_unlock(&mutex);
+
+    return cnt;
+}
+
+int cls_webu_tsenc::open()
+{
+    int retcd;
+    char errstr[128];
+    const AVCodec   *codec;
+
+    codec = avcodec_find_encoder(AV_CODEC_ID_H264);
+    if (codec == nullptr) {
         MOTPLS_LOG(ERR, TYPE_STREAM, NO_ERRNO
-            ,_("Error receiving encoded packet video:%s"), errstr);
-        //Packet is freed upon failure of encoding
+            ,_("Unable to find the H264 encoder"));
         return -1;
     }
 
-    pkt->pts = picture->pts;
+    ctx_codec = avcodec_alloc_context3(codec);
+    ctx_codec->gop_size      = 15;
+    ctx_codec->codec_id      = AV_CODEC_ID_H264;
+    ctx_codec->codec_type    = AVMEDIA_TYPE_VIDEO;
+    ctx_codec->bit_rate      = 400000;
+    ctx_codec->width         = width;
+    ctx_codec->height        = height;
+    ctx_codec->time_base.num = 1;
+    ctx_codec->time_base.den = 90000;
+    ctx_codec->pix_fmt       = AV_PIX_FMT_YUV420P;
+    ctx_codec->max_b_frames  = 1;
+    ctx_codec->flags         |= AV_CODEC_FLAG_GLOBAL_HEADER;
+    ctx_codec->framerate.num  = 1;
+    ctx_codec->framerate.den  = 1;
+    av_opt_set(ctx_codec->priv_data, "profile", "main", 0);
+    av_opt_set(ctx_codec->priv_data, "crf", "22", 0);
+    av_opt_set(ctx_codec->priv_data, "tune", "zerolatency", 0);
+    av_opt_set(ctx_codec->priv_data, "preset", "superfast",0);
+    av_opt_set(ctx_codec->priv_data, "forced-idr", "1",0);
 
-    retcd =  av_interleaved_write_frame(fmtctx, pkt);
-    if (retcd < 0 ) {
+    retcd = avcodec_open2(ctx_codec, codec, nullptr);
+    if (retcd < 0) {
         av_strerror(retcd, errstr, sizeof(errstr));
         MOTPLS_LOG(ERR, TYPE_STREAM, NO_ERRNO
-            ,_("Error while writing video frame. %s"), errstr);
+            ,_("Failed to open codec context for %dx%d transport stream: %s")
+            , width, height, errstr);
         return -1;
     }
 
-    av_packet_free(&pkt);
-    pkt = NULL;
+    img_buf = (u_char*)mymalloc((uint)((width * height * 3)/2));
+
+    picture = av_frame_alloc();
+    picture->linesize[0] = width;
+    picture->linesize[1] = width / 2;
+    picture->linesize[2] = width / 2;
+    picture->data[0] = img_buf;
+    picture->data[1] = picture->data[0] + (width * height);
+    picture->data[2] = picture->data[1] + ((width * height) / 4);
+    picture->format = ctx_codec->pix_fmt;
+    picture->width  = width;
+    picture->height = height;
+    picture->pts = -1;
+
+    clock_gettime(CLOCK_REALTIME, &start_time);
 
     return 0;
 }
 
+cls_webu_tsenc::cls_webu_tsenc(int p_width, int p_height)
+{
+    int indx;
+
+    width = p_width;
+    height = p_height;
+    refcnt = 0;
+    ctx_codec = nullptr;
+    picture = nullptr;
+    img_buf = nullptr;
+    img_nbr = -1;
+    pkt_seq = 0;
+    idr_req = false;
+    for (indx=0; indx<WEBU_TS_PKTS; indx++) {
+        pkts[indx] = mypacket_alloc(nullptr);
+    }
+    pkt_recv = mypacket_alloc(nullptr);
+    pthread_mutex_init(&mutex, nullptr);
+}
+
+cls_webu_tsenc::~cls_webu_tsenc()
+{
+    int indx;
+
+    for (indx=0; indx<WEBU_TS_PKTS; indx++) {
+        av_packet_free(&pkts[indx]);
+    }
+    av_packet_free(&pkt_recv);
+    if (picture != nullptr) {
+        av_frame_free(&picture);
+    }
+    if (ctx_codec != nullptr) {
+        avcodec_free_context(&ctx_codec);
+    }
+    myfree(img_buf);
+    pthread_mutex_destroy(&mutex);
+}
+
+/********Class Functions ****************************************************/
+
 void cls_webu_mpegts::resetpos()
 {
     stream_pos = 0;
     webus->resp_used = 0;
 }
 
+/* Mux the packets encoded since the last call into the response */
 int cls_webu_mpegts::getimg()
 {
-    ctx_stream_data *strm;
-    struct timespec curr_ts;
-    unsigned char *img_data;
-    int img_sz;
+    int retcd, indx, cnt;
+    char errstr[128];
 
     if (webus->check_finish() == true) {
         resetpos();
         return 0;
     }
 
-    clock_gettime(CLOCK_REALTIME, &curr_ts);
-
-    memset(webus->resp_image, '\0', webus->resp_size);
     webus->resp_used = 0;
 
+    if (tsenc->encode(strm, strm_mutex) < 0) {
+        return -1;
+    }
+
+    retcd = 0;
+    cnt = tsenc->pkts_get(&pkt_seq, &key_wait, pkts);
+    for (indx=0; indx<cnt; indx++) {
+        if (retcd >= 0) {
+            pkts[indx]->stream_index = 0;
+            av_packet_rescale_ts(pkts[indx]
+                , tsenc->ctx_codec->time_base, fmtctx->streams[0]->time_base);
+            retcd =  av_interleaved_write_frame(fmtctx, pkts[indx]);
+            if (retcd < 0 ) {
+                av_strerror(retcd, errstr, sizeof(errstr));
+                MOTPLS_LOG(ERR, TYPE_STREAM, NO_ERRNO
+                    ,_("Error while writing video frame. %s"), errstr);
+            }
+        }
+        av_packet_unref(pkts[indx]);
+    }
+
+    if (retcd < 0) {
+        return -1;
+    }
+
+    return 0;
+}
+
+/* Use the shared encoder of the stream, starting one if there is none for the size */
+int cls_webu_mpegts::tsenc_get()
+{
+    int img_w, img_h;
+    cls_webu_tsenc *newenc;
+
     if (webua->device_id > 0) {
-        /* Assign to a local pointer the stream we want */
         if (webua->cnct_type == WEBUI_CNCT_TS_FULL) {
             strm = &webua->cam->stream.norm;
         } else if (webua->cnct_type == WEBUI_CNCT_TS_SUB) {
@@ -169,18 +341,18 @@ int cls_webu_mpegts::getimg()
         } else if (webua->cnct_type == WEBUI_CNCT_TS_SECONDARY) {
             strm = &webua->cam->stream.secondary;
         } else {
-            return 0;
+            return -1;
+        }
+        strm_mutex = &webua->cam->stream.mutex;
+        if ((webua->cnct_type == WEBUI_CNCT_TS_SUB) &&
+            ((webua->cam->imgs.width  % 16) == 0) &&
+            ((webua->cam->imgs.height % 16) == 0)) {
+            img_w = (webua->cam->imgs.width/2);
+            img_h = (webua->cam->imgs.height/2);
+        } else {
+            img_w = webua->cam->imgs.width;
+            img_h = webua->cam->imgs.height;
         }
-        img_sz = (ctx_codec->width * ctx_codec->height * 3)/2;
-        img_data = (unsigned char*) mymalloc((uint)img_sz);
-        pthread_mutex_lock(&webua->cam->stream.mutex);
-            if (strm->img_data == NULL) {
-                memset(img_data, 0x00, (uint)img_sz);
-            } else {
-                memcpy(img_data, strm->img_data, (uint)img_sz);
-                strm->consumed = true;
-            }
-        pthread_mutex_unlock(&webua->cam->stream.mutex);
     } else {
         if (webua->cnct_type == WEBUI_CNCT_TS_FULL) {
             strm = &webua->app->allcam->stream.norm;
@@ -193,34 +365,77 @@ int cls_webu_mpegts::getimg()
         } else if (webua->cnct_type == WEBUI_CNCT_TS_SECONDARY) {
             strm = &webua->app->allcam->stream.secondary;
         } else {
-            return 0;
+            return -1;
         }
-        img_sz = app->allcam->all_sizes.dst_sz;
-        img_data = (unsigned char*) mymalloc((uint)img_sz);
-        pthread_mutex_lock(&webua->app->allcam->stream.mutex);
-            if (strm->img_data == nullptr) {
-                memset(img_data, 0x00, (uint)img_sz);
-            } else {
-                memcpy(img_data, strm->img_data, (uint)img_sz);
-                strm->consumed = true;
-            }
-        pthread_mutex_unlock(&webua->app->allcam->stream.mutex);
-
+        strm_mutex = &webua->app->allcam->stream.mutex;
+        img_w = app->allcam->all_sizes.dst_w;
+        img_h = app->allcam->all_sizes.dst_h;
     }
 
-    if (pic_send(img_data) < 0) {
-        myfree(img_data);
-        return -1;
+    pthread_mutex_lock(strm_mutex);
+        tsenc = strm->ts_enc;
+        if ((tsenc != nullptr) &&
+            (tsenc->width == img_w) && (tsenc->height == img_h)) {
+            tsenc->refcnt++;
+        } else {
+            tsenc = nullptr;
+        }
+    pthread_mutex_unlock(strm_mutex);
+    if (tsenc != nullptr) {
+        return 0;
     }
-    myfree(img_data);
 
-    if (pic_get() < 0) {
+    /* Open outside of the lock so the camera is not held up */
+    newenc = new cls_webu_tsenc(img_w, img_h);
+    if (newenc->open() < 0) {
+        delete newenc;
         return -1;
     }
 
+    /*
+     * Another connection may have started one meanwhile.  An encoder of an
+     * old size is left to the connections still using it.
+     */
+    pthread_mutex_lock(strm_mutex);
+        tsenc = strm->ts_enc;
+        if ((tsenc != nullptr) &&
+            (tsenc->width == img_w) && (tsenc->height == img_h)) {
+            tsenc->refcnt++;
+        } else {
+            tsenc = newenc;
+            newenc = nullptr;
+            tsenc->refcnt = 1;
+            strm->ts_enc = tsenc;
+        }
+    pthread_mutex_unlock(strm_mutex);
+    mydelete(newenc);
+
     return 0;
 }
 
+/* Let go of the shared encoder.  The last connection out frees it */
+void cls_webu_mpegts::tsenc_release()
+{
+    bool last;
+
+    if (tsenc == nullptr) {
+        return;
+    }
+
+    pthread_mutex_lock(strm_mutex);
+        tsenc->refcnt--;
+        last = (tsenc->refcnt == 0);
+        if (last && (strm->ts_enc == tsenc)) {
+            strm->ts_enc = nullptr;
+        }
+    pthread_mutex_unlock(strm_mutex);
+
+    if (last) {
+        delete tsenc;
+    }
+    tsenc = nullptr;
+}
+
 int cls_webu_mpegts::avio_buf(myuint *buf, int buf_size)
 {
     if (webus->resp_size < (size_t)buf_size + webus->resp_used) {
@@ -248,10 +463,10 @@ ssize_t cls_webu_mpegts::response(char *buf, size_t max)
         return -1;
     }
 
-    if (ctx_codec != nullptr) {
+    if (tsenc != nullptr) {
         if ((webua->device_id == 0) &&
-            ((webua->app->allcam->all_sizes.dst_h != ctx_codec->height ) ||
-             (webua->app->allcam->all_sizes.dst_w != ctx_codec->width))) {
+            ((webua->app->allcam->all_sizes.dst_h != tsenc->height ) ||
+             (webua->app->allcam->all_sizes.dst_w != tsenc->width))) {
             return -1;
         }
     }
@@ -262,7 +477,9 @@ ssize_t cls_webu_mpegts::response(char *buf, size_t max)
         } else {
             webus->set_fps();
         }
-        webus->delay();
+        if (webus->delay() == false) {
+            return 0;
+        }
         resetpos();
         if (getimg() < 0) {
             return 0;
@@ -293,83 +510,40 @@ ssize_t cls_webu_mpegts::response(char *buf, size_t max)
 
 int cls_webu_mpegts::open_mpegts()
 {
-    int retcd, img_w, img_h;
+    int retcd, indx;
     char errstr[128];
     unsigned char   *buf_image;
-    AVStream        *strm;
-    const AVCodec   *codec;
+    AVStream        *fmt_strm;
     AVDictionary    *opts;
     size_t          aviobuf_sz;
 
     opts = NULL;
     webus->stream_fps = 30;
     aviobuf_sz = 4096;
-    clock_gettime(CLOCK_REALTIME, &start_time);
     clock_gettime(CLOCK_MONOTONIC, &st_mono_time);
 
-    fmtctx = avformat_alloc_context();
-    fmtctx->oformat = av_guess_format("mpegts", NULL, NULL);
-    fmtctx->video_codec_id = AV_CODEC_ID_H264;
-
-    codec = avcodec_find_encoder(AV_CODEC_ID_H264);
-    strm = avformat_new_stream(fmtctx, codec);
-
-    if (webua->device_id > 0) {
-        if ((webua->cnct_type == WEBUI_CNCT_TS_SUB) &&
-            ((webua->cam->imgs.width  % 16) == 0) &&
-            ((webua->cam->imgs.height % 16) == 0)) {
-            img_w = (webua->cam->imgs.width/2);
-            img_h = (webua->cam->imgs.height/2);
-        } else {
-            img_w = webua->cam->imgs.width;
-            img_h = webua->cam->imgs.height;
-        }
-    } else {
-        if (webus->all_ready() == false) {
-            return -1;
-        }
-        img_w = app->allcam->all_sizes.dst_w;
-        img_h = app->allcam->all_sizes.dst_h;
+    if ((webua->device_id == 0) && (webus->all_ready() == false)) {
+        return -1;
     }
 
-    ctx_codec = avcodec_alloc_context3(codec);
-    ctx_codec->gop_size      = 15;
-    ctx_codec->codec_id      = AV_CODEC_ID_H264;
-    ctx_codec->codec_type    = AVMEDIA_TYPE_VIDEO;
-    ctx_codec->bit_rate      = 400000;
-    ctx_codec->width         = img_w;
-    ctx_codec->height        = img_h;
-    ctx_codec->time_base.num = 1;
-    ctx_codec->time_base.den = 90000;
-    ctx_codec->pix_fmt       = AV_PIX_FMT_YUV420P;
-    ctx_codec->max_b_frames  = 1;
-    ctx_codec->flags         |= AV_CODEC_FLAG_GLOBAL_HEADER;
-    ctx_codec->framerate.num  = 1;
-    ctx_codec->framerate.den  = 1;
-    av_opt_set(ctx_codec->priv_data, "profile", "main", 0);
-    av_opt_set(ctx_codec->priv_data, "crf", "22", 0);
-    av_opt_set(ctx_codec->priv_data, "tune", "zerolatency", 0);
-    av_opt_set(ctx_codec->priv_data, "preset", "superfast",0);
-    av_dict_set(&opts, "movflags", "empty_moov", 0);
-
-    retcd = avcodec_open2(ctx_codec, codec, &opts);
-    if (retcd < 0) {
-        av_strerror(retcd, errstr, sizeof(errstr));
-        MOTPLS_LOG(ERR, TYPE_STREAM, NO_ERRNO
-            ,_("Failed to open codec context for %dx%d transport stream: %s")
-            , img_w, img_h, errstr);
-        av_dict_free(&opts);
+    if (tsenc_get() < 0) {
         return -1;
     }
 
-    retcd = avcodec_parameters_from_context(strm->codecpar, ctx_codec);
+    fmtctx = avformat_alloc_context();
+    fmtctx->oformat = av_guess_format("mpegts", NULL, NULL);
+    fmtctx->video_codec_id = AV_CODEC_ID_H264;
+
+    fmt_strm = avformat_new_stream(fmtctx, NULL);
+
+    retcd = avcodec_parameters_from_context(fmt_strm->codecpar, tsenc->ctx_codec);
     if (retcd < 0) {
         av_strerror(retcd, errstr, sizeof(errstr));
         MOTPLS_LOG(ERR, TYPE_STREAM, NO_ERRNO
             ,_("Failed to copy decoder parameters!: %s"), errstr);
-        av_dict_free(&opts);
         return -1;
     }
+    fmt_strm->time_base = tsenc->ctx_codec->time_base;
 
     if (webua->device_id == 0) {
         webus->all_buffer();
@@ -377,13 +551,13 @@ int cls_webu_mpegts::open_mpegts()
         webus->one_buffer();
     }
 
-
     buf_image = (unsigned char*)av_malloc(aviobuf_sz);
     fmtctx->pb = avio_alloc_context(
         buf_image, (int)aviobuf_sz, 1, this
         , NULL, &webu_mpegts_avio_buf, NULL);
     fmtctx->flags = AVFMT_FLAG_CUSTOM_IO;
 
+    av_dict_set(&opts, "movflags", "empty_moov", 0);
     retcd = avformat_write_header(fmtctx, &opts);
     if (retcd < 0) {
         av_strerror(retcd, errstr, sizeof(errstr));
@@ -393,6 +567,12 @@ int cls_webu_mpegts::open_mpegts()
         return -1;
     }
 
+    for (indx=0; indx<WEBU_TS_PKTS; indx++) {
+        pkts[indx] = mypacket_alloc(pkts[indx]);
+    }
+    pkt_seq = -1;
+    key_wait = true;
+
     stream_pos = 0;
     webus->resp_used = 0;
 
@@ -446,29 +626,37 @@ mhdrslt cls_webu_mpegts::main()
 
 cls_webu_mpegts::cls_webu_mpegts(cls_webu_ans *p_webua, cls_webu_stream *p_webus)
 {
+    int indx;
+
     app    = p_webua->app;
     webu   = p_webua->webu;
     webua  = p_webua;
     webus  = p_webus;
 
     stream_pos    = 0;
-    picture = nullptr;;
-    ctx_codec = nullptr;
+    tsenc = nullptr;
+    strm = nullptr;
+    strm_mutex = nullptr;
     fmtctx = nullptr;
+    pkt_seq = -1;
+    key_wait = true;
+    for (indx=0; indx<WEBU_TS_PKTS; indx++) {
+        pkts[indx] = nullptr;
+    }
 }
 
 cls_webu_mpegts::~cls_webu_mpegts()
 {
+    int indx;
+
+    tsenc_release();
     app    = nullptr;
     webu   = nullptr;
     webua  = nullptr;
-    if (picture != nullptr) {
-        av_frame_free(&picture);
-        picture = nullptr;
-    }
-    if (ctx_codec != nullptr) {
-        avcodec_free_context(&ctx_codec);
-        ctx_codec = nullptr;
+    for (indx=0; indx<WEBU_TS_PKTS; indx++) {
+        if (pkts[indx] != nullptr) {
+            av_packet_free(&pkts[indx]);
+        }
     }
     if (fmtctx != nullptr) {
         if (fmtctx->pb != nullptr) {
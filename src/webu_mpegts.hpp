@@ -19,6 +19,43 @@
 #ifndef _INCLUDE_WEBU_MPEGTS_HPP_
 #define _INCLUDE_WEBU_MPEGTS_HPP_
 
+    #define WEBU_TS_PKTS    64  /* Encoded packets kept for the connections */
+
+    /*
+     * H264 encoder shared by all the mpegts connections of one stream.  Each
+     * image of the stream is encoded once into a ring of packets and every
+     * connection muxes its own transport stream from the ring.
+     */
+    class cls_webu_tsenc {
+        public:
+            cls_webu_tsenc(int p_width, int p_height);
+            ~cls_webu_tsenc();
+
+            int             width;
+            int             height;
+            int             refcnt;     /* Connections using it.  Changed with the stream mutex */
+            AVCodecContext  *ctx_codec;
+
+            int open();
+            int encode(ctx_stream_data *strm, pthread_mutex_t *strm_mutex);
+            int pkts_get(int64_t *pkt_seq, bool *key_wait, AVPacket **pkts);
+
+        private:
+            pthread_mutex_t mutex;
+            AVFrame         *picture;
+            u_char          *img_buf;       /* Copy of the stream image being encoded */
+            int64_t         img_nbr;        /* Update number of the last image encoded */
+            AVPacket        *pkts[WEBU_TS_PKTS];
+            int64_t         pkt_seq;        /* Sequence number of the newest packet */
+            AVPacket        *pkt_recv;      /* Packet being received from the encoder */
+            bool            idr_req;        /* A connection is waiting for a keyframe */
+            struct timespec start_time;
+
+            int pic_send();
+            int pic_get();
+    };
+
+
     class cls_webu_mpegts {
         public:
             cls_webu_mpegts(cls_webu_ans *p_webua, cls_webu_stream *p_webus);
@@ -33,17 +70,20 @@
             cls_webu_ans    *webua;
             cls_webu_stream *webus;
 
-            AVFrame         *picture;
+            cls_webu_tsenc  *tsenc;
+            ctx_stream_data *strm;
+            pthread_mutex_t *strm_mutex;
             AVFormatContext *fmtctx;
-            AVCodecContext  *ctx_codec;
+            AVPacket        *pkts[WEBU_TS_PKTS];
+            int64_t         pkt_seq;        /* Sequence number of the last packet muxed */
+            bool            key_wait;       /* Skip packets until the next keyframe */
             size_t          stream_pos;     /* Stream position of sent image */
-            struct timespec start_time;     /* Start time of the stream*/
             struct timespec st_mono_time;
 
-            int pic_send(unsigned char *img);
-            int pic_get();
             void resetpos();
             int getimg();
+            int tsenc_get();
+            void tsenc_release();
             int open_mpegts();
     };
 
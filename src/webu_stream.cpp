@@ -27,8 +27,10 @@
 #include "webu_ans.hpp"
 #include "webu_stream.hpp"
 #include "webu_mpegts.hpp"
+#include "webu_mp4.hpp"
 #include "alg_sec.hpp"
 #include "jpegutils.hpp"
+#include "webu_getimg.hpp"
 
 static ssize_t webu_mjpeg_response (void *cls, uint64_t pos, char *buf, size_t max)
 {
@@ -53,40 +55,89 @@ void cls_webu_stream::set_fps()
     }
 }
 
-/* Sleep required time to get to the user requested framerate for the stream */
-void cls_webu_stream::delay()
+/*
+ * Wait for the camera to publish new images.  Images published sooner
+ * than the stream rate allows are passed over so the rate is kept without
+ * sleeping.  Returns after WEBU_PUB_WAIT seconds with nothing new so that
+ * the connection is kept alive.  When the connections are answered by a
+ * thread pool, the connection is suspended instead of waited on and false
+ * is returned.  It is resumed once the camera publishes again.
+ */
+bool cls_webu_stream::delay()
 {
-    long   stream_rate;
-    struct timespec time_curr;
-    long   stream_delay;
+    ctx_stream *stream;
+    struct timespec time_curr, time_wait;
+    int64_t interval, early;
+    int retcd;
 
     if (check_finish()) {
-        return;
+        return true;
     }
 
-    clock_gettime(CLOCK_MONOTONIC, &time_curr);
-
-    /* The stream rate MUST be less than 1000000000 otherwise undefined behaviour
-     * will occur with the SLEEP function.
-     */
-    stream_delay = ((time_curr.tv_nsec - time_last.tv_nsec)) +
-        ((time_curr.tv_sec - time_last.tv_sec)*1000000000);
-    if (stream_delay < 0)  {
-        stream_delay = 0;
-    }
-    if (stream_delay > 1000000000 ) {
-        stream_delay = 1000000000;
+    if (webua->device_id == 0) {
+        stream = &app->allcam->stream;
+    } else if (webua->cam != NULL) {
+        stream = &webua->cam->stream;
+    } else {
+        return true;
     }
 
     if (stream_fps >= 1) {
-        stream_rate = ( (1000000000 / stream_fps) - stream_delay);
-        if ((stream_rate > 0) && (stream_rate < 1000000000)) {
-            SLEEP(0,stream_rate);
-        } else if (stream_rate == 1000000000) {
-            SLEEP(1,0);
-        }
+        interval = 1000000000L / stream_fps;
+    } else {
+        interval = 0;
     }
+
+    clock_gettime(CLOCK_MONOTONIC, &time_wait);
+    time_wait.tv_sec += WEBU_PUB_WAIT;
+
+    pthread_mutex_lock(&stream->mutex);
+        while (true) {
+            if (stream->pub_nbr != pub_seen) {
+                pub_seen = stream->pub_nbr;
+                clock_gettime(CLOCK_MONOTONIC, &time_curr);
+                early = ((time_due.tv_sec - time_curr.tv_sec) * 1000000000L) +
+                    (time_due.tv_nsec - time_curr.tv_nsec);
+                if (early <= (interval / 2)) {
+                    break;
+                }
+            }
+            if (webu->stream_suspend) {
+                if (check_finish()) {
+                    break;
+                }
+                pub_next = stream->pub_wait;
+                stream->pub_wait = this;
+                MHD_suspend_connection(webua->connection);
+                pthread_mutex_unlock(&stream->mutex);
+                return false;
+            }
+            retcd = pthread_cond_timedwait(&stream->cond_pub
+                , &stream->mutex, &time_wait);
+            if ((retcd == ETIMEDOUT) || check_finish()) {
+                break;
+            }
+        }
+    pthread_mutex_unlock(&stream->mutex);
+
+    /* The next image is due an interval after this one was due */
     clock_gettime(CLOCK_MONOTONIC, &time_last);
+    if ((time_due.tv_sec < time_last.tv_sec) ||
+        ((time_due.tv_sec == time_last.tv_sec) &&
+         (time_due.tv_nsec < time_last.tv_nsec))) {
+        time_due = time_last;
+    }
+    time_due.tv_nsec += interval;
+    time_due.tv_sec += time_due.tv_nsec / 1000000000L;
+    time_due.tv_nsec = time_due.tv_nsec % 1000000000L;
+
+    return true;
+}
+
+/* Resume the connection suspended in delay.  The stream mutex is locked */
+void cls_webu_stream::resume()
+{
+    MHD_resume_connection(webua->connection);
 }
 
 void cls_webu_stream::one_buffer()
@@ -169,8 +220,6 @@ bool cls_webu_stream::all_ready()
 
 void cls_webu_stream::mjpeg_all_img()
 {
-    char resp_head[80];
-    int  header_len;
     ctx_stream_data *strm;
 
     if (check_finish()) {
@@ -181,10 +230,6 @@ void cls_webu_stream::mjpeg_all_img()
         return;
     }
 
-    all_buffer();
-
-    memset(resp_image, '\0', resp_size);
-
     /* Assign to a local pointer the stream we want */
     if (webua->app == NULL) {
         return;
@@ -202,47 +247,27 @@ void cls_webu_stream::mjpeg_all_img()
         return;
     }
 
-    /* Copy jpg from the motion loop thread */
+    /* Take the part published by the all camera thread */
     pthread_mutex_lock(&webua->app->allcam->stream.mutex);
         set_fps();
-        if (strm->jpg_data == NULL) {
-            pthread_mutex_unlock(&webua->app->allcam->stream.mutex);
-            return;
-        }
-        header_len = snprintf(resp_head, 80
-            ,"--BoundaryString\r\n"
-            "Content-type: image/jpeg\r\n"
-            "Content-Length: %9d\r\n\r\n"
-            ,strm->jpg_sz);
-        memcpy(resp_image, resp_head, (uint)header_len);
-        memcpy(resp_image + header_len
-            , strm->jpg_data
-            , (uint)strm->jpg_sz);
-        /* Copy in the terminator after the jpg data at the end*/
-        memcpy(resp_image + header_len + strm->jpg_sz,"\r\n",2);
-        resp_used =(uint)(header_len + strm->jpg_sz + 2);
-        strm->consumed = true;
+        part_take(strm, &webua->app->allcam->stream.mutex);
     pthread_mutex_unlock(&webua->app->allcam->stream.mutex);
 
 }
 
 void cls_webu_stream::mjpeg_one_img()
 {
-    char resp_head[80];
-    int  header_len;
     ctx_stream_data *strm;
 
     if (check_finish()) {
         return;
     }
 
-    memset(resp_image, '\0', resp_size);
-
     /* Assign to a local pointer the stream we want */
     if (webua->cam == NULL) {
         return;
     } else if (webua->cnct_type == WEBUI_CNCT_JPG_FULL) {
-        strm = &webua->cam->stream.norm;
+        strm = rung_strm(rung);
     } else if (webua->cnct_type == WEBUI_CNCT_JPG_SUB) {
         strm = &webua->cam->stream.sub;
     } else if (webua->cnct_type == WEBUI_CNCT_JPG_MOTION) {
@@ -255,28 +280,155 @@ void cls_webu_stream::mjpeg_one_img()
         return;
     }
 
-    /* Copy jpg from the motion loop thread */
+    /* Take the part published by the motion loop thread */
     pthread_mutex_lock(&webua->cam->stream.mutex);
         set_fps();
-        if (strm->jpg_data == NULL) {
-            pthread_mutex_unlock(&webua->cam->stream.mutex);
-            return;
+        part_take(strm, &webua->cam->stream.mutex);
+    pthread_mutex_unlock(&webua->cam->stream.mutex);
+
+}
+
+/*
+ * Hold the latest part of the stream in place of the one sent before.
+ * The part is shared with the other connections and is not changed once
+ * published so it is sent without a copy of its own.  The stream mutex
+ * is locked.
+ */
+void cls_webu_stream::part_take(ctx_stream_data *strm, pthread_mutex_t *mutex)
+{
+    if (strm->jpg_part != jpg_part) {
+        webu_getimg_release(strm, jpg_part);
+        jpg_part = strm->jpg_part;
+        if (jpg_part != nullptr) {
+            jpg_part->refcnt++;
         }
-        header_len = snprintf(resp_head, 80
-            ,"--BoundaryString\r\n"
-            "Content-type: image/jpeg\r\n"
-            "Content-Length: %9d\r\n\r\n"
-            ,strm->jpg_sz);
-        memcpy(resp_image, resp_head, (uint)header_len);
-        memcpy(resp_image + header_len
-            , strm->jpg_data
-            , (uint)strm->jpg_sz);
-        /* Copy in the terminator after the jpg data at the end*/
-        memcpy(resp_image + header_len + strm->jpg_sz,"\r\n",2);
-        resp_used =(uint)(header_len + strm->jpg_sz + 2);
+    }
+    part_strm = strm;
+    part_mutex = mutex;
+    if (jpg_part == nullptr) {
+        resp_used = 0;
+    } else {
+        resp_used = jpg_part->part_sz;
         strm->consumed = true;
+    }
+}
+
+/* Let go of the part held by the connection */
+void cls_webu_stream::part_release()
+{
+    if (jpg_part == nullptr) {
+        return;
+    }
+    pthread_mutex_lock(part_mutex);
+        webu_getimg_release(part_strm, jpg_part);
+    pthread_mutex_unlock(part_mutex);
+    jpg_part = nullptr;
+}
+
+/* The stream of the normal image for a rung of the ladder */
+ctx_stream_data *cls_webu_stream::rung_strm(int p_rung)
+{
+    if (p_rung > 0) {
+        return &webua->cam->stream.ladder[p_rung - 1];
+    } else {
+        return &webua->cam->stream.norm;
+    }
+}
+
+/*
+ * Move the connection to another rung of the ladder.  The connection is
+ * counted on the stream of the new rung so the camera only scales and
+ * compresses the rungs that have clients.
+ */
+void cls_webu_stream::rung_set(int p_rung)
+{
+    ctx_stream_data *strm;
+
+    if (webua->cam == NULL) {
+        return;
+    }
+
+    pthread_mutex_lock(&webua->cam->stream.mutex);
+        if (p_rung > webua->cam->stream.rung_cnt) {
+            p_rung = webua->cam->stream.rung_cnt;
+        }
+        if (p_rung < 0) {
+            p_rung = 0;
+        }
+        if (p_rung != rung) {
+            strm = rung_strm(rung);
+            if (strm->jpg_cnct > 0) {
+                strm->jpg_cnct--;
+            }
+            rung_strm(p_rung)->jpg_cnct++;
+            if (jpg_part != nullptr) {
+                webu_getimg_release(part_strm, jpg_part);
+                jpg_part = nullptr;
+            }
+            rung = p_rung;
+        }
+        rung_behind = 0;
+        rung_ok = 0;
     pthread_mutex_unlock(&webua->cam->stream.mutex);
+}
 
+/*
+ * Check the send queue of the socket as each part is due.  A client with
+ * more than the last part still queued is not keeping up and after a few
+ * such parts it is moved down a rung.  Once it has kept up for a while it
+ * is moved back up toward the rung it asked for.
+ */
+void cls_webu_stream::rung_check()
+{
+    if ((webua->cam == NULL) || (webua->device_id == 0) ||
+        (webua->cnct_type != WEBUI_CNCT_JPG_FULL)) {
+        return;
+    }
+
+    if (rung > webua->cam->stream.rung_cnt) {
+        rung_set(webua->cam->stream.rung_cnt);
+    }
+    if ((webua->cam->stream.rung_cnt == 0) || (jpg_part == nullptr)) {
+        return;
+    }
+
+    #if (MHD_VERSION >= 0x00094400) && defined(TIOCOUTQ)
+        const union MHD_ConnectionInfo *info;
+        int pending;
+
+        info = MHD_get_connection_info(webua->connection
+            , MHD_CONNECTION_INFO_CONNECTION_FD);
+        if (info == NULL) {
+            return;
+        }
+        pending = 0;
+        if (ioctl(info->connect_fd, TIOCOUTQ, &pending) == -1) {
+            return;
+        }
+
+        if ((size_t)pending > jpg_part->part_sz) {
+            rung_ok = 0;
+            rung_behind++;
+            if ((rung_behind >= WEBU_RUNG_BEHIND) &&
+                (rung < webua->cam->stream.rung_cnt)) {
+                MOTPLS_LOG(DBG, TYPE_STREAM, NO_ERRNO
+                    , _("Stream client %s moved down to rung %d")
+                    , webua->clientip.c_str(), rung + 1);
+                rung_set(rung + 1);
+            }
+        } else {
+            rung_behind = 0;
+            if (pending == 0) {
+                rung_ok++;
+            }
+            if ((rung_ok >= WEBU_RUNG_OK) && (rung > rung_req)) {
+                MOTPLS_LOG(DBG, TYPE_STREAM, NO_ERRNO
+                    , _("Stream client %s moved up to rung %d")
+                    , webua->clientip.c_str(), rung - 1);
+                rung_set(rung - 1);
+            }
+        }
+    #endif
 }
 
 ssize_t cls_webu_stream::mjpeg_response (char *buf, size_t max)
@@ -289,7 +441,10 @@ ssize_t cls_webu_stream::mjpeg_response (char *buf, size_t max)
 
     if ((stream_pos == 0) || (resp_used == 0)) {
 
-        delay();
+        if (delay() == false) {
+            return 0;
+        }
+        rung_check();
 
         stream_pos = 0;
         resp_used = 0;
@@ -311,7 +466,7 @@ ssize_t cls_webu_stream::mjpeg_response (char *buf, size_t max)
         sent_bytes = resp_used - stream_pos;
     }
 
-    memcpy(buf, resp_image + stream_pos, sent_bytes);
+    memcpy(buf, jpg_part->buf + stream_pos, sent_bytes);
 
     stream_pos = stream_pos + sent_bytes;
     if (stream_pos >= resp_used) {
@@ -431,7 +586,8 @@ void cls_webu_stream::jpg_cnct()
     pthread_mutex_unlock(&webua->cam->stream.mutex);
 
 
-    if (strm->jpg_cnct == 1) {
+    if ((strm->jpg_cnct == 1) &&
+        ((webu->stream_suspend == false) || (webua->uri_cmd1 == "static"))) {
         /* This is the first connection so we need to wait half a sec
          * so that the motion loop on the other thread can update image
          */
@@ -527,7 +683,7 @@ void cls_webu_stream::ts_cnct()
         strm->ts_cnct++;
     pthread_mutex_unlock(&webua->cam->stream.mutex);
 
-    if (strm->ts_cnct == 1) {
+    if ((strm->ts_cnct == 1) && (webu->stream_suspend == false)) {
         /* This is the first connection so we need to wait half a sec
          * so that the motion loop on the other thread can update image
          */
@@ -562,6 +718,12 @@ void cls_webu_stream::set_cnct_type()
         } else {
             webua->cnct_type = WEBUI_CNCT_UNKNOWN;
         }
+    } else if (webua->uri_cmd1 == "mp4") {
+        if ((webua->uri_cmd2 == "stream") || (webua->uri_cmd2 == "")) {
+            webua->cnct_type = WEBUI_CNCT_MP4;
+        } else {
+            webua->cnct_type = WEBUI_CNCT_UNKNOWN;
+        }
     } else {
         if (webua->uri_cmd2 == "stream") {
             webua->cnct_type = WEBUI_CNCT_JPG_FULL;
@@ -664,6 +826,7 @@ mhdrslt cls_webu_stream::stream_static()
 mhdrslt cls_webu_stream::main()
 {
     mhdrslt retcd;
+    const char *rung_val;
 
     if (valid_request() == false) {
         webua->bad_request();
@@ -684,10 +847,15 @@ mhdrslt cls_webu_stream::main()
     } else if (webua->uri_cmd1 == "mjpg") {
         if (webua->device_id > 0) {
             jpg_cnct();
-            one_buffer();
+            rung_val = MHD_lookup_connection_value(webua->connection
+                , MHD_GET_ARGUMENT_KIND, "rung");
+            if ((rung_val != NULL) &&
+                (webua->cnct_type == WEBUI_CNCT_JPG_FULL)) {
+                rung_set(atoi(rung_val));
+                rung_req = rung;
+            }
         } else {
             all_cnct();
-            all_buffer();
         }
         retcd = stream_mjpeg();
     } else if (webua->uri_cmd1 == "mpegts") {
@@ -704,6 +872,16 @@ mhdrslt cls_webu_stream::main()
             mydelete(webu_mpegts);
         }
 
+    } else if ((webua->uri_cmd1 == "mp4") &&
+        (webua->cnct_type == WEBUI_CNCT_MP4) && (webua->device_id > 0)) {
+        if (webu_mp4 == nullptr){
+            webu_mp4 = new cls_webu_mp4(webua, this);
+        }
+        retcd = webu_mp4->main();
+        if (retcd == MHD_NO) {
+            mydelete(webu_mp4);
+        }
+
     } else {
         webua->bad_request();
         retcd = MHD_NO;
@@ -718,6 +896,7 @@ cls_webu_stream::cls_webu_stream(cls_webu_ans *p_webua)
     webu   = p_webua->webu;
     webua  = p_webua;
     webu_mpegts = nullptr;
+    webu_mp4 = nullptr;
 
     resp_image    = nullptr;
     resp_size     = 0;
@@ -725,13 +904,31 @@ cls_webu_stream::cls_webu_stream(cls_webu_ans *p_webua)
 
     stream_pos = 0;
     stream_fps = 1;
+    pub_seen   = -1;
+    time_due.tv_sec  = 0;
+    time_due.tv_nsec = 0;
+
+    jpg_part   = nullptr;
+    part_strm  = nullptr;
+    part_mutex = nullptr;
+    pub_next   = nullptr;
+
+    rung        = 0;
+    rung_req    = 0;
+    rung_behind = 0;
+    rung_ok     = 0;
 
 }
 
 cls_webu_stream::~cls_webu_stream()
 {
     mydelete(webu_mpegts);
+    mydelete(webu_mp4);
 
+    if (rung != 0) {
+        rung_set(0);
+    }
+    part_release();
     myfree(resp_image);
 
 }
@@ -18,6 +18,11 @@
 
 #ifndef _INCLUDE_WEBU_STREAM_HPP_
 #define _INCLUDE_WEBU_STREAM_HPP_
+
+    #define WEBU_PUB_WAIT   2   /* Seconds to wait for new images before sending again */
+    #define WEBU_RUNG_BEHIND 3  /* Parts sent while behind before moving down a rung */
+    #define WEBU_RUNG_OK    100 /* Parts sent with nothing queued before moving up a rung */
+
     class cls_webu_stream {
         public:
             cls_webu_stream(cls_webu_ans *webua);
@@ -31,23 +36,40 @@
             mhdrslt main();
             ssize_t mjpeg_response (char *buf, size_t max);
             bool check_finish();
-            void delay();
+            bool delay();
             void set_fps();
             void one_buffer();
             void all_buffer();
             bool all_ready();
             struct timespec time_last;      /* Keep track of processing time for stream thread*/
+            cls_webu_stream *pub_next;      /* Next connection waiting on the same images */
+            void resume();
 
         private:
             cls_motapp      *app;
             cls_webu        *webu;
             cls_webu_ans    *webua;
             cls_webu_mpegts *webu_mpegts;
+            cls_webu_mp4    *webu_mp4;
 
             size_t          stream_pos;
+            int64_t         pub_seen;       /* Publication number of the images last sent */
+            struct timespec time_due;       /* Time the next image is due at the stream rate */
+            ctx_stream_jpg  *jpg_part;      /* The mjpeg part being sent */
+            ctx_stream_data *part_strm;     /* The stream the part is from */
+            pthread_mutex_t *part_mutex;    /* The mutex of that stream */
+            int             rung;           /* Rung of the ladder being sent.  0 is the full image */
+            int             rung_req;       /* Rung asked for by the client */
+            int             rung_behind;    /* Parts in a row sent while the socket was behind */
+            int             rung_ok;        /* Parts in a row sent with the socket empty */
 
             void mjpeg_all_img();
             void mjpeg_one_img();
+            void part_take(ctx_stream_data *strm, pthread_mutex_t *mutex);
+            void part_release();
+            ctx_stream_data *rung_strm(int p_rung);
+            void rung_set(int p_rung);
+            void rung_check();
             void static_all_img();
             void static_one_img();
             mhdrslt stream_static();
@@ -0,0 +1,175 @@
+/*
+ *    This file is part of MotionPlus.
+ *
+ *    MotionPlus is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ *
+ *    MotionPlus is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License
+ *    along with MotionPlus.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "motionplus.hpp"
+#include "util.hpp"
+#include "logger.hpp"
+#include "workpool.hpp"
+
+static void *workpool_handler(void *arg)
+{
+    ((cls_workpool *)arg)->handler();
+    return nullptr;
+}
+
+/* Claim and run one item of the job.  Called and returns with mutex locked */
+bool cls_workpool::claim(ctx_workpool_job *job)
+{
+    int indx;
+
+    if (job->next >= job->cnt) {
+        return false;
+    }
+    indx = job->next++;
+
+    pthread_mutex_unlock(&mutex);
+        job->fn(job->arg, indx);
+    pthread_mutex_lock(&mutex);
+
+    job->done++;
+    if (job->done == job->cnt) {
+        pthread_cond_broadcast(&cond_done);
+    }
+
+    return true;
+}
+
+void cls_workpool::handler()
+{
+    ctx_workpool_job *job;
+
+    mythreadname_set("wp", 0, "workpool");
+
+    pthread_mutex_lock(&mutex);
+    while (handler_stop == false) {
+        job = job_list;
+        while ((job != nullptr) && (job->next >= job->cnt)) {
+            job = job->job_next;
+        }
+        if (job == nullptr) {
+            pthread_cond_wait(&cond_work, &mutex);
+        } else {
+            claim(job);
+        }
+    }
+    pthread_mutex_unlock(&mutex);
+
+    pthread_exit(NULL);
+}
+
+/* Start workers as needed so cnt items can run at once.  Mutex is locked */
+void cls_workpool::start(int cnt)
+{
+    int retcd;
+
+    while ((thread_cnt < (cnt - 1)) && (thread_cnt < thread_max)) {
+        retcd = pthread_create(&threads[thread_cnt], NULL, &workpool_handler, this);
+        if (retcd != 0) {
+            MOTPLS_LOG(WRN, TYPE_ALL, NO_ERRNO,_("Unable to start workpool thread."));
+            thread_max = thread_cnt;
+            return;
+        }
+        thread_cnt++;
+    }
+}
+
+/*
+ * Run fn for each indx from 0 to cnt-1 and return once all have finished.
+ * The calling thread runs items too so this completes even with no workers.
+ */
+void cls_workpool::run(workpool_fn fn, void *arg, int cnt)
+{
+    ctx_workpool_job job, **prev;
+
+    if (cnt <= 1) {
+        if (cnt == 1) {
+            fn(arg, 0);
+        }
+        return;
+    }
+
+    job.fn = fn;
+    job.arg = arg;
+    job.cnt = cnt;
+    job.next = 0;
+    job.done = 0;
+    job.job_next = nullptr;
+
+    pthread_mutex_lock(&mutex);
+        start(cnt);
+
+        prev = &job_list;
+        while (*prev != nullptr) {
+            prev = &(*prev)->job_next;
+        }
+        *prev = &job;
+        pthread_cond_broadcast(&cond_work);
+
+        while (claim(&job)) {
+        }
+        while (job.done < job.cnt) {
+            pthread_cond_wait(&cond_done, &mutex);
+        }
+
+        prev = &job_list;
+        while (*prev != &job) {
+            prev = &(*prev)->job_next;
+        }
+        *prev = job.job_next;
+    pthread_mutex_unlock(&mutex);
+}
+
+cls_workpool::cls_workpool(cls_motapp *p_app)
+{
+    long cpu_cnt;
+
+    app = p_app;
+    job_list = nullptr;
+    thread_cnt = 0;
+    handler_stop = false;
+
+    cpu_cnt = sysconf(_SC_NPROCESSORS_ONLN);
+    if (cpu_cnt < 1) {
+        cpu_cnt = 1;
+    } else if (cpu_cnt > WORKPOOL_MAX_THREADS) {
+        cpu_cnt = WORKPOOL_MAX_THREADS;
+    }
+    thread_max = (int)cpu_cnt;
+
+    pthread_mutex_init(&mutex, NULL);
+    pthread_cond_init(&cond_work, NULL);
+    pthread_cond_init(&cond_done, NULL);
+}
+
+cls_workpool::~cls_workpool()
+{
+    int indx;
+
+    pthread_mutex_lock(&mutex);
+        handler_stop = true;
+        pthread_cond_broadcast(&cond_work);
+    pthread_mutex_unlock(&mutex);
+
+    for (indx = 0; indx < thread_cnt; indx++) {
+        pthread_join(threads[indx], NULL);
+    }
+
+    pthread_mutex_destroy(&mutex);
+    pthread_cond_destroy(&cond_work);
+    pthread_cond_destroy(&cond_done);
+}
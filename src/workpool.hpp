@@ -0,0 +1,64 @@
+/*
+ *    This file is part of MotionPlus.
+ *
+ *    MotionPlus is free software: you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published by
+ *    the Free Software Foundation, either version 3 of the License, or
+ *    (at your option) any later version.
+ *
+ *    MotionPlus is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License
+ *    along with MotionPlus.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef _INCLUDE_WORKPOOL_HPP_
+#define _INCLUDE_WORKPOOL_HPP_
+
+    #define WORKPOOL_MAX_THREADS   32
+
+    typedef void (*workpool_fn)(void *arg, int indx);
+
+    /* A set of items submitted by one caller.  Lives on the caller's stack */
+    struct ctx_workpool_job {
+        workpool_fn         fn;
+        void                *arg;
+        int                 cnt;        /* Number of items */
+        int                 next;       /* Next item to be claimed */
+        int                 done;       /* Number of items finished */
+        ctx_workpool_job    *job_next;
+    };
+
+    /*
+     * Worker threads shared by all the cameras.  Each caller runs items of
+     * its own job while it waits and idle workers take the remaining items
+     * from whichever job has them so no camera waits on another's items.
+     */
+    class cls_workpool {
+        public:
+            cls_workpool(cls_motapp *p_app);
+            ~cls_workpool();
+
+            void run(workpool_fn fn, void *arg, int cnt);
+            void handler();
+
+        private:
+            cls_motapp          *app;
+            pthread_mutex_t     mutex;
+            pthread_cond_t      cond_work;  /* Signaled when a job is added */
+            pthread_cond_t      cond_done;  /* Signaled when a job finishes */
+            ctx_workpool_job    *job_list;
+            pthread_t           threads[WORKPOOL_MAX_THREADS];
+            int                 thread_cnt;
+            int                 thread_max;
+            bool                handler_stop;
+
+            void start(int cnt);
+            bool claim(ctx_workpool_job *job);
+    };
+
+#endif /* _INCLUDE_WORKPOOL_HPP_ */